@@ -0,0 +1,354 @@
+#include "BinaryMesh.h"
+
+#include "Utils.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace rr {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct SectionData {
+    const void* data = nullptr;
+    size_t      size = 0;
+
+    SectionData() = default;
+
+    template <typename T> SectionData(const std::vector<T>& v) : data(v.data()), size(v.size() * sizeof(T)) {}
+};
+
+uint64_t align(uint64_t offset) {
+    return (offset + binary_mesh_alignment - 1) / binary_mesh_alignment * binary_mesh_alignment;
+}
+
+// create_vertex_layout needs a normal for every corner
+bool has_corner_normals(const Mesh& mesh) {
+    return mesh.normal_faces.size() == mesh.num_faces() &&
+           mesh.normal_faces.uniform_size() == mesh.position_faces.uniform_size() &&
+           mesh.normal_faces.offsets() == mesh.position_faces.offsets();
+}
+
+void write_binary(const std::string& path, const Mesh& mesh, bool with_layout, uint64_t source_size,
+                  int64_t source_time) {
+    // the layout is created the way make_visual would create it
+    with_layout = with_layout && (mesh.normal_faces.empty() || has_corner_normals(mesh));
+    VisualMeshLayout layout;
+    if (with_layout && mesh.normal_faces.empty()) {
+        Mesh copy = mesh;
+        set_flat_normals(copy);
+        layout = create_vertex_layout(copy);
+    } else if (with_layout) {
+        layout = create_vertex_layout(mesh);
+    }
+
+    std::array<SectionData, size_t(BinaryMeshSection::Count)> sections = {
+        mesh.positions,
+        mesh.normals,
+        mesh.uvs,
+        mesh.position_faces.indices(),
+        mesh.position_faces.offsets(),
+        mesh.normal_faces.indices(),
+        mesh.normal_faces.offsets(),
+        mesh.uv_faces.indices(),
+        mesh.uv_faces.offsets(),
+        layout.positions,
+        layout.normals,
+        layout.triangles,
+        layout.face_offsets,
+        layout.position_ids,
+        layout.normal_ids,
+    };
+
+    BinaryMeshHeader header;
+    header.has_layout    = with_layout ? 1 : 0;
+    header.source_size   = source_size;
+    header.source_time   = source_time;
+    header.face_sizes[0] = mesh.position_faces.uniform_size();
+    header.face_sizes[1] = mesh.normal_faces.uniform_size();
+    header.face_sizes[2] = mesh.uv_faces.uniform_size();
+    uint64_t offset      = align(sizeof(BinaryMeshHeader));
+    for (size_t i = 0; i < sections.size(); ++i) {
+        header.sections[i] = {offset, sections[i].size};
+        offset             = align(offset + sections[i].size);
+    }
+
+    // Written under another name and renamed, so a reader never maps a half written file
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Failed to open file: " + temp_path);
+        }
+        static const char zeros[binary_mesh_alignment] = {};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        uint64_t position = sizeof(header);
+        for (size_t i = 0; i < sections.size(); ++i) {
+            file.write(zeros, std::streamsize(header.sections[i].offset - position));
+            file.write(static_cast<const char*>(sections[i].data), std::streamsize(sections[i].size));
+            position = header.sections[i].offset + sections[i].size;
+        }
+        if (!file) {
+            throw std::runtime_error("Failed to write binary mesh: " + temp_path);
+        }
+    }
+    fs::rename(temp_path, path);
+}
+
+int64_t modification_time(std::string_view path) {
+    return int64_t(fs::last_write_time(path).time_since_epoch().count());
+}
+
+// Writes the cache, a failure only costs the next load another parse
+bool write_cache(std::string_view path, const Mesh& mesh, uint64_t source_size, int64_t source_time) {
+    try {
+        write_binary(mesh_cache_path(path), mesh, true, source_size, source_time);
+        return true;
+    } catch (const std::exception&) {
+        std::error_code ec;
+        fs::remove(mesh_cache_path(path) + ".tmp", ec);
+        return false;
+    }
+}
+
+// The cache of path if it was written for the current version of the file
+std::optional<BinaryMeshFile> open_current_cache(std::string_view path, uint64_t source_size, int64_t source_time) {
+    std::string     cache_path = mesh_cache_path(path);
+    std::error_code ec;
+    if (!fs::exists(cache_path, ec)) {
+        return std::nullopt;
+    }
+    try {
+        BinaryMeshFile          cache(cache_path);
+        const BinaryMeshHeader& header = cache.header();
+        if (header.source_size == source_size && header.source_time == source_time) {
+            return cache;
+        }
+    } catch (const std::runtime_error&) {
+        // a broken cache is rebuilt
+    }
+    return std::nullopt;
+}
+
+} // namespace
+
+void save_binary(std::string_view path, const Mesh& mesh, bool with_layout) {
+    write_binary(std::string(path), mesh, with_layout, 0, 0);
+}
+
+Mesh load_binary(std::string_view path) {
+    return BinaryMeshFile(path).mesh();
+}
+
+BinaryMeshFile::BinaryMeshFile(std::string_view path) : m_file(path), m_path(path) {
+    BinaryMeshHeader expected;
+    if (m_file.size() < sizeof(BinaryMeshHeader) ||
+        std::memcmp(header().magic, expected.magic, sizeof(expected.magic)) != 0 ||
+        header().version != expected.version) {
+        throw std::runtime_error("Not a binary mesh: " + m_path);
+    }
+    for (const BinaryMeshSectionEntry& entry : header().sections) {
+        if (entry.offset % binary_mesh_alignment != 0 || entry.offset > m_file.size() ||
+            entry.size > m_file.size() - entry.offset) {
+            throw std::runtime_error("Binary mesh is truncated: " + m_path);
+        }
+    }
+    validate();
+}
+
+template <typename T> const T* BinaryMeshFile::section(BinaryMeshSection s, size_t& count) const {
+    const BinaryMeshSectionEntry& entry = header().sections[size_t(s)];
+    count                               = size_t(entry.size / sizeof(T));
+    return reinterpret_cast<const T*>(m_file.data() + entry.offset);
+}
+
+size_t BinaryMeshFile::validate_faces(BinaryMeshSection indices, BinaryMeshSection offsets, uint32_t face_size,
+                                      size_t num_attributes) const {
+    size_t          num_indices = 0;
+    size_t          num_offsets = 0;
+    const uint32_t* index_data  = section<uint32_t>(indices, num_indices);
+    const uint32_t* offset_data = section<uint32_t>(offsets, num_offsets);
+
+    size_t num_faces = 0;
+    if (num_offsets > 0) {
+        if (offset_data[0] != 0 || offset_data[num_offsets - 1] != num_indices ||
+            !std::is_sorted(offset_data, offset_data + num_offsets)) {
+            throw std::runtime_error("Invalid face offsets in binary mesh: " + m_path);
+        }
+        num_faces = num_offsets - 1;
+    } else {
+        if (face_size > 0 ? num_indices % face_size != 0 : num_indices != 0) {
+            throw std::runtime_error("Invalid faces in binary mesh: " + m_path);
+        }
+        num_faces = face_size > 0 ? num_indices / face_size : 0;
+    }
+    if (std::any_of(index_data, index_data + num_indices, [&](uint32_t i) { return i >= num_attributes; })) {
+        throw std::runtime_error("Invalid face indices in binary mesh: " + m_path);
+    }
+    return num_faces;
+}
+
+bool BinaryMeshFile::same_face_sizes(BinaryMeshSection offsets_a, uint32_t face_size_a, BinaryMeshSection offsets_b,
+                                     uint32_t face_size_b, size_t num_faces) const {
+    size_t          num_offsets_a = 0;
+    size_t          num_offsets_b = 0;
+    const uint32_t* a             = section<uint32_t>(offsets_a, num_offsets_a);
+    const uint32_t* b             = section<uint32_t>(offsets_b, num_offsets_b);
+    if (num_offsets_a == 0 && num_offsets_b == 0) {
+        return num_faces == 0 || face_size_a == face_size_b;
+    }
+    // validate_faces made sure that lists with offsets have num_faces + 1 of them
+    for (size_t f = 0; f < num_faces; ++f) {
+        uint32_t size_a = num_offsets_a > 0 ? a[f + 1] - a[f] : face_size_a;
+        uint32_t size_b = num_offsets_b > 0 ? b[f + 1] - b[f] : face_size_b;
+        if (size_a != size_b) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BinaryMeshFile::validate() const {
+    size_t num_positions = 0;
+    size_t num_normals   = 0;
+    size_t num_uvs       = 0;
+    section<glm::vec3>(BinaryMeshSection::Positions, num_positions);
+    section<glm::vec3>(BinaryMeshSection::Normals, num_normals);
+    section<glm::vec2>(BinaryMeshSection::Uvs, num_uvs);
+
+    using S                    = BinaryMeshSection;
+    const uint32_t* face_sizes = header().face_sizes;
+    size_t num_faces        = validate_faces(S::PositionFaces, S::PositionFaceOffsets, face_sizes[0], num_positions);
+    size_t num_normal_faces = validate_faces(S::NormalFaces, S::NormalFaceOffsets, face_sizes[1], num_normals);
+    size_t num_uv_faces     = validate_faces(S::UvFaces, S::UvFaceOffsets, face_sizes[2], num_uvs);
+    if ((num_normal_faces != 0 && num_normal_faces != num_faces) || (num_uv_faces != 0 && num_uv_faces != num_faces)) {
+        throw std::runtime_error("Invalid faces in binary mesh: " + m_path);
+    }
+    // normal and uv faces are read with the corners of the position faces
+    if ((num_normal_faces != 0 &&
+         !same_face_sizes(S::PositionFaceOffsets, face_sizes[0], S::NormalFaceOffsets, face_sizes[1], num_faces)) ||
+        (num_uv_faces != 0 &&
+         !same_face_sizes(S::PositionFaceOffsets, face_sizes[0], S::UvFaceOffsets, face_sizes[2], num_faces))) {
+        throw std::runtime_error("Invalid faces in binary mesh: " + m_path);
+    }
+    if (!has_layout()) {
+        return;
+    }
+
+    size_t num_vertices       = 0;
+    size_t num_layout_normals = 0;
+    size_t num_triangles      = 0;
+    size_t num_face_offsets   = 0;
+    size_t num_position_ids   = 0;
+    size_t num_normal_ids     = 0;
+    section<glm::vec3>(BinaryMeshSection::LayoutPositions, num_vertices);
+    section<glm::vec3>(BinaryMeshSection::LayoutNormals, num_layout_normals);
+    const glm::uvec4* triangles    = section<glm::uvec4>(BinaryMeshSection::LayoutTriangles, num_triangles);
+    const uint32_t*   face_offsets = section<uint32_t>(BinaryMeshSection::LayoutFaceOffsets, num_face_offsets);
+    const uint32_t*   position_ids = section<uint32_t>(BinaryMeshSection::LayoutPositionIds, num_position_ids);
+    const uint32_t*   normal_ids   = section<uint32_t>(BinaryMeshSection::LayoutNormalIds, num_normal_ids);
+    if (num_layout_normals != num_vertices || num_position_ids != num_vertices || num_normal_ids != num_vertices ||
+        num_face_offsets != num_faces + 1 || face_offsets[0] != 0 || face_offsets[num_faces] != num_triangles ||
+        !std::is_sorted(face_offsets, face_offsets + num_face_offsets)) {
+        throw std::runtime_error("Invalid vertex layout in binary mesh: " + m_path);
+    }
+
+    // without normal faces the layout was created with one flat normal per face
+    size_t normal_bound = num_normal_faces != 0 ? num_normals : num_faces;
+    auto   out_of       = [](size_t bound) { return [bound](uint32_t i) { return i >= bound; }; };
+    auto   bad_triangle = [&](const glm::uvec4& t) {
+        return t.x >= num_vertices || t.y >= num_vertices || t.z >= num_vertices;
+    };
+    if (std::any_of(position_ids, position_ids + num_vertices, out_of(num_positions)) ||
+        std::any_of(normal_ids, normal_ids + num_vertices, out_of(normal_bound)) ||
+        std::any_of(triangles, triangles + num_triangles, bad_triangle)) {
+        throw std::runtime_error("Invalid vertex layout in binary mesh: " + m_path);
+    }
+}
+
+// The file was validated when it was opened
+FaceList BinaryMeshFile::face_list(BinaryMeshSection indices, BinaryMeshSection offsets, uint32_t face_size) const {
+    size_t          num_indices = 0;
+    size_t          num_offsets = 0;
+    const uint32_t* index_data  = section<uint32_t>(indices, num_indices);
+    const uint32_t* offset_data = section<uint32_t>(offsets, num_offsets);
+
+    FaceList faces;
+    if (num_offsets > 0) {
+        faces.assign({index_data, index_data + num_indices}, {offset_data, offset_data + num_offsets});
+    } else {
+        faces.assign({index_data, index_data + num_indices}, face_size);
+    }
+    return faces;
+}
+
+Mesh BinaryMeshFile::mesh() const {
+    Mesh   mesh;
+    size_t count = 0;
+
+    const glm::vec3* positions = section<glm::vec3>(BinaryMeshSection::Positions, count);
+    mesh.positions.assign(positions, positions + count);
+    const glm::vec3* normals = section<glm::vec3>(BinaryMeshSection::Normals, count);
+    mesh.normals.assign(normals, normals + count);
+    const glm::vec2* uvs = section<glm::vec2>(BinaryMeshSection::Uvs, count);
+    mesh.uvs.assign(uvs, uvs + count);
+
+    const uint32_t* face_sizes = header().face_sizes;
+    mesh.position_faces =
+        face_list(BinaryMeshSection::PositionFaces, BinaryMeshSection::PositionFaceOffsets, face_sizes[0]);
+    mesh.normal_faces = face_list(BinaryMeshSection::NormalFaces, BinaryMeshSection::NormalFaceOffsets, face_sizes[1]);
+    mesh.uv_faces     = face_list(BinaryMeshSection::UvFaces, BinaryMeshSection::UvFaceOffsets, face_sizes[2]);
+    return mesh;
+}
+
+VisualMeshLayoutView BinaryMeshFile::layout() const {
+    assert(has_layout());
+    // the sizes of the sections and the indices were validated when the file was opened
+    VisualMeshLayoutView view;
+    size_t               count            = 0;
+    size_t               num_face_offsets = 0;
+    view.positions    = section<glm::vec3>(BinaryMeshSection::LayoutPositions, view.num_vertices);
+    view.normals      = section<glm::vec3>(BinaryMeshSection::LayoutNormals, count);
+    view.triangles    = section<glm::uvec4>(BinaryMeshSection::LayoutTriangles, view.num_triangles);
+    view.face_offsets = section<uint32_t>(BinaryMeshSection::LayoutFaceOffsets, num_face_offsets);
+    view.position_ids = section<uint32_t>(BinaryMeshSection::LayoutPositionIds, count);
+    view.normal_ids   = section<uint32_t>(BinaryMeshSection::LayoutNormalIds, count);
+    view.num_faces    = num_face_offsets - 1;
+    return view;
+}
+
+std::string mesh_cache_path(std::string_view path) {
+    return std::string(path) + ".rrmesh";
+}
+
+std::optional<BinaryMeshFile> open_mesh_cache(std::string_view path) {
+    uint64_t source_size = fs::file_size(path);
+    int64_t  source_time = modification_time(path);
+    if (std::optional<BinaryMeshFile> cache = open_current_cache(path, source_size, source_time)) {
+        return cache;
+    }
+    if (!write_cache(path, load_mesh(path), source_size, source_time)) {
+        return std::nullopt;
+    }
+    return BinaryMeshFile(mesh_cache_path(path));
+}
+
+Mesh load_mesh_cached(std::string_view path) {
+    uint64_t source_size = fs::file_size(path);
+    int64_t  source_time = modification_time(path);
+    if (std::optional<BinaryMeshFile> cache = open_current_cache(path, source_size, source_time)) {
+        return cache->mesh();
+    }
+    Mesh mesh = load_mesh(path);
+    write_cache(path, mesh, source_size, source_time);
+    return mesh;
+}
+
+} // namespace rr
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "VisualMesh.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace rr {
+
+// Arrays of a binary mesh file. The faces are stored like in a FaceList, the offsets sections
+// are empty for lists whose faces all have the same size. The layout sections hold the
+// VisualMeshLayout of the mesh in the full vertex format, ready to be uploaded.
+enum class BinaryMeshSection : uint32_t {
+    Positions,
+    Normals,
+    Uvs,
+    PositionFaces,
+    PositionFaceOffsets,
+    NormalFaces,
+    NormalFaceOffsets,
+    UvFaces,
+    UvFaceOffsets,
+    LayoutPositions,
+    LayoutNormals,
+    LayoutTriangles,
+    LayoutFaceOffsets,
+    LayoutPositionIds,
+    LayoutNormalIds,
+    Count
+};
+
+struct BinaryMeshSectionEntry {
+    uint64_t offset = 0; // bytes from the start of the file
+    uint64_t size   = 0; // bytes
+};
+
+// File layout: BinaryMeshHeader, then the sections in the order of BinaryMeshSection, each one
+// starting at a multiple of binary_mesh_alignment so it can be used in place when mapped.
+struct BinaryMeshHeader {
+    char     magic[8] = {'R', 'R', 'M', 'E', 'S', 'H', '\0', '\0'};
+    uint32_t version  = 1;
+    // the layout sections are filled, they were created from the mesh with flat normals if it
+    // has none, like make_visual does
+    uint32_t has_layout = 0;
+    // size and modification time of the file the mesh was loaded from, used by the mesh cache
+    uint64_t source_size = 0;
+    int64_t  source_time = 0;
+    // corners per face of the position, normal and uv faces, 0 if the offsets section is used
+    uint32_t               face_sizes[3] = {0, 0, 0};
+    uint32_t               padding       = 0;
+    BinaryMeshSectionEntry sections[size_t(BinaryMeshSection::Count)];
+};
+
+static_assert(sizeof(BinaryMeshHeader) == 48 + 16 * size_t(BinaryMeshSection::Count));
+
+constexpr size_t binary_mesh_alignment = 64;
+
+// Writes the mesh and, if with_layout is set, its GPU layout. The layout is left out if the
+// normal faces do not match the position faces. Throws std::runtime_error if the file cannot
+// be written.
+void save_binary(std::string_view path, const Mesh& mesh, bool with_layout = true);
+
+// Reads a file written by save_binary. Throws std::runtime_error if it is not a valid binary mesh.
+Mesh load_binary(std::string_view path);
+
+// A memory mapped binary mesh file. mesh() copies the arrays into a Mesh while layout() points
+// into the mapping, so the GPU buffers are written straight from the file pages.
+class BinaryMeshFile {
+public:
+    // Throws std::runtime_error if the file is not a valid binary mesh. Every index is checked
+    // against the array it refers to, so a corrupt file is rejected here instead of being read
+    // out of bounds by the CPU or the GPU.
+    explicit BinaryMeshFile(std::string_view path);
+
+    const BinaryMeshHeader& header() const {
+        return *reinterpret_cast<const BinaryMeshHeader*>(m_file.data());
+    }
+
+    Mesh mesh() const;
+
+    bool has_layout() const {
+        return header().has_layout != 0;
+    }
+
+    // Only valid while this file is alive
+    VisualMeshLayoutView layout() const;
+
+private:
+    template <typename T> const T* section(BinaryMeshSection s, size_t& count) const;
+
+    // Number of faces of a face list, throws if its offsets or its indices are invalid
+    size_t validate_faces(BinaryMeshSection indices, BinaryMeshSection offsets, uint32_t face_size,
+                          size_t num_attributes) const;
+
+    // Whether the first num_faces faces of two face lists have the same number of corners
+    bool same_face_sizes(BinaryMeshSection offsets_a, uint32_t face_size_a, BinaryMeshSection offsets_b,
+                         uint32_t face_size_b, size_t num_faces) const;
+
+    void validate() const;
+
+    FaceList face_list(BinaryMeshSection indices, BinaryMeshSection offsets, uint32_t face_size) const;
+
+    MappedFile  m_file;
+    std::string m_path;
+};
+
+// The binary cache of an OBJ file, <path>.rrmesh
+std::string mesh_cache_path(std::string_view path);
+
+// The cache of the OBJ file at path, rewritten first unless it matches the size and the
+// modification time of the file. Empty if the cache could not be written, e.g. because the
+// directory is read-only.
+std::optional<BinaryMeshFile> open_mesh_cache(std::string_view path);
+
+// Same result as load_mesh(path), but the OBJ file is only parsed when its cache is outdated
+Mesh load_mesh_cached(std::string_view path);
+
+} // namespace rr
@@ -1,6 +1,10 @@
 #pragma once
 
+#include "Parallel.h"
 #include "glm/glm.hpp"
+
+#include <cfloat>
+#include <mutex>
 #include <vector>
 
 namespace rr {
@@ -8,13 +12,20 @@ namespace rr {
 struct BoundingBox {
     BoundingBox() : lower(glm::vec3(FLT_MAX)), upper(glm::vec3(-FLT_MAX)) {}
 
+    // Every thread reduces its own range, the ranges are merged at the end
     explicit BoundingBox(const std::vector<glm::vec3>& pts) {
         lower = glm::vec3(FLT_MAX);
         upper = glm::vec3(-FLT_MAX);
-        for(const glm::vec3& pt : pts) {
-            lower = glm::min(lower, pt);
-            upper = glm::max(upper, pt);
-        }
+        std::mutex mutex;
+        parallel_for(0, pts.size(), [&](size_t begin, size_t end) {
+            BoundingBox range;
+            for (size_t i = begin; i < end; ++i) {
+                range.lower = glm::min(range.lower, pts[i]);
+                range.upper = glm::max(range.upper, pts[i]);
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            expand_to_include(range);
+        });
     }
 
     void expand_to_include(const BoundingBox& other) {
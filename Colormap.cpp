@@ -0,0 +1,154 @@
+#include "Colormap.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <array>
+
+namespace rr {
+
+namespace {
+
+// Polynomial fits of the matplotlib colormaps by Matt Zucker (CC0) and of Turbo by Anton
+// Mikhailov (Apache 2.0), coefficients in increasing order
+using Polynomial = std::array<glm::vec3, 7>;
+
+const Polynomial viridis = {glm::vec3(0.2777273272234177, 0.005407344544966578, 0.3340998053353061),
+                            glm::vec3(0.1050930431085774, 1.404613529898575, 1.384590162594685),
+                            glm::vec3(-0.3308618287255563, 0.214847559468213, 0.09509516302823659),
+                            glm::vec3(-4.634230498983486, -5.799100973351585, -19.33244095627987),
+                            glm::vec3(6.228269936347081, 14.17993336680509, 56.69055260068105),
+                            glm::vec3(4.776384997670288, -13.74514537774601, -65.35303263337234),
+                            glm::vec3(-5.435455855934631, 4.645852612178535, 26.3124352495832)};
+
+const Polynomial plasma = {glm::vec3(0.05873234392399702, 0.02333670892565664, 0.5433401826748754),
+                           glm::vec3(2.176514634195958, 0.2383834171260182, 0.7539604599784036),
+                           glm::vec3(-2.689460476458034, -7.455851135738909, 3.110799939717086),
+                           glm::vec3(6.130348345893603, 42.3461881477227, -28.51885465332158),
+                           glm::vec3(-11.10743619062271, -82.66631109428045, 60.13984767418263),
+                           glm::vec3(10.02306557647065, 71.41361770095349, -54.07218655560067),
+                           glm::vec3(-3.658713842777788, -22.93153465461149, 18.19190778539828)};
+
+const Polynomial magma = {glm::vec3(-0.002136485053939582, -0.000749655052795221, -0.005386127855323933),
+                          glm::vec3(0.2516605407371642, 0.6775232436837668, 2.494026599312351),
+                          glm::vec3(8.353717279216625, -3.577719514958484, 0.3144679030132573),
+                          glm::vec3(-27.66873308576866, 14.26473078096533, -13.64921318813922),
+                          glm::vec3(52.17613981234068, -27.94360607168351, 12.94416944238394),
+                          glm::vec3(-50.76852536473588, 29.04658282127291, 4.23415299384598),
+                          glm::vec3(18.65570506591883, -11.48977351997711, -5.601961508734096)};
+
+const Polynomial turbo = {glm::vec3(0.13572138, 0.09140261, 0.10667330),
+                          glm::vec3(4.61539260, 2.19418839, 12.64194608),
+                          glm::vec3(-42.66032258, 4.84296658, -60.58204836),
+                          glm::vec3(132.13108234, -14.18503333, 110.36276771),
+                          glm::vec3(-152.94239396, 4.27729857, -89.90310912),
+                          glm::vec3(59.28637943, 2.82956604, 27.34824973),
+                          glm::vec3(0.0f)};
+
+glm::vec3 evaluate(const Polynomial& p, float t) {
+    glm::vec3 c = p[6];
+    for (int i = 5; i >= 0; --i) {
+        c = p[i] + t * c;
+    }
+    return c;
+}
+
+// Diverging map by Kenneth Moreland, sampled at 0, 0.25, 0.5, 0.75 and 1
+const std::array<glm::vec3, 5> coolwarm = {glm::vec3(0.230f, 0.299f, 0.754f), glm::vec3(0.552f, 0.690f, 0.996f),
+                                           glm::vec3(0.865f, 0.865f, 0.865f), glm::vec3(0.958f, 0.604f, 0.482f),
+                                           glm::vec3(0.706f, 0.016f, 0.150f)};
+
+} // namespace
+
+const char* colormap_name(Colormap colormap) {
+    switch (colormap) {
+    case Colormap::Viridis:
+        return "viridis";
+    case Colormap::Plasma:
+        return "plasma";
+    case Colormap::Magma:
+        return "magma";
+    case Colormap::Turbo:
+        return "turbo";
+    case Colormap::Coolwarm:
+        return "coolwarm";
+    case Colormap::Grayscale:
+        return "grayscale";
+    default:
+        return "unknown";
+    }
+}
+
+glm::vec3 colormap_color(Colormap colormap, float t) {
+    t = std::clamp(t, 0.0f, 1.0f);
+    glm::vec3 c(t);
+    switch (colormap) {
+    case Colormap::Viridis:
+        c = evaluate(viridis, t);
+        break;
+    case Colormap::Plasma:
+        c = evaluate(plasma, t);
+        break;
+    case Colormap::Magma:
+        c = evaluate(magma, t);
+        break;
+    case Colormap::Turbo:
+        c = evaluate(turbo, t);
+        break;
+    case Colormap::Coolwarm: {
+        float  x = t * float(coolwarm.size() - 1);
+        size_t i = std::min(size_t(x), coolwarm.size() - 2);
+        c        = glm::mix(coolwarm[i], coolwarm[i + 1], x - float(i));
+        break;
+    }
+    default:
+        break;
+    }
+    return glm::clamp(c, glm::vec3(0.0f), glm::vec3(1.0f));
+}
+
+std::vector<uint32_t> colormap_rgba8(Colormap colormap) {
+    std::vector<uint32_t> texels(colormap_resolution);
+    for (uint32_t i = 0; i < colormap_resolution; ++i) {
+        float t   = float(i) / float(colormap_resolution - 1);
+        texels[i] = glm::packUnorm4x8(glm::vec4(colormap_color(colormap, t), 1.0f));
+    }
+    return texels;
+}
+
+WGPUTexture create_colormap_texture(WGPUDevice device, WGPUQueue queue, Colormap colormap) {
+    WGPUTextureFormat     format       = WGPUTextureFormat_RGBA8UnormSrgb;
+    WGPUTextureDescriptor texture_desc = {};
+    texture_desc.dimension             = WGPUTextureDimension_1D;
+    texture_desc.format                = format;
+    texture_desc.mipLevelCount         = 1;
+    texture_desc.sampleCount           = 1;
+    texture_desc.size                  = {colormap_resolution, 1, 1};
+    texture_desc.usage                 = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst;
+    texture_desc.viewFormatCount       = 1;
+    texture_desc.viewFormats           = &format;
+    WGPUTexture texture                = wgpuDeviceCreateTexture(device, &texture_desc);
+
+    write_colormap_texture(queue, texture, colormap);
+    return texture;
+}
+
+void write_colormap_texture(WGPUQueue queue, WGPUTexture texture, Colormap colormap) {
+    std::vector<uint32_t> texels = colormap_rgba8(colormap);
+
+    WGPUImageCopyTexture destination = {};
+    destination.texture              = texture;
+    destination.mipLevel             = 0;
+    destination.origin               = {0, 0, 0};
+    destination.aspect               = WGPUTextureAspect_All;
+
+    WGPUTextureDataLayout source = {};
+    source.offset                = 0;
+    source.bytesPerRow           = colormap_resolution * sizeof(uint32_t);
+    source.rowsPerImage          = 1;
+
+    WGPUExtent3D size = {colormap_resolution, 1, 1};
+    wgpuQueueWriteTexture(queue, &destination, texels.data(), texels.size() * sizeof(uint32_t), &source, &size);
+}
+
+} // namespace rr
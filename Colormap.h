@@ -0,0 +1,29 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <webgpu/webgpu.h>
+
+namespace rr {
+
+enum class Colormap { Viridis, Plasma, Magma, Turbo, Coolwarm, Grayscale, Count };
+
+const char* colormap_name(Colormap colormap);
+
+// Color at t in [0, 1], in sRGB
+glm::vec3 colormap_color(Colormap colormap, float t);
+
+// Number of texels of a colormap texture
+constexpr uint32_t colormap_resolution = 256;
+
+// colormap_resolution sRGB colors packed as RGBA8
+std::vector<uint32_t> colormap_rgba8(Colormap colormap);
+
+// Creates a 1D RGBA8UnormSrgb texture with usage TextureBinding | CopyDst and uploads the colormap
+WGPUTexture create_colormap_texture(WGPUDevice device, WGPUQueue queue, Colormap colormap);
+
+void write_colormap_texture(WGPUQueue queue, WGPUTexture texture, Colormap colormap);
+
+} // namespace rr
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace rr {
+
+// Element ranges of a GPU buffer that changed since the last upload. The ranges are sorted and
+// coalesced when they are read, spans that are at most max_gap elements apart are merged so
+// that many small edits turn into few buffer writes.
+class DirtyRanges {
+public:
+    using Range = std::pair<size_t, size_t>;
+
+    explicit DirtyRanges(size_t max_gap = 64) : m_max_gap(max_gap) {}
+
+    void add(size_t begin, size_t end) {
+        if (begin >= end) {
+            return;
+        }
+        // edits in ascending order extend the last range without growing the list
+        if (!m_ranges.empty() && begin >= m_ranges.back().first && begin <= m_ranges.back().second + m_max_gap) {
+            m_ranges.back().second = std::max(m_ranges.back().second, end);
+            return;
+        }
+        m_sorted = m_sorted && (m_ranges.empty() || begin > m_ranges.back().first);
+        m_ranges.emplace_back(begin, end);
+    }
+
+    void add(size_t i) {
+        add(i, i + 1);
+    }
+
+    void clear() {
+        m_ranges.clear();
+        m_sorted = true;
+    }
+
+    bool empty() const {
+        return m_ranges.empty();
+    }
+
+    // Sorted, disjoint ranges [begin, end)
+    const std::vector<Range>& ranges() {
+        coalesce();
+        return m_ranges;
+    }
+
+private:
+    void coalesce() {
+        if (m_sorted) {
+            return;
+        }
+        std::sort(m_ranges.begin(), m_ranges.end());
+        size_t last = 0;
+        for (size_t i = 1; i < m_ranges.size(); ++i) {
+            if (m_ranges[i].first <= m_ranges[last].second + m_max_gap) {
+                m_ranges[last].second = std::max(m_ranges[last].second, m_ranges[i].second);
+            } else {
+                m_ranges[++last] = m_ranges[i];
+            }
+        }
+        m_ranges.resize(last + 1);
+        m_sorted = true;
+    }
+
+    std::vector<Range> m_ranges;
+    size_t             m_max_gap = 64;
+    bool               m_sorted  = true;
+};
+
+} // namespace rr
@@ -2,6 +2,8 @@
 #pragma once
 
 #include "BoundingBox.h"
+#include "RenderEncoder.h"
+#include <cstdint>
 #include <string>
 #include <webgpu/webgpu.h>
 #include <glm/glm.hpp>
@@ -23,9 +25,17 @@ public:
 
     virtual ~Drawable() = default;
 
-    virtual void draw(WGPURenderPassEncoder renderPass) = 0;
+    // Work of a frame that is not encoded, e.g. writing dirty uniforms. Called every frame
+    // before draw, also when the commands of the drawable are replayed from a render bundle.
+    virtual void update() {}
 
-    virtual void on_camera_update() = 0;
+    // Only encodes commands, so it can record into a render bundle that is replayed while the
+    // commands stay the same, see invalidate_commands
+    virtual void draw(RenderEncoder encoder) = 0;
+
+    // Drawables whose commands differ from frame to frame, e.g. streamed ones, return false
+    // and are never put into a render bundle
+    virtual bool is_static() const { return true; }
 
     virtual void update_ui(std::string name) = 0;
 
@@ -37,9 +47,27 @@ public:
 
     void set_transform_status(TransformStatus status) { m_transform_status = status; }
 
+    // Makes the on-demand loop draw the next frame, see Renderer::set_on_demand_rendering.
+    // Setters that change what is drawn call it.
+    void request_redraw() { m_redraw_requested = true; }
+
+    // Also true while work is pending that is only done in update, e.g. dirty uniforms
+    virtual bool needs_redraw() const { return m_redraw_requested; }
+
+    // The commands encoded by draw changed, e.g. a pipeline, a buffer or a bind group was
+    // replaced or the visibility changed. Render bundles holding the drawable are recorded again.
+    void invalidate_commands() {
+        ++m_commands_version;
+        m_redraw_requested = true;
+    }
+
     const Renderer* m_renderer = nullptr;
     BoundingBox     m_bbox;
     TransformStatus m_transform_status{TransformStatus::None};
+    // cleared by the renderer after each drawn frame
+    bool m_redraw_requested = true;
+    // compared with the version a render bundle was recorded with
+    uint64_t m_commands_version = 0;
 };
 
 } // namespace rr
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+namespace rr {
+
+// The corners of one face inside a FaceList, T is uint32_t or const uint32_t
+template <typename T> class FaceSpan {
+public:
+    FaceSpan() = default;
+
+    FaceSpan(T* begin, T* end) : m_begin(begin), m_end(end) {}
+
+    operator FaceSpan<const T>() const {
+        return {m_begin, m_end};
+    }
+
+    size_t size() const {
+        return size_t(m_end - m_begin);
+    }
+
+    bool empty() const {
+        return m_begin == m_end;
+    }
+
+    T& operator[](size_t i) const {
+        assert(i < size());
+        return m_begin[i];
+    }
+
+    T* begin() const {
+        return m_begin;
+    }
+
+    T* end() const {
+        return m_end;
+    }
+
+private:
+    T* m_begin = nullptr;
+    T* m_end   = nullptr;
+};
+
+// Faces of a mesh stored as one array of corner indices plus the offset of every face (CSR).
+// While all faces have the same size, e.g. in triangle or quad meshes, the offsets are implicit
+// and the list costs exactly one uint32_t per corner. Indexing and iterating yield FaceSpans
+// into the index array, so code written for std::vector<Mesh::Face> keeps working.
+class FaceList {
+public:
+    using ConstFace   = FaceSpan<const uint32_t>;
+    using MutableFace = FaceSpan<uint32_t>;
+
+    template <typename List, typename Face> class Iterator {
+    public:
+        Iterator(List* list, size_t f) : m_list(list), m_face(f) {}
+
+        Face operator*() const {
+            return (*m_list)[m_face];
+        }
+
+        Iterator& operator++() {
+            ++m_face;
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return m_face == other.m_face;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return m_face != other.m_face;
+        }
+
+    private:
+        List*  m_list = nullptr;
+        size_t m_face = 0;
+    };
+
+    using iterator       = Iterator<FaceList, MutableFace>;
+    using const_iterator = Iterator<const FaceList, ConstFace>;
+
+    FaceList() = default;
+
+    // num_faces faces of face_size corners, all indices are zero
+    FaceList(size_t num_faces, uint32_t face_size) {
+        resize(num_faces, face_size);
+    }
+
+    size_t size() const {
+        return m_num_faces;
+    }
+
+    bool empty() const {
+        return m_num_faces == 0;
+    }
+
+    size_t num_indices() const {
+        return m_indices.size();
+    }
+
+    // First corner of face f, offset(size()) is num_indices()
+    size_t offset(size_t f) const {
+        return m_offsets.empty() ? f * m_face_size : m_offsets[f];
+    }
+
+    ConstFace operator[](size_t f) const {
+        assert(f < m_num_faces);
+        const uint32_t* data = m_indices.data();
+        return {data + offset(f), data + offset(f + 1)};
+    }
+
+    MutableFace operator[](size_t f) {
+        assert(f < m_num_faces);
+        uint32_t* data = m_indices.data();
+        return {data + offset(f), data + offset(f + 1)};
+    }
+
+    iterator begin() {
+        return {this, 0};
+    }
+
+    iterator end() {
+        return {this, m_num_faces};
+    }
+
+    const_iterator begin() const {
+        return {this, 0};
+    }
+
+    const_iterator end() const {
+        return {this, m_num_faces};
+    }
+
+    // Any container of indices, e.g. a Mesh::Face or a face of another FaceList
+    template <typename Face> void push_back(const Face& face) {
+        append(face.begin(), face.size());
+    }
+
+    void push_back(std::initializer_list<uint32_t> face) {
+        append(face.begin(), face.size());
+    }
+
+    void reserve(size_t num_faces, size_t num_indices) {
+        m_indices.reserve(num_indices);
+        if (!m_offsets.empty()) {
+            m_offsets.reserve(num_faces + 1);
+        }
+    }
+
+    void resize(size_t num_faces, uint32_t face_size) {
+        m_indices.assign(num_faces * face_size, 0);
+        m_offsets.clear();
+        m_num_faces = num_faces;
+        m_face_size = face_size;
+    }
+
+    // Takes over a filled CSR, offsets has one entry per face plus the total number of indices.
+    // The offsets are dropped if all faces have the same size.
+    void assign(std::vector<uint32_t> indices, std::vector<uint32_t> offsets) {
+        assert(!offsets.empty() && offsets.front() == 0 && offsets.back() == indices.size());
+        m_indices   = std::move(indices);
+        m_offsets   = std::move(offsets);
+        m_num_faces = m_offsets.size() - 1;
+        m_face_size = m_num_faces > 0 ? m_offsets[1] : 0;
+        for (size_t f = 0; f < m_num_faces; ++f) {
+            if (m_offsets[f + 1] - m_offsets[f] != m_face_size) {
+                return;
+            }
+        }
+        m_offsets.clear();
+    }
+
+    // Takes over the indices of faces that all have face_size corners
+    void assign(std::vector<uint32_t> indices, uint32_t face_size) {
+        assert(face_size > 0 ? indices.size() % face_size == 0 : indices.empty());
+        m_num_faces = face_size > 0 ? indices.size() / face_size : 0;
+        m_face_size = face_size;
+        m_indices   = std::move(indices);
+        m_offsets.clear();
+    }
+
+    void clear() {
+        m_indices.clear();
+        m_offsets.clear();
+        m_num_faces = 0;
+        m_face_size = 0;
+    }
+
+    // The size of every face, 0 if the sizes differ
+    uint32_t uniform_size() const {
+        return m_offsets.empty() ? m_face_size : 0;
+    }
+
+    const std::vector<uint32_t>& indices() const {
+        return m_indices;
+    }
+
+    // Empty while all faces have uniform_size() corners
+    const std::vector<uint32_t>& offsets() const {
+        return m_offsets;
+    }
+
+private:
+    template <typename It> void append(It face, size_t n) {
+        if (m_num_faces == 0) {
+            m_face_size = uint32_t(n);
+        } else if (m_offsets.empty() && n != m_face_size) {
+            // the first face of a different size, the offsets become explicit
+            m_offsets.resize(m_num_faces + 1);
+            for (size_t f = 0; f <= m_num_faces; ++f) {
+                m_offsets[f] = uint32_t(f * m_face_size);
+            }
+        }
+        m_indices.insert(m_indices.end(), face, face + std::ptrdiff_t(n));
+        if (!m_offsets.empty()) {
+            assert(m_indices.size() <= UINT32_MAX);
+            m_offsets.push_back(uint32_t(m_indices.size()));
+        }
+        ++m_num_faces;
+    }
+
+    std::vector<uint32_t> m_indices;
+    std::vector<uint32_t> m_offsets;
+    size_t                m_num_faces = 0;
+    uint32_t              m_face_size = 0;
+};
+
+} // namespace rr
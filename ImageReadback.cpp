@@ -0,0 +1,211 @@
+#include "ImageReadback.h"
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+// the PNG encoder vendored with GLFW, static so it cannot clash with another copy
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+#endif
+#define STB_IMAGE_WRITE_STATIC
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "glfw/deps/stb_image_write.h"
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace rr {
+
+ImageFormat image_format_from_path(std::string_view path) {
+    bool png = path.size() >= 4 && path.substr(path.size() - 4) == ".png";
+    return png ? ImageFormat::Png : ImageFormat::Raw;
+}
+
+void write_image(std::string_view path, const Image& image, ImageFormat format) {
+    std::string p(path);
+    if (format == ImageFormat::Png) {
+        if (!stbi_write_png(p.c_str(), int(image.width), int(image.height), 4, image.pixels.data(),
+                            int(image.width * 4))) {
+            throw std::runtime_error("Failed to write image: " + p);
+        }
+        return;
+    }
+    std::ofstream file(p, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(image.pixels.data()), std::streamsize(image.pixels.size()));
+    if (!file) {
+        throw std::runtime_error("Failed to write image: " + p);
+    }
+}
+
+ImageWriter::ImageWriter(size_t max_queued) : m_max_queued(max_queued) {
+    m_thread = std::thread([this]() { run(); });
+}
+
+ImageWriter::~ImageWriter() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_job_added.notify_one();
+    m_thread.join();
+}
+
+void ImageWriter::push(std::string path, Image image, ImageFormat format) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_job_done.wait(lock, [this]() { return m_jobs.size() < m_max_queued; });
+    m_jobs.push_back({std::move(path), std::move(image), format});
+    lock.unlock();
+    m_job_added.notify_one();
+}
+
+void ImageWriter::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_job_done.wait(lock, [this]() { return m_jobs.empty() && !m_busy; });
+}
+
+size_t ImageWriter::num_written() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_num_written;
+}
+
+size_t ImageWriter::num_failed() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_num_failed;
+}
+
+void ImageWriter::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_job_added.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+        if (m_jobs.empty()) {
+            // stopped and nothing left to write
+            return;
+        }
+        Job job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        m_busy = true;
+        lock.unlock();
+
+        bool ok = true;
+        try {
+            write_image(job.path, job.image, job.format);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            ok = false;
+        }
+
+        lock.lock();
+        m_busy = false;
+        ++(ok ? m_num_written : m_num_failed);
+        m_job_done.notify_all();
+    }
+}
+
+ReadbackRing::ReadbackRing(WGPUDevice device, WGPUInstance instance, uint32_t width, uint32_t height,
+                           size_t num_slots)
+    : m_instance(instance), m_width(width), m_height(height), m_bytes_per_row((width * 4 + 255) & ~255u),
+      m_slots(num_slots) {
+    assert(num_slots > 0);
+    WGPUBufferDescriptor buffer_desc = {};
+    buffer_desc.size                 = uint64_t(m_bytes_per_row) * height;
+    buffer_desc.usage                = WGPUBufferUsage_CopyDst | WGPUBufferUsage_MapRead;
+    buffer_desc.mappedAtCreation     = false;
+    for (Slot& slot : m_slots) {
+        slot.buffer = wgpuDeviceCreateBuffer(device, &buffer_desc);
+    }
+}
+
+ReadbackRing::~ReadbackRing() {
+    // frames in flight are dropped, their buffers are destroyed while mapping
+    for (Slot& slot : m_slots) {
+        wgpuBufferDestroy(slot.buffer);
+        wgpuBufferRelease(slot.buffer);
+    }
+}
+
+void ReadbackRing::copy(WGPUCommandEncoder encoder, WGPUTexture texture, size_t index, const Callback& callback) {
+    Slot& slot = m_slots[m_next];
+    if (slot.in_flight) {
+        read(slot, callback);
+    }
+    slot.index  = index;
+    slot.mapped = false;
+    slot.failed = false;
+
+    WGPUImageCopyTexture source = {};
+    source.texture              = texture;
+    source.mipLevel             = 0;
+    source.origin               = {0, 0, 0};
+    source.aspect               = WGPUTextureAspect_All;
+
+    WGPUImageCopyBuffer destination = {};
+    destination.buffer              = slot.buffer;
+    destination.layout.offset       = 0;
+    destination.layout.bytesPerRow  = m_bytes_per_row;
+    destination.layout.rowsPerImage = m_height;
+
+    WGPUExtent3D size = {m_width, m_height, 1};
+    wgpuCommandEncoderCopyTextureToBuffer(encoder, &source, &destination, &size);
+
+    m_last = m_next;
+    m_next = (m_next + 1) % m_slots.size();
+}
+
+void ReadbackRing::map_last() {
+    Slot& slot     = m_slots[m_last];
+    slot.in_flight = true;
+
+    auto on_mapped = [](WGPUMapAsyncStatus status, WGPUStringView message, void* user_data, void*) {
+        Slot& s = *reinterpret_cast<Slot*>(user_data);
+        if (status != WGPUMapAsyncStatus_Success) {
+            std::cerr << "Failed to map readback buffer: " << std::string(message.data, message.length) << std::endl;
+            s.failed = true;
+        }
+        s.mapped = true;
+    };
+    // the callback runs in wgpuInstanceProcessEvents, i.e. on the thread that waits for it
+    WGPUBufferMapCallbackInfo callback_info = {nullptr, WGPUCallbackMode_AllowProcessEvents, on_mapped, &slot,
+                                               nullptr};
+    wgpuBufferMapAsync(slot.buffer, WGPUMapMode_Read, 0, size_t(m_bytes_per_row) * m_height, callback_info);
+}
+
+void ReadbackRing::finish(const Callback& callback) {
+    // the oldest frame is in the next slot
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+        Slot& slot = m_slots[(m_next + i) % m_slots.size()];
+        if (slot.in_flight) {
+            read(slot, callback);
+        }
+    }
+}
+
+void ReadbackRing::read(Slot& slot, const Callback& callback) {
+    while (!slot.mapped) {
+        wgpuInstanceProcessEvents(m_instance);
+        std::this_thread::yield();
+    }
+    slot.in_flight = false;
+    if (slot.failed) {
+        return;
+    }
+
+    size_t         size = size_t(m_bytes_per_row) * m_height;
+    const uint8_t* data = static_cast<const uint8_t*>(wgpuBufferGetConstMappedRange(slot.buffer, 0, size));
+
+    Image image;
+    image.width  = m_width;
+    image.height = m_height;
+    image.pixels.resize(size_t(m_width) * m_height * 4);
+    for (uint32_t y = 0; y < m_height; ++y) {
+        std::memcpy(image.pixels.data() + size_t(y) * m_width * 4, data + size_t(y) * m_bytes_per_row,
+                    size_t(m_width) * 4);
+    }
+    wgpuBufferUnmap(slot.buffer);
+    callback(slot.index, std::move(image));
+}
+
+} // namespace rr
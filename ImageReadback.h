@@ -0,0 +1,129 @@
+#pragma once
+
+#include <webgpu/webgpu.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace rr {
+
+// An image read back from the GPU, RGBA with 8 bits per channel and rows without padding
+struct Image {
+    uint32_t             width  = 0;
+    uint32_t             height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// Raw writes the pixels as they are, without a header
+enum class ImageFormat { Png, Raw };
+
+// Png for paths ending in .png, Raw otherwise
+ImageFormat image_format_from_path(std::string_view path);
+
+// Throws std::runtime_error if the file cannot be written
+void write_image(std::string_view path, const Image& image, ImageFormat format);
+
+// Writes images on a background thread, so encoding does not stall the rendering. push blocks
+// while max_queued images are waiting, which bounds the memory when rendering is faster than
+// writing. Failed writes are reported to std::cerr and counted.
+class ImageWriter {
+public:
+    explicit ImageWriter(size_t max_queued = 16);
+    // Writes all queued images
+    ~ImageWriter();
+
+    ImageWriter(const ImageWriter&)            = delete;
+    ImageWriter& operator=(const ImageWriter&) = delete;
+
+    void push(std::string path, Image image, ImageFormat format);
+
+    // Blocks until all queued images are written
+    void wait();
+
+    size_t num_written() const;
+
+    size_t num_failed() const;
+
+private:
+    struct Job {
+        std::string path;
+        Image       image;
+        ImageFormat format;
+    };
+
+    void run();
+
+    size_t                  m_max_queued;
+    std::deque<Job>         m_jobs;
+    bool                    m_busy        = false;
+    bool                    m_stop        = false;
+    size_t                  m_num_written = 0;
+    size_t                  m_num_failed  = 0;
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_job_added;
+    std::condition_variable m_job_done;
+    std::thread             m_thread;
+};
+
+// Staging buffers that copy frames of a color texture to the CPU. Every frame gets the next
+// buffer of the ring and is mapped asynchronously after its submit, so the GPU renders the
+// following frames while earlier ones are mapped. A frame is only waited for when its buffer
+// is needed again or at finish, and frames are handed out in the order they were rendered.
+class ReadbackRing {
+public:
+    using Callback = std::function<void(size_t index, Image&& image)>;
+
+    // The texture has to be RGBA8 and allow CopySrc
+    ReadbackRing(WGPUDevice device, WGPUInstance instance, uint32_t width, uint32_t height, size_t num_slots = 3);
+    ~ReadbackRing();
+
+    ReadbackRing(const ReadbackRing&)            = delete;
+    ReadbackRing& operator=(const ReadbackRing&) = delete;
+
+    // Records the copy of texture into the next buffer. If that buffer still holds an earlier
+    // frame, that frame is read back and handed to callback first.
+    void copy(WGPUCommandEncoder encoder, WGPUTexture texture, size_t index, const Callback& callback);
+
+    // Starts mapping the buffer of the last copy, has to be called after its submit
+    void map_last();
+
+    // Reads back all frames that are still in flight
+    void finish(const Callback& callback);
+
+    uint32_t width() const {
+        return m_width;
+    }
+
+    uint32_t height() const {
+        return m_height;
+    }
+
+private:
+    struct Slot {
+        WGPUBuffer buffer    = nullptr;
+        size_t     index     = 0;
+        bool       in_flight = false;
+        bool       mapped    = false;
+        bool       failed    = false;
+    };
+
+    void read(Slot& slot, const Callback& callback);
+
+    WGPUInstance      m_instance = nullptr;
+    uint32_t          m_width    = 0;
+    uint32_t          m_height   = 0;
+    // copies need rows aligned to 256 bytes
+    uint32_t          m_bytes_per_row = 0;
+    std::vector<Slot> m_slots;
+    size_t            m_next = 0;
+    size_t            m_last = 0;
+};
+
+} // namespace rr
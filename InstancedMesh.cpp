@@ -2,22 +2,18 @@
 
 #include "Camera.h"
 #include "Mesh.h"
+#include "PipelineCache.h"
 #include "Renderer.h"
 
 namespace rr {
 
-struct InstancedMeshVertexAttributes {
-    glm::vec3 position;
-    glm::vec3 normal;
-};
-
 static_assert(sizeof(InstanceData) == 80, "InstanceData size is not as expected.");
 static_assert(offsetof(InstanceData, transform) == 0, "Transform offset is not zero.");
 static_assert(offsetof(InstanceData, color) == 64, "Color offset is not as expected.");
 // static_assert(alignof(InstancedMeshVertexAttributes) % 16 == 0, "InstancedMeshVertexAttributes alignment is not as
 // expected.");
 
-static std::vector<InstancedMeshVertexAttributes> create_vertex_attributes(const Mesh& mesh) {
+std::vector<InstancedMeshVertexAttributes> create_vertex_attributes(const Mesh& mesh) {
     std::vector<InstancedMeshVertexAttributes> vertex_attributes;
     vertex_attributes.reserve(3 * mesh.num_faces());
 
@@ -60,10 +56,9 @@ void InstancedMesh::release() {
     wgpuBufferRelease(m_vertex_buffer);
     wgpuBufferDestroy(m_instance_buffer);
     wgpuBufferRelease(m_instance_buffer);
-    wgpuBufferDestroy(m_uniform_buffer);
-    wgpuBufferRelease(m_uniform_buffer);
-    wgpuBindGroupRelease(m_bind_group);
-    wgpuRenderPipelineRelease(m_pipeline);
+    // the pipeline belongs to the pipeline cache
+    m_pipeline      = nullptr;
+    m_vertex_buffer = nullptr;
 }
 
 InstancedMesh::~InstancedMesh() {
@@ -89,7 +84,7 @@ struct VertexOutput {
     @location(3) view_pos: vec3f,
 }
 
-struct Uniforms {
+struct Camera {
     projection_matrix: mat4x4f,
     view_matrix: mat4x4f,
 }
@@ -101,7 +96,7 @@ struct Light {
 }
 
 @group(0) @binding(0)
-var<uniform> uniforms: Uniforms;
+var<uniform> camera: Camera;
 
 fn calculate_lighting(light: Light, normal: vec3f, view_pos: vec3f, view_dir: vec3f) -> vec3f {
     let light_dir = normalize(light.position - view_pos);
@@ -134,11 +129,11 @@ fn vs_main(input: VertexInput) -> VertexOutput {
     );
 
     let world_pos = model_matrix * vec4f(input.position, 1.0);
-    output.position = uniforms.projection_matrix * uniforms.view_matrix * world_pos;
-    output.view_pos = (uniforms.view_matrix * world_pos).xyz;
+    output.position = camera.projection_matrix * camera.view_matrix * world_pos;
+    output.view_pos = (camera.view_matrix * world_pos).xyz;
     output.world_pos = world_pos.xyz;
     let world_normal = normalize((model_matrix * vec4f(input.normal, 0.0)).xyz);
-    output.world_normal = (uniforms.view_matrix * vec4f(world_normal, 0.0)).xyz;
+    output.world_normal = (camera.view_matrix * vec4f(world_normal, 0.0)).xyz;
     output.color = input.instance_color;
 
     return output;
@@ -207,22 +202,6 @@ void InstancedMesh::configure_render_pipeline() {
     ib_desc.mappedAtCreation = false;
     m_instance_buffer = wgpuDeviceCreateBuffer(renderer.m_device, &ib_desc);
 
-    // Create uniform buffer
-    WGPUBufferDescriptor ub_desc = {};
-    ub_desc.size = sizeof(InstancedMeshUniforms);
-    ub_desc.usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Uniform;
-    ub_desc.mappedAtCreation = false;
-    m_uniform_buffer = wgpuDeviceCreateBuffer(renderer.m_device, &ub_desc);
-
-    // Create shader module
-    WGPUShaderModuleDescriptor shader_desc = {};
-    WGPUShaderModuleWGSLDescriptor shader_code_desc = {};
-    shader_code_desc.chain.next = nullptr;
-    shader_code_desc.chain.sType = WGPUSType_ShaderSourceWGSL;
-    shader_desc.nextInChain = &shader_code_desc.chain;
-    shader_code_desc.code = to_string_view(shaderCode);
-    WGPUShaderModule shader_module = wgpuDeviceCreateShaderModule(renderer.m_device, &shader_desc);
-
     // Vertex attributes
     std::vector<WGPUVertexAttribute> vertex_attribs;
 
@@ -268,95 +247,26 @@ void InstancedMesh::configure_render_pipeline() {
     instance_buffer_layout.arrayStride = sizeof(InstanceData);
     instance_buffer_layout.stepMode = WGPUVertexStepMode_Instance;
 
-    std::vector<WGPUVertexBufferLayout> buffer_layouts = {vertex_buffer_layout, instance_buffer_layout};
-
-    // Pipeline descriptor
-    WGPURenderPipelineDescriptor pipeline_desc = {};
-    pipeline_desc.vertex.bufferCount = buffer_layouts.size();
-    pipeline_desc.vertex.buffers = buffer_layouts.data();
-    pipeline_desc.vertex.module = shader_module;
-    pipeline_desc.vertex.entryPoint = to_string_view("vs_main");
-    pipeline_desc.vertex.constantCount = 0;
-    pipeline_desc.vertex.constants = nullptr;
-
-    pipeline_desc.primitive.topology         = WGPUPrimitiveTopology_TriangleList;
-    pipeline_desc.primitive.stripIndexFormat = WGPUIndexFormat_Undefined;
-    pipeline_desc.primitive.frontFace        = WGPUFrontFace_CCW;
-    // pipelineDesc.primitive.cullMode         = WGPUCullMode_Back;
-    pipeline_desc.primitive.cullMode = WGPUCullMode_None;
-
-    WGPUFragmentState fragmentState = {};
-    pipeline_desc.fragment           = &fragmentState;
-    fragmentState.module            = shader_module;
-    fragmentState.entryPoint        = to_string_view("fs_main");
-    fragmentState.constantCount     = 0;
-    fragmentState.constants         = nullptr;
-
-    WGPUBlendState blendState  = {};
-    blendState.color.srcFactor = WGPUBlendFactor_SrcAlpha;
-    blendState.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
-    blendState.color.operation = WGPUBlendOperation_Add;
-    blendState.alpha.srcFactor = WGPUBlendFactor_Zero;
-    blendState.alpha.dstFactor = WGPUBlendFactor_One;
-    blendState.alpha.operation = WGPUBlendOperation_Add;
-
-    WGPUColorTargetState colorTarget = {};
-    colorTarget.format               = renderer.m_swap_chain_format;
-    colorTarget.blend                = &blendState;
-    colorTarget.writeMask            = WGPUColorWriteMask_All;
-
-    fragmentState.targetCount = 1;
-    fragmentState.targets     = &colorTarget;
-
-    WGPUDepthStencilState depthStencilState = {};
-    depthStencilState.depthCompare          = WGPUCompareFunction_Less;
-    depthStencilState.depthWriteEnabled     = WGPUOptionalBool_True;
-    depthStencilState.format                = renderer.m_depth_texture_format;
-    depthStencilState.stencilReadMask       = 0;
-    depthStencilState.stencilWriteMask      = 0;
-
-    pipeline_desc.depthStencil = &depthStencilState;
-
-    pipeline_desc.multisample.count                  = 1;
-    pipeline_desc.multisample.mask                   = ~0u;
-    pipeline_desc.multisample.alphaToCoverageEnabled = false;
-
-    // Create binding layout
-    WGPUBindGroupLayoutEntry bindingLayout = {};
-    bindingLayout.binding                  = 0;
-    bindingLayout.visibility               = WGPUShaderStage_Vertex | WGPUShaderStage_Fragment;
-    bindingLayout.buffer.type              = WGPUBufferBindingType_Uniform;
-    bindingLayout.buffer.minBindingSize    = sizeof(InstancedMeshUniforms);
-
-    WGPUBindGroupLayoutDescriptor bindGroupLayoutDesc = {};
-    bindGroupLayoutDesc.entryCount                    = 1;
-    bindGroupLayoutDesc.entries                       = &bindingLayout;
-    WGPUBindGroupLayout bindGroupLayout = wgpuDeviceCreateBindGroupLayout(renderer.m_device, &bindGroupLayoutDesc);
-
-    // Create pipeline layout
-    WGPUPipelineLayoutDescriptor layoutDesc = {};
-    layoutDesc.bindGroupLayoutCount         = 1;
-    layoutDesc.bindGroupLayouts             = &bindGroupLayout;
-    WGPUPipelineLayout layout               = wgpuDeviceCreatePipelineLayout(renderer.m_device, &layoutDesc);
-    pipeline_desc.layout                     = layout;
-
-    // Create bind group
-    WGPUBindGroupEntry binding = {};
-    binding.binding            = 0;
-    binding.buffer             = m_uniform_buffer;
-    binding.offset             = 0;
-    binding.size               = sizeof(InstancedMeshUniforms);
-
-    WGPUBindGroupDescriptor bindGroupDesc = {};
-    bindGroupDesc.layout                  = bindGroupLayout;
-    bindGroupDesc.entryCount              = 1;
-    bindGroupDesc.entries                 = &binding;
-    m_bind_group                           = wgpuDeviceCreateBindGroup(renderer.m_device, &bindGroupDesc);
-
-    m_pipeline = wgpuDeviceCreateRenderPipeline(renderer.m_device, &pipeline_desc);
-    wgpuShaderModuleRelease(shader_module);
-
-    on_camera_update();
+    // Pipeline description, all instanced meshes share the same pipeline
+    RenderPipelineDescription pipeline_desc;
+    pipeline_desc.shader_source  = shaderCode;
+    pipeline_desc.vertex_buffers = {vertex_buffer_layout, instance_buffer_layout};
+    // The only bind group is the camera of the renderer
+    pipeline_desc.bind_groups    = {{Renderer::camera_layout_entry()}};
+    // pipeline_desc.cull_mode   = WGPUCullMode_Back;
+    pipeline_desc.cull_mode      = WGPUCullMode_None;
+
+    pipeline_desc.blend.color.srcFactor = WGPUBlendFactor_SrcAlpha;
+    pipeline_desc.blend.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    pipeline_desc.blend.color.operation = WGPUBlendOperation_Add;
+    pipeline_desc.blend.alpha.srcFactor = WGPUBlendFactor_Zero;
+    pipeline_desc.blend.alpha.dstFactor = WGPUBlendFactor_One;
+    pipeline_desc.blend.alpha.operation = WGPUBlendOperation_Add;
+
+    pipeline_desc.color_format = renderer.m_swap_chain_format;
+    pipeline_desc.depth_format = renderer.m_depth_texture_format;
+
+    m_pipeline = renderer.m_pipeline_cache->get(pipeline_desc).pipeline;
 }
 
 void InstancedMesh::upload_instance_data() {
@@ -364,19 +274,14 @@ void InstancedMesh::upload_instance_data() {
                          m_instance_data.size() * sizeof(InstanceData));
 }
 
-void InstancedMesh::draw(WGPURenderPassEncoder render_pass) {
-    wgpuRenderPassEncoderSetPipeline(render_pass, m_pipeline);
+void InstancedMesh::draw(RenderEncoder encoder) {
+    encoder.set_pipeline(m_pipeline);
 
     // Bind vertex buffer to slot 0
-    wgpuRenderPassEncoderSetVertexBuffer(render_pass, 0, m_vertex_buffer, 0,
-                                         m_num_attr_verts * sizeof(InstancedMeshVertexAttributes));
+    encoder.set_vertex_buffer(0, m_vertex_buffer, 0, m_num_attr_verts * sizeof(InstancedMeshVertexAttributes));
 
     // Bind instance buffer to slot 1
-    wgpuRenderPassEncoderSetVertexBuffer(render_pass, 1, m_instance_buffer, 0,
-                                         m_instance_data.size() * sizeof(InstanceData));
-
-    // Set binding group for uniforms
-    wgpuRenderPassEncoderSetBindGroup(render_pass, 0, m_bind_group, 0, nullptr);
+    encoder.set_vertex_buffer(1, m_instance_buffer, 0, m_instance_data.size() * sizeof(InstanceData));
 
     // Draw call with instancing
     // Parameters:
@@ -384,19 +289,7 @@ void InstancedMesh::draw(WGPURenderPassEncoder render_pass) {
     // 2. Number of instances
     // 3. First vertex
     // 4. First instance
-    wgpuRenderPassEncoderDraw(render_pass, uint32_t(m_num_attr_verts), uint32_t(m_instance_data.size()), 0, 0);
-}
-
-void InstancedMesh::on_camera_update() {
-    m_uniforms.view_matrix = m_renderer->m_camera.transform();
-
-    float aspect_ratio          = static_cast<float>(m_renderer->m_width) / static_cast<float>(m_renderer->m_height);
-    float far_plane             = 100.0f;
-    float near_plane            = 0.01f;
-    float fov                   = glm::radians(45.0f);
-    m_uniforms.projection_matrix = glm::perspective(fov, aspect_ratio, near_plane, far_plane);
-
-    wgpuQueueWriteBuffer(m_renderer->m_queue, m_uniform_buffer, 0, &m_uniforms, sizeof(InstancedMeshUniforms));
+    encoder.draw(uint32_t(m_num_attr_verts), uint32_t(m_instance_data.size()), 0, 0);
 }
 
 } // namespace rr
@@ -8,20 +8,21 @@
 
 namespace rr {
 
-struct InstancedMeshUniforms {
-    // We add transform matrices
-    glm::mat4x4 projection_matrix;
-    glm::mat4x4 view_matrix;
-};
-
 struct InstanceData {
     glm::mat4x4 transform;
     glm::vec4   color;
 };
 
-static_assert(sizeof(InstancedMeshUniforms) % 16 == 0);
 static_assert(sizeof(InstanceData) % 16 == 0);
 
+struct InstancedMeshVertexAttributes {
+    glm::vec3 position;
+    glm::vec3 normal;
+};
+
+// One position and normal per triangle corner, polygons are fan triangulated. The mesh needs normals.
+std::vector<InstancedMeshVertexAttributes> create_vertex_attributes(const Mesh& mesh);
+
 class InstancedMesh : public Drawable {
 public:
     InstancedMesh(const Mesh& mesh, size_t num_instances, const Renderer& renderer);
@@ -31,9 +32,7 @@ public:
 
     void configure_render_pipeline();
 
-    void draw(WGPURenderPassEncoder render_pass) override;
-
-    void on_camera_update() override;
+    void draw(RenderEncoder encoder) override;
 
     void set_transforms(const std::vector<glm::mat4x4>& transforms) {
         for (size_t i = 0; i < m_instance_data.size(); ++i) {
@@ -72,13 +71,9 @@ public:
 
 private:
     WGPUBuffer         m_vertex_buffer   = nullptr;
-    WGPUBuffer         m_uniform_buffer  = nullptr;
-    WGPUBindGroup      m_bind_group      = nullptr;
     WGPURenderPipeline m_pipeline        = nullptr;
     WGPUBuffer         m_instance_buffer = nullptr;
 
-    InstancedMeshUniforms m_uniforms;
-
     Mesh   m_mesh;
     size_t m_num_attr_verts = 0;
 
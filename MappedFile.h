@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace rr {
+
+// Read-only memory mapping of a whole file. Throws std::runtime_error if the file
+// cannot be opened or mapped. An empty file yields data() == nullptr and size() == 0.
+class MappedFile {
+public:
+    explicit MappedFile(std::string_view path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    const char* data() const {
+        return m_data;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+private:
+    void unmap();
+
+    const char* m_data = nullptr;
+    size_t      m_size = 0;
+#ifdef _WIN32
+    void* m_file    = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
+
+} // namespace rr
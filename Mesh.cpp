@@ -1,26 +1,35 @@
 #include "Mesh.h"
+#include "Parallel.h"
+
 #include <array>
 
 namespace rr {
 
 Mesh::Mesh(const std::vector<glm::vec3>& pts, const std::vector<std::array<uint32_t, 3>>& triangles) : positions(pts) {
-    position_faces.resize(triangles.size());
+    position_faces.resize(triangles.size(), 3);
     for (size_t f = 0; f < triangles.size(); ++f) {
-        position_faces[f] = {triangles[f][0], triangles[f][1], triangles[f][2]};
+        auto face = position_faces[f];
+        face[0]   = triangles[f][0];
+        face[1]   = triangles[f][1];
+        face[2]   = triangles[f][2];
     }
 }
 
 Mesh& Mesh::translate(const glm::vec3& p) {
-    for (auto& pos : positions) {
-        pos += p;
-    }
+    parallel_for(0, positions.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            positions[i] += p;
+        }
+    });
     return *this;
 }
 
 Mesh& Mesh::scale(const glm::vec3& s) {
-    for (auto& pos : positions) {
-        pos *= s;
-    }
+    parallel_for(0, positions.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            positions[i] *= s;
+        }
+    });
     return *this;
 }
 
@@ -29,122 +38,123 @@ Mesh& Mesh::scale(float s) {
 }
 
 Mesh& Mesh::triangulate() {
-    // Create temporary vectors to store the new triangulated faces
-    std::vector<Face> new_position_faces;
-    std::vector<Face> new_normal_faces;
-    std::vector<Face> new_uv_faces;
-
-    // Reserve space to avoid reallocations (worst case: all quads becoming 2 triangles)
-    new_position_faces.reserve(position_faces.size() * 2);
-    if (!normal_faces.empty())
-        new_normal_faces.reserve(normal_faces.size() * 2);
-    if (!uv_faces.empty())
-        new_uv_faces.reserve(uv_faces.size() * 2);
-
-    // Process each face
-    for (size_t face_idx = 0; face_idx < position_faces.size(); ++face_idx) {
-        const Face& pos_face = position_faces[face_idx];
-
-        // If it's already a triangle, just copy it
-        if (pos_face.size() == 3) {
-            new_position_faces.push_back(pos_face);
-            if (!normal_faces.empty())
-                new_normal_faces.push_back(normal_faces[face_idx]);
-            if (!uv_faces.empty())
-                new_uv_faces.push_back(uv_faces[face_idx]);
-            continue;
-        }
-
-        // For non-triangular faces, create a fan triangulation
-        for (size_t i = 1; i < pos_face.size() - 1; ++i) {
-            // Create new triangle face for positions
-            Face new_pos_tri(3);
-            new_pos_tri[0] = pos_face[0];     // center vertex
-            new_pos_tri[1] = pos_face[i];     // current vertex
-            new_pos_tri[2] = pos_face[i + 1]; // next vertex
-            new_position_faces.push_back(new_pos_tri);
-
-            // If we have normal topology, create corresponding triangle
-            if (!normal_faces.empty()) {
-                const Face& norm_face = normal_faces[face_idx];
-                Face        new_norm_tri(3);
-                new_norm_tri[0] = norm_face[0];
-                new_norm_tri[1] = norm_face[i];
-                new_norm_tri[2] = norm_face[i + 1];
-                new_normal_faces.push_back(new_norm_tri);
-            }
+    size_t num_faces = position_faces.size();
+    if (position_faces.uniform_size() == 3) {
+        return *this;
+    }
 
-            // If we have UV topology, create corresponding triangle
-            if (!uv_faces.empty()) {
-                const Face& uv_face = uv_faces[face_idx];
-                Face        new_uv_tri(3);
-                new_uv_tri[0] = uv_face[0];
-                new_uv_tri[1] = uv_face[i];
-                new_uv_tri[2] = uv_face[i + 1];
-                new_uv_faces.push_back(new_uv_tri);
-            }
-        }
+    // Counting pass and prefix sum, the triangles of face f start at first_triangle[f]. Every
+    // face then writes its own range of the output in parallel.
+    std::vector<size_t> first_triangle(num_faces + 1);
+    first_triangle[0] = 0;
+    for (size_t f = 0; f < num_faces; ++f) {
+        size_t n              = position_faces.offset(f + 1) - position_faces.offset(f);
+        first_triangle[f + 1] = first_triangle[f] + (n < 3 ? 0 : n - 2);
     }
+    size_t num_triangles = first_triangle[num_faces];
+
+    auto fan = [&](const FaceList& faces) {
+        FaceList triangles(num_triangles, 3);
+        parallel_for(0, num_faces, [&](size_t begin, size_t end) {
+            for (size_t f = begin; f < end; ++f) {
+                auto   face = faces[f];
+                size_t t    = first_triangle[f];
+                // connect the first vertex to all other edges
+                for (size_t i = 1; i + 1 < face.size(); ++i) {
+                    auto triangle = triangles[t++];
+                    triangle[0]   = face[0];
+                    triangle[1]   = face[i];
+                    triangle[2]   = face[i + 1];
+                }
+            }
+        });
+        return triangles;
+    };
 
-    // Replace the old faces with the triangulated ones
-    position_faces = std::move(new_position_faces);
+    position_faces = fan(position_faces);
     if (!normal_faces.empty())
-        normal_faces = std::move(new_normal_faces);
+        normal_faces = fan(normal_faces);
     if (!uv_faces.empty())
-        uv_faces = std::move(new_uv_faces);
+        uv_faces = fan(uv_faces);
 
     return *this;
 }
 
-void set_flat_normals(Mesh& mesh) {
-    mesh.normals.resize(mesh.num_faces());
-    mesh.normal_faces.resize(mesh.num_faces());
+static glm::vec3 face_normal(const Mesh& mesh, size_t f) {
+    const auto& face = mesh.position_faces[f];
 
-    // Calculate one normal per face
-    for (size_t f = 0; f < mesh.num_faces(); ++f) {
-        const auto& face = mesh.position_faces[f];
+    const glm::vec3& v0 = mesh.positions[face[0]];
+    const glm::vec3& v1 = mesh.positions[face[1]];
+    const glm::vec3& v2 = mesh.positions[face[2]];
 
-        const glm::vec3& v0 = mesh.positions[face[0]];
-        const glm::vec3& v1 = mesh.positions[face[1]];
-        const glm::vec3& v2 = mesh.positions[face[2]];
+    glm::vec3 edge1 = v1 - v0;
+    glm::vec3 edge2 = v2 - v0;
+    return glm::normalize(glm::cross(edge1, edge2));
+}
 
-        glm::vec3 edge1  = v1 - v0;
-        glm::vec3 edge2  = v2 - v0;
-        glm::vec3 normal = glm::normalize(glm::cross(edge1, edge2));
+void set_flat_normals(Mesh& mesh) {
+    mesh.normals.resize(mesh.num_faces());
+    // same face sizes, the indices are overwritten
+    mesh.normal_faces = mesh.position_faces;
 
-        mesh.normals[f]      = normal;
-        mesh.normal_faces[f] = Mesh::Face(mesh.position_faces[f].size(), f);
-    }
+    // Calculate one normal per face
+    parallel_for(0, mesh.num_faces(), [&](size_t begin, size_t end) {
+        for (size_t f = begin; f < end; ++f) {
+            mesh.normals[f] = face_normal(mesh, f);
+            for (uint32_t& n : mesh.normal_faces[f]) {
+                n = uint32_t(f);
+            }
+        }
+    });
 }
 
 void set_smooth_normals(Mesh& mesh) {
-    mesh.normals.assign(mesh.num_vertices(), glm::vec3(0));
-    mesh.normal_faces.resize(mesh.num_faces());
-
-    for (size_t f = 0; f < mesh.num_faces(); ++f) {
-        const auto& face = mesh.position_faces[f];
-
-        const glm::vec3& v0 = mesh.positions[face[0]];
-        const glm::vec3& v1 = mesh.positions[face[1]];
-        const glm::vec3& v2 = mesh.positions[face[2]];
-
-        glm::vec3 edge1       = v1 - v0;
-        glm::vec3 edge2       = v2 - v0;
-        glm::vec3 face_normal = glm::normalize(glm::cross(edge1, edge2));
-
-        for (uint32_t i : face) {
-            mesh.normals[i] += face_normal;
+    size_t                 num_faces = mesh.num_faces();
+    std::vector<glm::vec3> face_normals(num_faces);
+    mesh.normal_faces = mesh.position_faces;
+    parallel_for(0, num_faces, [&](size_t begin, size_t end) {
+        for (size_t f = begin; f < end; ++f) {
+            face_normals[f] = face_normal(mesh, f);
+        }
+    });
+
+    // Every vertex gathers the normals of its own faces, so there are no concurrent writes
+    std::vector<uint32_t> offsets, faces;
+    vertex_face_adjacency(mesh, offsets, faces);
+    mesh.normals.resize(mesh.num_vertices());
+    parallel_for(0, mesh.num_vertices(), [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            glm::vec3 n(0.0f);
+            for (uint32_t i = offsets[v]; i < offsets[v + 1]; ++i) {
+                n += face_normals[faces[i]];
+            }
+            mesh.normals[v] = glm::normalize(n);
         }
+    });
+}
 
-        mesh.normal_faces[f] = face;
+void vertex_face_adjacency(const Mesh& mesh, std::vector<uint32_t>& offsets, std::vector<uint32_t>& faces) {
+    size_t num_vertices = mesh.num_vertices();
+    offsets.assign(num_vertices + 1, 0);
+    for (uint32_t v : mesh.position_faces.indices()) {
+        ++offsets[v + 1];
     }
-
-    for (size_t i = 0; i < mesh.normals.size(); ++i) {
-        mesh.normals[i] = glm::normalize(mesh.normals[i]);
+    for (size_t v = 0; v < num_vertices; ++v) {
+        offsets[v + 1] += offsets[v];
+    }
+    faces.resize(offsets[num_vertices]);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t f = 0; f < mesh.num_faces(); ++f) {
+        for (uint32_t v : mesh.position_faces[f]) {
+            faces[fill[v]++] = uint32_t(f);
+        }
     }
 }
 
 bool is_triangulated(const Mesh& mesh) {
+    if (mesh.position_faces.uniform_size() == 3) {
+        return true;
+    }
     for (const auto& face : mesh.position_faces) {
         if (face.size() != 3) {
             return false;
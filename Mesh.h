@@ -1,6 +1,8 @@
 #pragma once
 
+#include <array>
 #include <vector>
+#include "FaceList.h"
 #include "SmallVector.h"
 
 #include "glm/glm.hpp"
@@ -12,19 +14,20 @@ struct Mesh {
 
     explicit Mesh(const std::vector<glm::vec3>& positions, const std::vector<std::array<uint32_t, 3>>& triangles);
 
+    // for building faces, position_faces and the others store all faces in one index array
     using Face = SmallVector<uint32_t, 4>;
 
     std::vector<glm::vec3> positions;
-    std::vector<Face> position_faces;
+    FaceList position_faces;
 
     // Optionally, this mesh struct also supports storing
     // normals and uvs with proper normal and uv topology.
 
     std::vector<glm::vec3> normals;
-    std::vector<Face> normal_faces;
+    FaceList normal_faces;
 
     std::vector<glm::vec2> uvs;
-    std::vector<Face> uv_faces;
+    FaceList uv_faces;
 
     size_t num_faces() const {
         return position_faces.size();
@@ -42,6 +45,10 @@ struct Mesh {
 
 void set_flat_normals(Mesh& mesh);
 void set_smooth_normals(Mesh& mesh);
+
+// The faces around every position, the faces of vertex v are faces[offsets[v]] to faces[offsets[v + 1] - 1]
+void vertex_face_adjacency(const Mesh& mesh, std::vector<uint32_t>& offsets, std::vector<uint32_t>& faces);
+
 bool is_triangulated(const Mesh& mesh);
 
 }
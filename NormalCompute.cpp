@@ -0,0 +1,209 @@
+#include "NormalCompute.h"
+
+#include "PipelineCache.h"
+#include "Renderer.h"
+
+#include <algorithm>
+#include <array>
+#include <string>
+
+namespace rr {
+
+// VisualMeshVertexFormat::Full, see visualMeshFetchFull
+const char* normalComputeFull = R"(
+@group(0) @binding(1) var<storage, read> positions: array<f32>;
+@group(0) @binding(2) var<storage, read> triangles: array<vec4u>;
+@group(0) @binding(6) var<storage, read_write> normals: array<f32>;
+
+fn load_triangle(t: u32) -> vec3u {
+    return triangles[t].xyz;
+}
+
+fn load_position(v: u32) -> vec3f {
+    return vec3f(positions[3u * v], positions[3u * v + 1u], positions[3u * v + 2u]);
+}
+
+fn store_normal(v: u32, n: vec3f) {
+    normals[3u * v] = n.x;
+    normals[3u * v + 1u] = n.y;
+    normals[3u * v + 2u] = n.z;
+}
+)";
+
+// VisualMeshVertexFormat::Compact, see visualMeshFetchCompact
+const char* normalComputeCompact = R"(
+@group(0) @binding(1) var<storage, read> positions: array<u32>;
+@group(0) @binding(2) var<storage, read> triangles: array<u32>;
+@group(0) @binding(6) var<storage, read_write> normals: array<u32>;
+
+fn load_triangle(t: u32) -> vec3u {
+    return vec3u(triangles[3u * t], triangles[3u * t + 1u], triangles[3u * t + 2u]) & vec3u(0x7fffffffu);
+}
+
+fn load_position(v: u32) -> vec3f {
+    let q = vec3f(unpack2x16unorm(positions[2u * v]), unpack2x16unorm(positions[2u * v + 1u]).x);
+    return uniforms.position_offset.xyz + q * uniforms.position_scale.xyz;
+}
+
+// same as encode_octahedral in VisualMesh.cpp
+fn store_normal(v: u32, n: vec3f) {
+    var e = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+    if (n.z < 0.0) {
+        e = (1.0 - abs(e.yx)) * select(vec2f(-1.0), vec2f(1.0), e >= vec2f(0.0));
+    }
+    normals[v] = pack2x16snorm(e);
+}
+)";
+
+const char* normalComputeShaderCode = R"(
+struct Uniforms {
+    position_offset: vec4f,
+    position_scale: vec4f,
+    num_triangles: u32,
+    num_vertices: u32,
+}
+
+@group(0) @binding(0) var<uniform> uniforms: Uniforms;
+@group(0) @binding(3) var<storage, read_write> triangle_normals: array<vec4f>;
+@group(0) @binding(4) var<storage, read> vertex_triangle_offsets: array<u32>;
+@group(0) @binding(5) var<storage, read> vertex_triangles: array<u32>;
+
+// large meshes need more than maxComputeWorkgroupsPerDimension groups, they are dispatched as rows
+fn thread_index(id: vec3u, groups: vec3u) -> u32 {
+    return id.x + id.y * groups.x * 64u;
+}
+
+@compute @workgroup_size(64)
+fn triangle_normals_main(@builtin(global_invocation_id) id: vec3u, @builtin(num_workgroups) groups: vec3u) {
+    let t = thread_index(id, groups);
+    if (t >= uniforms.num_triangles) {
+        return;
+    }
+    let v = load_triangle(t);
+    let p0 = load_position(v.x);
+    // unweighted like the face normals on the CPU, degenerate triangles add nothing
+    let n = cross(load_position(v.y) - p0, load_position(v.z) - p0);
+    let l = length(n);
+    triangle_normals[t] = vec4f(select(vec3f(0.0), n / l, l > 0.0), 0.0);
+}
+
+@compute @workgroup_size(64)
+fn vertex_normals_main(@builtin(global_invocation_id) id: vec3u, @builtin(num_workgroups) groups: vec3u) {
+    let v = thread_index(id, groups);
+    if (v >= uniforms.num_vertices) {
+        return;
+    }
+    var n = vec3f(0.0);
+    for (var i = vertex_triangle_offsets[v]; i < vertex_triangle_offsets[v + 1u]; i++) {
+        n += triangle_normals[vertex_triangles[i]].xyz;
+    }
+    let l = length(n);
+    store_normal(v, select(vec3f(0.0, 0.0, 1.0), n / l, l > 0.0));
+}
+)";
+
+static void dispatch_threads(WGPUComputePassEncoder pass, uint32_t num_threads) {
+    const uint32_t max_groups = 65535;
+    uint32_t       groups     = (num_threads + 63) / 64;
+    uint32_t       rows       = (groups + max_groups - 1) / max_groups;
+    if (groups > 0) {
+        wgpuComputePassEncoderDispatchWorkgroups(pass, std::min(groups, max_groups), rows, 1);
+    }
+}
+
+NormalCompute::NormalCompute(const Renderer& renderer, bool compact, WGPUBuffer positions, WGPUBuffer triangles,
+                             WGPUBuffer normals, uint32_t num_triangles,
+                             const std::vector<uint32_t>& vertex_triangle_offsets,
+                             const std::vector<uint32_t>& vertex_triangles)
+    : m_renderer(&renderer) {
+    m_uniforms.num_triangles = num_triangles;
+    m_uniforms.num_vertices  = uint32_t(vertex_triangle_offsets.size() - 1);
+
+    m_uniform_buffer         = create_buffer(renderer, nullptr, sizeof(NormalComputeUniforms), WGPUBufferUsage_Uniform);
+    m_triangle_normal_buffer = create_buffer(renderer, nullptr, num_triangles * sizeof(glm::vec4),
+                                             WGPUBufferUsage_Storage);
+    m_offset_buffer          = create_buffer(renderer, vertex_triangle_offsets.data(),
+                                             vertex_triangle_offsets.size() * sizeof(uint32_t),
+                                             WGPUBufferUsage_Storage);
+    m_vertex_triangle_buffer = create_buffer(renderer, vertex_triangles.data(),
+                                             vertex_triangles.size() * sizeof(uint32_t), WGPUBufferUsage_Storage);
+
+    std::vector<WGPUBindGroupLayoutEntry> bindings(7);
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+        bindings[i].binding     = i;
+        bindings[i].visibility  = WGPUShaderStage_Compute;
+        bindings[i].buffer.type = WGPUBufferBindingType_ReadOnlyStorage;
+    }
+    bindings[0].buffer.type           = WGPUBufferBindingType_Uniform;
+    bindings[0].buffer.minBindingSize = sizeof(NormalComputeUniforms);
+    bindings[3].buffer.type           = WGPUBufferBindingType_Storage;
+    bindings[6].buffer.type           = WGPUBufferBindingType_Storage;
+
+    static const std::string full_source    = std::string(normalComputeFull) + normalComputeShaderCode;
+    static const std::string compact_source = std::string(normalComputeCompact) + normalComputeShaderCode;
+
+    // Both entry points use the same layout, so one bind group serves both pipelines
+    ComputePipelineDescription pipeline_desc;
+    pipeline_desc.shader_source = compact ? compact_source : full_source;
+    pipeline_desc.bind_groups   = {bindings};
+    pipeline_desc.entry_point   = "triangle_normals_main";
+    const CachedComputePipeline& cached = renderer.m_pipeline_cache->get(pipeline_desc);
+    m_triangle_pipeline                 = cached.pipeline;
+    pipeline_desc.entry_point           = "vertex_normals_main";
+    m_vertex_pipeline                   = renderer.m_pipeline_cache->get(pipeline_desc).pipeline;
+
+    std::array<WGPUBuffer, 7>         buffers = {m_uniform_buffer, positions, triangles, m_triangle_normal_buffer,
+                                                 m_offset_buffer, m_vertex_triangle_buffer, normals};
+    std::array<WGPUBindGroupEntry, 7> entries = {};
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        entries[i].binding = i;
+        entries[i].buffer  = buffers[i];
+        entries[i].offset  = 0;
+        entries[i].size    = wgpuBufferGetSize(buffers[i]);
+    }
+
+    WGPUBindGroupDescriptor bind_group_desc = {};
+    bind_group_desc.layout                  = cached.bind_group_layouts[0];
+    bind_group_desc.entryCount              = entries.size();
+    bind_group_desc.entries                 = entries.data();
+    m_bind_group                            = wgpuDeviceCreateBindGroup(renderer.m_device, &bind_group_desc);
+}
+
+NormalCompute::~NormalCompute() {
+    for (WGPUBuffer buffer : {m_uniform_buffer, m_triangle_normal_buffer, m_offset_buffer, m_vertex_triangle_buffer}) {
+        wgpuBufferDestroy(buffer);
+        wgpuBufferRelease(buffer);
+    }
+    wgpuBindGroupRelease(m_bind_group);
+    // the pipelines belong to the pipeline cache
+}
+
+void NormalCompute::dispatch(const glm::vec3& position_offset, const glm::vec3& position_scale) {
+    const Renderer& renderer = *m_renderer;
+
+    m_uniforms.position_offset = glm::vec4(position_offset, 0.0f);
+    m_uniforms.position_scale  = glm::vec4(position_scale, 0.0f);
+    renderer.write_uniforms(m_uniform_buffer, &m_uniforms, sizeof(NormalComputeUniforms));
+
+    WGPUCommandEncoderDescriptor encoder_desc = {};
+    encoder_desc.label                        = to_string_view("Normal compute encoder");
+    WGPUCommandEncoder     encoder            = wgpuDeviceCreateCommandEncoder(renderer.m_device, &encoder_desc);
+    WGPUComputePassEncoder pass               = wgpuCommandEncoderBeginComputePass(encoder, nullptr);
+
+    // the vertex pass reads what the triangle pass wrote, dispatches in one pass run in order
+    wgpuComputePassEncoderSetBindGroup(pass, 0, m_bind_group, 0, nullptr);
+    wgpuComputePassEncoderSetPipeline(pass, m_triangle_pipeline);
+    dispatch_threads(pass, m_uniforms.num_triangles);
+    wgpuComputePassEncoderSetPipeline(pass, m_vertex_pipeline);
+    dispatch_threads(pass, m_uniforms.num_vertices);
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+
+    WGPUCommandBuffer command = wgpuCommandEncoderFinish(encoder, nullptr);
+    wgpuCommandEncoderRelease(encoder);
+    // queued after the position upload and before the next frame
+    wgpuQueueSubmit(renderer.m_queue, 1, &command);
+    wgpuCommandBufferRelease(command);
+}
+
+} // namespace rr
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <webgpu/webgpu.h>
+
+namespace rr {
+
+class Renderer;
+
+struct NormalComputeUniforms {
+    glm::vec4 position_offset;
+    glm::vec4 position_scale;
+    uint32_t  num_triangles;
+    uint32_t  num_vertices;
+    uint32_t  padding[2];
+};
+
+static_assert(sizeof(NormalComputeUniforms) % 16 == 0);
+
+// Recomputes the normals of a VisualMesh on the GPU, reading its position and triangle buffers
+// and writing its normal buffer. The first pass writes the unit normal of every triangle, the
+// second pass sums the triangles of every vertex and normalizes, like set_smooth_normals does
+// on the CPU. The triangles of a vertex are a CSR list built once on the CPU, so the sums need
+// no atomics and do not depend on the order of the threads.
+//
+// The buffers belong to the mesh, which has to destroy the NormalCompute before releasing them.
+class NormalCompute {
+public:
+    // vertex_triangle_offsets has num_vertices + 1 entries, the triangles summed for vertex v are
+    // vertex_triangles[vertex_triangle_offsets[v]] to vertex_triangles[vertex_triangle_offsets[v + 1] - 1]
+    NormalCompute(const Renderer& renderer, bool compact, WGPUBuffer positions, WGPUBuffer triangles,
+                  WGPUBuffer normals, uint32_t num_triangles, const std::vector<uint32_t>& vertex_triangle_offsets,
+                  const std::vector<uint32_t>& vertex_triangles);
+    ~NormalCompute();
+
+    NormalCompute(const NormalCompute&)            = delete;
+    NormalCompute& operator=(const NormalCompute&) = delete;
+
+    // Records and submits both passes. Compact positions are decoded with offset and scale.
+    void dispatch(const glm::vec3& position_offset, const glm::vec3& position_scale);
+
+private:
+    const Renderer* m_renderer = nullptr;
+
+    NormalComputeUniforms m_uniforms = {};
+
+    WGPUBuffer          m_uniform_buffer         = nullptr;
+    WGPUBuffer          m_triangle_normal_buffer = nullptr;
+    WGPUBuffer          m_offset_buffer          = nullptr;
+    WGPUBuffer          m_vertex_triangle_buffer = nullptr;
+    WGPUBindGroup       m_bind_group             = nullptr;
+    WGPUComputePipeline m_triangle_pipeline      = nullptr;
+    WGPUComputePipeline m_vertex_pipeline        = nullptr;
+};
+
+} // namespace rr
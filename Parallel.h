@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace rr {
+
+inline size_t num_worker_threads() {
+#ifdef __EMSCRIPTEN__
+    return 1;
+#else
+    size_t n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+#endif
+}
+
+// Splits [begin, end) into contiguous ranges and calls f(range_begin, range_end) for each of
+// them on its own thread. Ranges are at least min_grain elements long, so small inputs run
+// serially on the calling thread.
+template <typename F> void parallel_for(size_t begin, size_t end, F&& f, size_t min_grain = 4096) {
+    if (end <= begin) {
+        return;
+    }
+    size_t count      = end - begin;
+    size_t num_chunks = std::min(num_worker_threads(), (count + min_grain - 1) / min_grain);
+    if (num_chunks <= 1) {
+        f(begin, end);
+        return;
+    }
+
+    size_t                   chunk_size = (count + num_chunks - 1) / num_chunks;
+    std::vector<std::thread> threads;
+    threads.reserve(num_chunks - 1);
+    for (size_t c = 1; c < num_chunks; ++c) {
+        size_t b = begin + c * chunk_size;
+        size_t e = std::min(end, b + chunk_size);
+        if (b >= e) {
+            break;
+        }
+        threads.emplace_back([&f, b, e]() { f(b, e); });
+    }
+    // the calling thread processes the first chunk itself
+    f(begin, std::min(end, begin + chunk_size));
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+} // namespace rr
@@ -0,0 +1,264 @@
+#include "PipelineCache.h"
+
+#include "Renderer.h"
+
+#include <iostream>
+
+namespace rr {
+
+namespace {
+
+void shaderCompilationCallback(WGPUCompilationInfoRequestStatus, WGPUCompilationInfo const* compilation_info, void*,
+                               void*) {
+    if (compilation_info) {
+        for (uint32_t i = 0; i < compilation_info->messageCount; ++i) {
+            WGPUCompilationMessage const& message = compilation_info->messages[i];
+
+            const char* message_type;
+            switch (message.type) {
+            case WGPUCompilationMessageType_Error:
+                message_type = "Error";
+                break;
+            case WGPUCompilationMessageType_Warning:
+                message_type = "Warning";
+                break;
+            case WGPUCompilationMessageType_Info:
+                message_type = "Info";
+                break;
+            default:
+                message_type = "Unknown";
+                break;
+            }
+
+            std::cerr << message_type << " at line " << message.lineNum << ", column " << message.linePos << ": "
+                      << to_string(message.message) << std::endl;
+        }
+    }
+}
+
+template <typename T> void append(std::string& key, const T& value) {
+    key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void append_bind_groups(std::string& key, const std::vector<std::vector<WGPUBindGroupLayoutEntry>>& bind_groups) {
+    append(key, bind_groups.size());
+    for (const auto& group : bind_groups) {
+        append(key, group.size());
+        for (const WGPUBindGroupLayoutEntry& entry : group) {
+            append(key, entry.binding);
+            append(key, entry.visibility);
+            append(key, entry.buffer.type);
+            append(key, entry.buffer.hasDynamicOffset);
+            append(key, entry.buffer.minBindingSize);
+            append(key, entry.sampler.type);
+            append(key, entry.texture.sampleType);
+            append(key, entry.texture.viewDimension);
+            append(key, entry.texture.multisampled);
+        }
+    }
+}
+
+// Serializes the fields of a description that affect the pipeline, the structs themselves
+// contain pointers and padding
+std::string pipeline_key(const RenderPipelineDescription& desc, WGPUShaderModule module) {
+    std::string key;
+    key.reserve(256);
+    append(key, module);
+    append(key, desc.vertex_buffers.size());
+    for (const WGPUVertexBufferLayout& buffer : desc.vertex_buffers) {
+        append(key, buffer.stepMode);
+        append(key, buffer.arrayStride);
+        append(key, buffer.attributeCount);
+        for (size_t i = 0; i < buffer.attributeCount; ++i) {
+            append(key, buffer.attributes[i].format);
+            append(key, buffer.attributes[i].offset);
+            append(key, buffer.attributes[i].shaderLocation);
+        }
+    }
+    append_bind_groups(key, desc.bind_groups);
+    append(key, desc.topology);
+    append(key, desc.cull_mode);
+    for (const WGPUBlendComponent& c : {desc.blend.color, desc.blend.alpha}) {
+        append(key, c.operation);
+        append(key, c.srcFactor);
+        append(key, c.dstFactor);
+    }
+    append(key, desc.depth_write);
+    append(key, desc.depth_compare);
+    append(key, desc.color_format);
+    append(key, desc.depth_format);
+    return key;
+}
+
+std::string pipeline_key(const ComputePipelineDescription& desc, WGPUShaderModule module) {
+    std::string key;
+    append(key, module);
+    key.append(desc.entry_point);
+    key.push_back('\0');
+    append_bind_groups(key, desc.bind_groups);
+    return key;
+}
+
+} // namespace
+
+PipelineCache::~PipelineCache() {
+    clear();
+}
+
+void PipelineCache::clear() {
+    for (auto& [key, cached] : m_pipelines) {
+        wgpuRenderPipelineRelease(cached.pipeline);
+        for (WGPUBindGroupLayout layout : cached.bind_group_layouts) {
+            wgpuBindGroupLayoutRelease(layout);
+        }
+    }
+    for (auto& [key, cached] : m_compute_pipelines) {
+        wgpuComputePipelineRelease(cached.pipeline);
+        for (WGPUBindGroupLayout layout : cached.bind_group_layouts) {
+            wgpuBindGroupLayoutRelease(layout);
+        }
+    }
+    for (auto& [source, module] : m_shader_modules) {
+        wgpuShaderModuleRelease(module);
+    }
+    m_pipelines.clear();
+    m_compute_pipelines.clear();
+    m_shader_modules.clear();
+}
+
+WGPUShaderModule PipelineCache::get_shader_module(std::string_view source) {
+    auto [it, inserted] = m_shader_modules.try_emplace(std::string(source), nullptr);
+    if (!inserted) {
+        return it->second;
+    }
+
+    WGPUShaderModuleDescriptor     shader_desc{};
+    WGPUShaderModuleWGSLDescriptor shader_code_desc{};
+
+    shader_code_desc.chain.next  = nullptr;
+    shader_code_desc.chain.sType = WGPUSType_ShaderSourceWGSL;
+    shader_desc.nextInChain      = &shader_code_desc.chain;
+    shader_code_desc.code        = WGPUStringView{source.data(), source.size()};
+
+    WGPUShaderModule shader_module = wgpuDeviceCreateShaderModule(m_device, &shader_desc);
+
+    WGPUCompilationInfoCallbackInfo callback_info = {};
+    callback_info.callback                        = shaderCompilationCallback;
+    callback_info.mode                            = WGPUCallbackMode_AllowSpontaneous;
+
+    wgpuShaderModuleGetCompilationInfo(shader_module, callback_info);
+
+    it->second = shader_module;
+    return shader_module;
+}
+
+const CachedPipeline& PipelineCache::get(const RenderPipelineDescription& desc) {
+    WGPUShaderModule module = get_shader_module(desc.shader_source);
+
+    auto [it, inserted] = m_pipelines.try_emplace(pipeline_key(desc, module));
+    if (!inserted) {
+        ++m_hits;
+        return it->second;
+    }
+    ++m_misses;
+    it->second = create_pipeline(desc, module);
+    return it->second;
+}
+
+const CachedComputePipeline& PipelineCache::get(const ComputePipelineDescription& desc) {
+    WGPUShaderModule module = get_shader_module(desc.shader_source);
+
+    auto [it, inserted] = m_compute_pipelines.try_emplace(pipeline_key(desc, module));
+    if (!inserted) {
+        ++m_hits;
+        return it->second;
+    }
+    ++m_misses;
+
+    CachedComputePipeline& cached = it->second;
+    cached.bind_group_layouts     = create_bind_group_layouts(desc.bind_groups);
+
+    WGPUComputePipelineDescriptor pipeline_desc = {};
+    pipeline_desc.compute.module                = module;
+    pipeline_desc.compute.entryPoint            = WGPUStringView{desc.entry_point.data(), desc.entry_point.size()};
+    pipeline_desc.layout                        = create_pipeline_layout(cached.bind_group_layouts);
+
+    cached.pipeline = wgpuDeviceCreateComputePipeline(m_device, &pipeline_desc);
+    wgpuPipelineLayoutRelease(pipeline_desc.layout);
+    return cached;
+}
+
+std::vector<WGPUBindGroupLayout> PipelineCache::create_bind_group_layouts(
+    const std::vector<std::vector<WGPUBindGroupLayoutEntry>>& bind_groups) {
+    std::vector<WGPUBindGroupLayout> layouts;
+    for (const auto& group : bind_groups) {
+        WGPUBindGroupLayoutDescriptor bind_group_layout_desc{};
+        bind_group_layout_desc.entryCount = group.size();
+        bind_group_layout_desc.entries    = group.data();
+        layouts.push_back(wgpuDeviceCreateBindGroupLayout(m_device, &bind_group_layout_desc));
+    }
+    return layouts;
+}
+
+WGPUPipelineLayout PipelineCache::create_pipeline_layout(const std::vector<WGPUBindGroupLayout>& bind_group_layouts) {
+    WGPUPipelineLayoutDescriptor layout_desc{};
+    layout_desc.bindGroupLayoutCount = bind_group_layouts.size();
+    layout_desc.bindGroupLayouts     = bind_group_layouts.data();
+    return wgpuDeviceCreatePipelineLayout(m_device, &layout_desc);
+}
+
+CachedPipeline PipelineCache::create_pipeline(const RenderPipelineDescription& desc, WGPUShaderModule module) {
+    CachedPipeline cached;
+
+    WGPURenderPipelineDescriptor pipeline_desc = {};
+
+    pipeline_desc.vertex.bufferCount   = desc.vertex_buffers.size();
+    pipeline_desc.vertex.buffers       = desc.vertex_buffers.data();
+    pipeline_desc.vertex.module        = module;
+    pipeline_desc.vertex.entryPoint    = to_string_view("vs_main");
+    pipeline_desc.vertex.constantCount = 0;
+    pipeline_desc.vertex.constants     = nullptr;
+
+    pipeline_desc.primitive.topology         = desc.topology;
+    pipeline_desc.primitive.stripIndexFormat = WGPUIndexFormat_Undefined;
+    pipeline_desc.primitive.frontFace        = WGPUFrontFace_CCW;
+    pipeline_desc.primitive.cullMode         = desc.cull_mode;
+
+    WGPUFragmentState fragment_state = {};
+    pipeline_desc.fragment           = &fragment_state;
+    fragment_state.module            = module;
+    fragment_state.entryPoint        = to_string_view("fs_main");
+    fragment_state.constantCount     = 0;
+    fragment_state.constants         = nullptr;
+
+    WGPUColorTargetState color_target = {};
+    color_target.format               = desc.color_format;
+    color_target.blend                = &desc.blend;
+    color_target.writeMask            = WGPUColorWriteMask_All;
+
+    fragment_state.targetCount = 1;
+    fragment_state.targets     = &color_target;
+
+    WGPUDepthStencilState depth_stencil_state = {};
+    depth_stencil_state.depthCompare          = desc.depth_compare;
+    depth_stencil_state.depthWriteEnabled     = desc.depth_write ? WGPUOptionalBool_True : WGPUOptionalBool_False;
+    depth_stencil_state.format                = desc.depth_format;
+    depth_stencil_state.stencilReadMask       = 0;
+    depth_stencil_state.stencilWriteMask      = 0;
+
+    pipeline_desc.depthStencil = &depth_stencil_state;
+
+    pipeline_desc.multisample.count                  = 1;
+    pipeline_desc.multisample.mask                   = ~0u;
+    pipeline_desc.multisample.alphaToCoverageEnabled = false;
+
+    cached.bind_group_layouts          = create_bind_group_layouts(desc.bind_groups);
+    WGPUPipelineLayout pipeline_layout = create_pipeline_layout(cached.bind_group_layouts);
+    pipeline_desc.layout               = pipeline_layout;
+
+    cached.pipeline = wgpuDeviceCreateRenderPipeline(m_device, &pipeline_desc);
+    wgpuPipelineLayoutRelease(pipeline_layout);
+    return cached;
+}
+
+} // namespace rr
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <webgpu/webgpu.h>
+
+namespace rr {
+
+// Everything that distinguishes one render pipeline from another. The shader has to provide
+// vs_main and fs_main, the pipeline renders to one color target with depth testing.
+struct RenderPipelineDescription {
+    std::string_view                                   shader_source;
+    std::vector<WGPUVertexBufferLayout>                vertex_buffers;
+    std::vector<std::vector<WGPUBindGroupLayoutEntry>> bind_groups;
+    WGPUPrimitiveTopology                              topology      = WGPUPrimitiveTopology_TriangleList;
+    WGPUCullMode                                       cull_mode     = WGPUCullMode_None;
+    WGPUBlendState                                     blend         = {};
+    bool                                               depth_write   = true;
+    WGPUCompareFunction                                depth_compare = WGPUCompareFunction_Less;
+    WGPUTextureFormat                                  color_format  = WGPUTextureFormat_Undefined;
+    WGPUTextureFormat                                  depth_format  = WGPUTextureFormat_Undefined;
+};
+
+struct CachedPipeline {
+    WGPURenderPipeline               pipeline = nullptr;
+    std::vector<WGPUBindGroupLayout> bind_group_layouts;
+};
+
+// A compute pipeline for one entry point of a shader
+struct ComputePipelineDescription {
+    std::string_view                                   shader_source;
+    std::string_view                                   entry_point;
+    std::vector<std::vector<WGPUBindGroupLayoutEntry>> bind_groups;
+};
+
+struct CachedComputePipeline {
+    WGPUComputePipeline              pipeline = nullptr;
+    std::vector<WGPUBindGroupLayout> bind_group_layouts;
+};
+
+// Shader modules and render pipelines shared by all drawables. Shader modules are keyed by
+// their source, pipelines by their full description, so drawables with the same shader and
+// state get the same pipeline. Everything returned is owned by the cache.
+class PipelineCache {
+public:
+    explicit PipelineCache(WGPUDevice device) : m_device(device) {}
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache&)            = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    const CachedPipeline& get(const RenderPipelineDescription& desc);
+
+    const CachedComputePipeline& get(const ComputePipelineDescription& desc);
+
+    WGPUShaderModule get_shader_module(std::string_view source);
+
+    void clear();
+
+    size_t hits() const {
+        return m_hits;
+    }
+
+    size_t misses() const {
+        return m_misses;
+    }
+
+    size_t num_pipelines() const {
+        return m_pipelines.size() + m_compute_pipelines.size();
+    }
+
+private:
+    CachedPipeline create_pipeline(const RenderPipelineDescription& desc, WGPUShaderModule module);
+
+    std::vector<WGPUBindGroupLayout> create_bind_group_layouts(
+        const std::vector<std::vector<WGPUBindGroupLayoutEntry>>& bind_groups);
+
+    WGPUPipelineLayout create_pipeline_layout(const std::vector<WGPUBindGroupLayout>& bind_group_layouts);
+
+    WGPUDevice m_device = nullptr;
+
+    std::unordered_map<std::string, WGPUShaderModule>      m_shader_modules;
+    std::unordered_map<std::string, CachedPipeline>        m_pipelines;
+    std::unordered_map<std::string, CachedComputePipeline> m_compute_pipelines;
+
+    size_t m_hits   = 0;
+    size_t m_misses = 0;
+};
+
+} // namespace rr
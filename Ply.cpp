@@ -0,0 +1,731 @@
+#include "Ply.h"
+
+#include "MappedFile.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace rr {
+
+PlyType parse_ply_type(const std::string& name) {
+    if (name == "char" || name == "int8")
+        return PlyType::Int8;
+    if (name == "uchar" || name == "uint8")
+        return PlyType::Uint8;
+    if (name == "short" || name == "int16")
+        return PlyType::Int16;
+    if (name == "ushort" || name == "uint16")
+        return PlyType::Uint16;
+    if (name == "int" || name == "int32")
+        return PlyType::Int32;
+    if (name == "uint" || name == "uint32")
+        return PlyType::Uint32;
+    if (name == "float" || name == "float32")
+        return PlyType::Float32;
+    if (name == "double" || name == "float64")
+        return PlyType::Float64;
+    throw std::runtime_error("Unknown PLY property type: " + name);
+}
+
+size_t ply_type_size(PlyType type) {
+    switch (type) {
+    case PlyType::Int8:
+    case PlyType::Uint8:
+        return 1;
+    case PlyType::Int16:
+    case PlyType::Uint16:
+        return 2;
+    case PlyType::Int32:
+    case PlyType::Uint32:
+    case PlyType::Float32:
+        return 4;
+    default:
+        return 8;
+    }
+}
+
+namespace {
+
+template <typename T> double load(const char* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return double(value);
+}
+
+std::vector<std::string> split_words(const std::string& line) {
+    std::vector<std::string> words;
+    for (size_t b = 0; b < line.size();) {
+        size_t e = line.find_first_of(" \t", b);
+        e        = e == std::string::npos ? line.size() : e;
+        if (e > b) {
+            words.push_back(line.substr(b, e - b));
+        }
+        b = e + 1;
+    }
+    return words;
+}
+
+} // namespace
+
+PlyHeader parse_ply_header(const MappedFile& file) {
+    std::string_view text(file.data(), file.size());
+    size_t           end = text.find("end_header");
+    if (text.substr(0, 3) != "ply" || end == std::string_view::npos) {
+        throw std::runtime_error("Invalid PLY header");
+    }
+    PlyHeader header;
+    header.data_begin = text.find('\n', end);
+    if (header.data_begin == std::string_view::npos) {
+        throw std::runtime_error("Invalid PLY header");
+    }
+    ++header.data_begin;
+
+    bool   has_format = false;
+    size_t pos        = 0;
+    while (pos < end) {
+        size_t      eol = text.find('\n', pos);
+        std::string line(text.substr(pos, eol - pos));
+        pos = eol + 1;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        std::vector<std::string> words = split_words(line);
+        if (words.empty()) {
+            continue;
+        }
+        if (words[0] == "format") {
+            if (words.size() < 2 || (words[1] != "ascii" && words[1] != "binary_little_endian")) {
+                throw std::runtime_error("Unsupported PLY format: " + line);
+            }
+            header.binary = words[1] == "binary_little_endian";
+            has_format    = true;
+        } else if (words[0] == "element" && words.size() == 3) {
+            PlyElement element;
+            element.name  = words[1];
+            element.count = std::stoull(words[2]);
+            header.elements.push_back(element);
+        } else if (words[0] == "property" && !header.elements.empty()) {
+            PlyProperty property;
+            if (words.size() == 5 && words[1] == "list") {
+                property.list       = true;
+                property.count_type = parse_ply_type(words[2]);
+                property.type       = parse_ply_type(words[3]);
+                property.name       = words[4];
+            } else if (words.size() == 3) {
+                property.type = parse_ply_type(words[1]);
+                property.name = words[2];
+            } else {
+                throw std::runtime_error("Invalid PLY property: " + line);
+            }
+            header.elements.back().properties.push_back(property);
+        }
+    }
+    if (!has_format) {
+        throw std::runtime_error("Invalid PLY header");
+    }
+    for (PlyElement& element : header.elements) {
+        bool fixed = std::none_of(element.properties.begin(), element.properties.end(),
+                                  [](const PlyProperty& p) { return p.list; });
+        for (const PlyProperty& property : element.properties) {
+            element.stride += fixed ? ply_type_size(property.type) : 0;
+        }
+    }
+    return header;
+}
+
+// Float colors are in [0, 1], ushort colors use the full range and all other integers 0-255
+float ply_color_scale(PlyType type) {
+    switch (type) {
+    case PlyType::Float32:
+    case PlyType::Float64:
+        return 1.0f;
+    case PlyType::Uint16:
+        return 1.0f / 65535.0f;
+    default:
+        return 1.0f / 255.0f;
+    }
+}
+
+namespace {
+
+// Where the values of one property go, nullptr if it is not read
+struct Column {
+    float* data   = nullptr;
+    size_t stride = 0;
+    float  scale  = 1.0f;
+
+    void store(size_t i, double value) const {
+        data[i * stride] = float(value) * scale;
+    }
+};
+
+// The properties of an element that go into an array of glm vectors, e.g. x, y, z. Only
+// used if all of them exist.
+template <typename Vec>
+bool map_vector(const PlyElement& element, const std::array<const char*, Vec::length()>& names,
+                std::vector<Vec>& values, std::vector<Column>& columns, bool is_color = false) {
+    std::array<int, Vec::length()> props;
+    for (size_t c = 0; c < names.size(); ++c) {
+        props[c] = element.find(names[c]);
+        if (props[c] < 0 || element.properties[props[c]].list) {
+            return false;
+        }
+    }
+    values.resize(element.count);
+    for (size_t c = 0; c < names.size(); ++c) {
+        Column& column = columns[props[c]];
+        column.data    = reinterpret_cast<float*>(values.data()) + c;
+        column.stride  = Vec::length();
+        column.scale   = is_color ? ply_color_scale(element.properties[props[c]].type) : 1.0f;
+    }
+    return true;
+}
+
+// The remaining scalar properties of an element
+void map_scalars(const PlyElement& element, std::vector<PlyScalars>& scalars, std::vector<Column>& columns) {
+    for (size_t k = 0; k < element.properties.size(); ++k) {
+        if (columns[k].data == nullptr && !element.properties[k].list) {
+            scalars.push_back({element.properties[k].name, std::vector<float>(element.count)});
+        }
+    }
+    size_t s = 0;
+    for (size_t k = 0; k < element.properties.size(); ++k) {
+        if (columns[k].data == nullptr && !element.properties[k].list) {
+            columns[k].data   = scalars[s++].values.data();
+            columns[k].stride = 1;
+        }
+    }
+}
+
+int face_index_property(const PlyElement& element) {
+    for (const char* name : {"vertex_indices", "vertex_index"}) {
+        int k = element.find(name);
+        if (k >= 0 && element.properties[k].list) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+// Binary rows of an element without lists, they all have the same size and are read in parallel
+void read_binary_rows(const char* data, const PlyElement& element, const std::vector<Column>& columns) {
+    std::vector<size_t> offsets;
+    size_t              offset = 0;
+    for (const PlyProperty& property : element.properties) {
+        offsets.push_back(offset);
+        offset += ply_type_size(property.type);
+    }
+    parallel_for(0, element.count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const char* row = data + i * element.stride;
+            for (size_t k = 0; k < columns.size(); ++k) {
+                if (columns[k].data == nullptr) {
+                    continue;
+                }
+                if (element.properties[k].type == PlyType::Float32 && columns[k].scale == 1.0f) {
+                    std::memcpy(columns[k].data + i * columns[k].stride, row + offsets[k], sizeof(float));
+                } else {
+                    columns[k].store(i, read_ply_value(row + offsets[k], element.properties[k].type));
+                }
+            }
+        }
+    });
+}
+
+// Throws unless count values of size bytes remain between p and end. Compares counts instead of
+// pointers, so huge counts from a malformed header can neither overflow nor point past the mapping.
+void check_remaining(const char* p, const char* end, size_t count, size_t size) {
+    if (p > end || (size > 0 && count > size_t(end - p) / size)) {
+        throw std::runtime_error("PLY file is truncated");
+    }
+}
+
+// Binary faces with lists, returns the end of the element. The usual layout of a uchar count
+// followed by int indices and nothing else is found with one pass over the counts, after which
+// the indices of every face are copied in parallel.
+const char* read_binary_faces(const char* p, const char* end, const PlyElement& element, int index_property,
+                              const std::vector<Column>& columns, std::vector<uint32_t>& indices,
+                              std::vector<uint32_t>& offsets) {
+    offsets.assign(element.count + 1, 0);
+    const PlyProperty& list = element.properties[index_property];
+
+    bool packed = element.properties.size() == 1 && list.count_type == PlyType::Uint8 &&
+                  (list.type == PlyType::Int32 || list.type == PlyType::Uint32);
+    if (packed) {
+        const char* q = p;
+        for (size_t f = 0; f < element.count; ++f) {
+            check_remaining(q, end, 1, 1);
+            uint8_t n = uint8_t(*q);
+            check_remaining(q + 1, end, n, 4);
+            offsets[f + 1] = offsets[f] + n;
+            q += 1 + 4 * size_t(n);
+        }
+        indices.resize(offsets[element.count]);
+        parallel_for(0, element.count, [&](size_t begin, size_t end) {
+            for (size_t f = begin; f < end; ++f) {
+                // every face before f takes one count byte plus its indices
+                const char* face = p + f + 4 * size_t(offsets[f]) + 1;
+                std::memcpy(indices.data() + offsets[f], face, 4 * size_t(offsets[f + 1] - offsets[f]));
+            }
+        });
+        return q;
+    }
+
+    for (size_t f = 0; f < element.count; ++f) {
+        for (size_t k = 0; k < element.properties.size(); ++k) {
+            const PlyProperty& property = element.properties[k];
+            size_t             size     = ply_type_size(property.type);
+            if (!property.list) {
+                check_remaining(p, end, 1, size);
+                if (columns[k].data != nullptr) {
+                    columns[k].store(f, read_ply_value(p, property.type));
+                }
+                p += size;
+                continue;
+            }
+            check_remaining(p, end, 1, ply_type_size(property.count_type));
+            size_t n = size_t(read_ply_value(p, property.count_type));
+            p += ply_type_size(property.count_type);
+            check_remaining(p, end, n, size);
+            if (int(k) == index_property) {
+                for (size_t c = 0; c < n; ++c) {
+                    indices.push_back(uint32_t(int64_t(read_ply_value(p + c * size, property.type))));
+                }
+                offsets[f + 1] = uint32_t(indices.size());
+            }
+            p += n * size;
+        }
+    }
+    return p;
+}
+
+// Skips the binary rows of an element that is not read
+const char* skip_binary_rows(const char* p, const char* end, const PlyElement& element) {
+    if (element.stride > 0 || element.properties.empty()) {
+        check_remaining(p, end, element.count, element.stride);
+        return p + element.count * element.stride;
+    }
+    for (size_t i = 0; i < element.count; ++i) {
+        for (const PlyProperty& property : element.properties) {
+            size_t n = 1;
+            if (property.list) {
+                check_remaining(p, end, 1, ply_type_size(property.count_type));
+                n = size_t(read_ply_value(p, property.count_type));
+                p += ply_type_size(property.count_type);
+            }
+            check_remaining(p, end, n, ply_type_size(property.type));
+            p += n * ply_type_size(property.type);
+        }
+    }
+    return p;
+}
+
+// The next number of an ascii row, false if there is none
+bool parse_value(const char*& p, const char* end, double& value) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        ++p;
+    }
+    if (p < end && *p == '+') {
+        ++p;
+    }
+    auto [next, ec] = std::from_chars(p, end, value);
+    if (ec != std::errc()) {
+        return false;
+    }
+    p = next;
+    return true;
+}
+
+// Start of every non-empty line of the ascii data, found in parallel
+std::vector<const char*> find_lines(const char* data, const char* end) {
+    size_t size       = size_t(end - data);
+    size_t num_chunks = std::min(num_worker_threads(), size / (size_t(1) << 20) + 1);
+
+    std::vector<const char*> bounds(num_chunks + 1);
+    bounds[0]          = data;
+    bounds[num_chunks] = end;
+    for (size_t c = 1; c < num_chunks; ++c) {
+        const char* p = std::max(data + c * (size / num_chunks), bounds[c - 1]);
+        const char* n = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+        bounds[c]     = n ? n + 1 : end;
+    }
+
+    std::vector<std::vector<const char*>> chunks(num_chunks);
+    parallel_for(
+        0, num_chunks,
+        [&](size_t begin, size_t chunk_end) {
+            for (size_t c = begin; c < chunk_end; ++c) {
+                for (const char* p = bounds[c]; p < bounds[c + 1];) {
+                    const char* n = static_cast<const char*>(std::memchr(p, '\n', size_t(bounds[c + 1] - p)));
+                    n             = n ? n : bounds[c + 1];
+                    if (std::any_of(p, n, [](char ch) { return ch != ' ' && ch != '\t' && ch != '\r'; })) {
+                        chunks[c].push_back(p);
+                    }
+                    p = n + 1;
+                }
+            }
+        },
+        1);
+
+    std::vector<const char*> lines;
+    for (const auto& chunk : chunks) {
+        lines.insert(lines.end(), chunk.begin(), chunk.end());
+    }
+    return lines;
+}
+
+// Parses the ascii rows [first, first + element.count) in parallel. Lists are skipped except
+// for the index list, whose entries are written to indices at offsets[row] if given and
+// otherwise only counted in offsets[row + 1]. Returns false on invalid data.
+bool parse_ascii_rows(const std::vector<const char*>& lines, size_t first, const char* data_end,
+                      const PlyElement& element, const std::vector<Column>& columns, int index_property,
+                      std::vector<uint32_t>* offsets, uint32_t* indices) {
+    std::atomic<bool> valid(true);
+    parallel_for(0, element.count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end && valid; ++i) {
+            const char* p        = lines[first + i];
+            const char* line_end = first + i + 1 < lines.size() ? lines[first + i + 1] : data_end;
+            for (size_t k = 0; k < element.properties.size(); ++k) {
+                double value = 0.0;
+                if (!parse_value(p, line_end, value)) {
+                    valid = false;
+                    break;
+                }
+                if (!element.properties[k].list) {
+                    if (columns[k].data != nullptr) {
+                        columns[k].store(i, value);
+                    }
+                    continue;
+                }
+                size_t n = size_t(value);
+                for (size_t c = 0; c < n; ++c) {
+                    if (!parse_value(p, line_end, value)) {
+                        valid = false;
+                        break;
+                    }
+                    if (int(k) == index_property && indices != nullptr) {
+                        indices[(*offsets)[i] + c] = uint32_t(int64_t(value));
+                    }
+                }
+                if (int(k) == index_property && indices == nullptr) {
+                    (*offsets)[i + 1] = uint32_t(n);
+                }
+            }
+        }
+    });
+    return valid;
+}
+
+Mesh read_ply(std::string_view path, PlyProperties* properties) {
+    MappedFile      file(path);
+    PlyHeader       header = parse_ply_header(file);
+    const char*     p      = file.data() + header.data_begin;
+    const char*     end    = file.data() + file.size();
+    Mesh            mesh;
+    PlyProperties   ignored;
+    PlyProperties&  extra  = properties ? *properties : ignored;
+
+    std::vector<const char*> lines;
+    size_t                   line = 0;
+    if (!header.binary) {
+        lines = find_lines(p, end);
+    }
+
+    bool has_vertices = false;
+    for (const PlyElement& element : header.elements) {
+        bool is_vertex = element.name == "vertex";
+        bool is_face   = element.name == "face";
+        if (!header.binary && element.count > lines.size() - line) {
+            throw std::runtime_error("PLY file is truncated");
+        }
+        if (header.binary) {
+            // every row takes at least its fixed properties and list counts, checked before the
+            // arrays are allocated for the element
+            size_t min_row = 0;
+            for (const PlyProperty& property : element.properties) {
+                min_row += ply_type_size(property.list ? property.count_type : property.type);
+            }
+            check_remaining(p, end, element.count, min_row);
+        }
+        if (!is_vertex && !is_face) {
+            if (header.binary) {
+                p = skip_binary_rows(p, end, element);
+            }
+            line += element.count;
+            continue;
+        }
+
+        std::vector<Column> columns(element.properties.size());
+        int                 index_property = -1;
+        if (is_vertex) {
+            if (!map_vector(element, {"x", "y", "z"}, mesh.positions, columns)) {
+                throw std::runtime_error("PLY file has no vertex positions");
+            }
+            has_vertices = true;
+            map_vector(element, {"nx", "ny", "nz"}, mesh.normals, columns);
+            if (!map_vector(element, {"u", "v"}, mesh.uvs, columns) &&
+                !map_vector(element, {"s", "t"}, mesh.uvs, columns)) {
+                map_vector(element, {"texture_u", "texture_v"}, mesh.uvs, columns);
+            }
+            if (properties) {
+                map_vector(element, {"red", "green", "blue"}, extra.vertex_colors, columns, true);
+                map_scalars(element, extra.vertex_scalars, columns);
+            }
+        } else {
+            index_property = face_index_property(element);
+            if (index_property < 0) {
+                throw std::runtime_error("PLY faces have no vertex_indices");
+            }
+            if (properties) {
+                map_vector(element, {"red", "green", "blue"}, extra.face_colors, columns, true);
+                map_scalars(element, extra.face_scalars, columns);
+            }
+        }
+
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> offsets;
+        if (header.binary && element.stride > 0) {
+            bool float_positions = std::all_of(element.properties.begin(), element.properties.end(),
+                                               [](const PlyProperty& p) { return p.type == PlyType::Float32; });
+            if (is_vertex && float_positions && element.properties.size() == 3 && element.find("x") == 0 &&
+                element.find("y") == 1 && element.find("z") == 2) {
+                // nothing but float positions, the file holds the array as it is
+                std::memcpy(mesh.positions.data(), p, element.count * sizeof(glm::vec3));
+            } else {
+                read_binary_rows(p, element, columns);
+            }
+            p += element.count * element.stride;
+        } else if (header.binary) {
+            if (is_vertex) {
+                throw std::runtime_error("PLY vertices must not have list properties");
+            }
+            p = read_binary_faces(p, end, element, index_property, columns, indices, offsets);
+        } else {
+            // faces are parsed twice, once for the corner counts and once for the indices
+            if (is_face) {
+                std::vector<Column> no_columns(element.properties.size());
+                offsets.assign(element.count + 1, 0);
+                if (parse_ascii_rows(lines, line, end, element, no_columns, index_property, &offsets, nullptr)) {
+                    for (size_t f = 0; f < element.count; ++f) {
+                        offsets[f + 1] += offsets[f];
+                    }
+                    indices.resize(offsets[element.count]);
+                }
+            }
+            if (!parse_ascii_rows(lines, line, end, element, columns, index_property, &offsets,
+                                  is_face ? indices.data() : nullptr)) {
+                throw std::runtime_error("Invalid PLY " + element.name + " data");
+            }
+            line += element.count;
+        }
+
+        if (is_face) {
+            if (!has_vertices) {
+                throw std::runtime_error("PLY faces have to follow the vertices");
+            }
+            uint32_t num_vertices = uint32_t(mesh.positions.size());
+            if (std::any_of(indices.begin(), indices.end(), [&](uint32_t i) { return i >= num_vertices; })) {
+                throw std::runtime_error("PLY face index out of range");
+            }
+            mesh.position_faces.assign(std::move(indices), std::move(offsets));
+        }
+    }
+
+    // normals and uvs are per vertex
+    if (!mesh.normals.empty()) {
+        mesh.normal_faces = mesh.position_faces;
+    }
+    if (!mesh.uvs.empty()) {
+        mesh.uv_faces = mesh.position_faces;
+    }
+    return mesh;
+}
+
+bool same_faces(const FaceList& a, const FaceList& b) {
+    return a.uniform_size() == b.uniform_size() && a.indices() == b.indices() && a.offsets() == b.offsets();
+}
+
+} // namespace
+
+double read_ply_value(const char* p, PlyType type) {
+    switch (type) {
+    case PlyType::Int8:
+        return load<int8_t>(p);
+    case PlyType::Uint8:
+        return load<uint8_t>(p);
+    case PlyType::Int16:
+        return load<int16_t>(p);
+    case PlyType::Uint16:
+        return load<uint16_t>(p);
+    case PlyType::Int32:
+        return load<int32_t>(p);
+    case PlyType::Uint32:
+        return load<uint32_t>(p);
+    case PlyType::Float32:
+        return load<float>(p);
+    default:
+        return load<double>(p);
+    }
+}
+
+Mesh load_ply(std::string_view path) {
+    return read_ply(path, nullptr);
+}
+
+Mesh load_ply(std::string_view path, PlyProperties& properties) {
+    properties = {};
+    return read_ply(path, &properties);
+}
+
+PlyWriter::PlyWriter(std::string_view path, const PlyWriterLayout& layout) : m_path(path), m_layout(layout) {
+    m_file.open(m_path, std::ios::binary | std::ios::trunc);
+    if (!m_file) {
+        throw std::runtime_error("Failed to open file: " + m_path);
+    }
+    m_buffer.reserve(size_t(1) << 20);
+
+    m_file << "ply\nformat binary_little_endian 1.0\ncomment written by RenderRex\n";
+    m_file << "element vertex " << layout.num_vertices << "\n";
+    m_file << "property float x\nproperty float y\nproperty float z\n";
+    if (layout.normals) {
+        m_file << "property float nx\nproperty float ny\nproperty float nz\n";
+    }
+    if (layout.uvs) {
+        m_file << "property float u\nproperty float v\n";
+    }
+    if (layout.vertex_colors) {
+        m_file << "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+    }
+    for (const std::string& name : layout.vertex_scalars) {
+        m_file << "property float " << name << "\n";
+    }
+    m_file << "element face " << layout.num_faces << "\n";
+    m_file << "property list uchar uint vertex_indices\n";
+    if (layout.face_colors) {
+        m_file << "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+    }
+    for (const std::string& name : layout.face_scalars) {
+        m_file << "property float " << name << "\n";
+    }
+    m_file << "end_header\n";
+}
+
+PlyWriter::~PlyWriter() {
+    if (m_file.is_open()) {
+        flush();
+    }
+}
+
+void PlyWriter::put_color(const glm::vec3& color) {
+    glm::vec3 c = glm::round(glm::clamp(color, 0.0f, 1.0f) * 255.0f);
+    put(uint8_t(c.x));
+    put(uint8_t(c.y));
+    put(uint8_t(c.z));
+}
+
+void PlyWriter::write_vertices(const glm::vec3* positions, size_t count, const PlyElementData& data) {
+    assert(m_num_faces == 0 && m_num_vertices + count <= m_layout.num_vertices);
+    assert(data.scalars.size() >= m_layout.vertex_scalars.size());
+    for (size_t i = 0; i < count; ++i) {
+        put(positions[i]);
+        if (m_layout.normals) {
+            put(data.normals[i]);
+        }
+        if (m_layout.uvs) {
+            put(data.uvs[i]);
+        }
+        if (m_layout.vertex_colors) {
+            put_color(data.colors[i]);
+        }
+        for (size_t s = 0; s < m_layout.vertex_scalars.size(); ++s) {
+            put(data.scalars[s][i]);
+        }
+        flush_if_full();
+    }
+    m_num_vertices += count;
+}
+
+void PlyWriter::write_faces(const FaceList& faces, const PlyElementData& data) {
+    assert(m_num_vertices == m_layout.num_vertices && m_num_faces + faces.size() <= m_layout.num_faces);
+    assert(data.scalars.size() >= m_layout.face_scalars.size());
+    for (size_t f = 0; f < faces.size(); ++f) {
+        auto face = faces[f];
+        if (face.size() > 255) {
+            throw std::runtime_error("PLY faces have at most 255 corners: " + m_path);
+        }
+        put(uint8_t(face.size()));
+        const char* bytes = reinterpret_cast<const char*>(face.begin());
+        m_buffer.insert(m_buffer.end(), bytes, bytes + face.size() * sizeof(uint32_t));
+        if (m_layout.face_colors) {
+            put_color(data.colors[f]);
+        }
+        for (size_t s = 0; s < m_layout.face_scalars.size(); ++s) {
+            put(data.scalars[s][f]);
+        }
+        flush_if_full();
+    }
+    m_num_faces += faces.size();
+}
+
+void PlyWriter::close() {
+    flush();
+    m_file.close();
+    if (!m_file) {
+        throw std::runtime_error("Failed to write PLY file: " + m_path);
+    }
+    if (m_num_vertices != m_layout.num_vertices || m_num_faces != m_layout.num_faces) {
+        throw std::runtime_error("PLY element counts do not match the header: " + m_path);
+    }
+}
+
+void PlyWriter::flush_if_full() {
+    if (m_buffer.size() >= (size_t(1) << 20) - 4096) {
+        flush();
+    }
+}
+
+void PlyWriter::flush() {
+    m_file.write(m_buffer.data(), std::streamsize(m_buffer.size()));
+    m_buffer.clear();
+}
+
+void save_ply(std::string_view path, const Mesh& mesh, const PlyProperties& properties) {
+    PlyWriterLayout layout;
+    layout.num_vertices = mesh.num_vertices();
+    layout.num_faces    = mesh.num_faces();
+    layout.normals = mesh.normals.size() == mesh.num_vertices() && same_faces(mesh.normal_faces, mesh.position_faces);
+    layout.uvs     = mesh.uvs.size() == mesh.num_vertices() && same_faces(mesh.uv_faces, mesh.position_faces);
+    layout.vertex_colors = properties.vertex_colors.size() == mesh.num_vertices() && mesh.num_vertices() > 0;
+    layout.face_colors   = properties.face_colors.size() == mesh.num_faces() && mesh.num_faces() > 0;
+
+    PlyElementData vertex_data;
+    vertex_data.normals = mesh.normals.data();
+    vertex_data.uvs     = mesh.uvs.data();
+    vertex_data.colors  = properties.vertex_colors.data();
+    for (const PlyScalars& scalars : properties.vertex_scalars) {
+        assert(scalars.values.size() == mesh.num_vertices());
+        layout.vertex_scalars.push_back(scalars.name);
+        vertex_data.scalars.push_back(scalars.values.data());
+    }
+    PlyElementData face_data;
+    face_data.colors = properties.face_colors.data();
+    for (const PlyScalars& scalars : properties.face_scalars) {
+        assert(scalars.values.size() == mesh.num_faces());
+        layout.face_scalars.push_back(scalars.name);
+        face_data.scalars.push_back(scalars.values.data());
+    }
+
+    PlyWriter writer(path, layout);
+    writer.write_vertices(mesh.positions.data(), mesh.num_vertices(), vertex_data);
+    writer.write_faces(mesh.position_faces, face_data);
+    writer.close();
+}
+
+} // namespace rr
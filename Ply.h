@@ -0,0 +1,158 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rr {
+
+class MappedFile;
+
+enum class PlyType { Int8, Uint8, Int16, Uint16, Int32, Uint32, Float32, Float64 };
+
+// Accepts both the old (uchar) and the sized (uint8) type names, throws std::runtime_error
+// for unknown ones
+PlyType parse_ply_type(const std::string& name);
+
+size_t ply_type_size(PlyType type);
+
+// Reads one little endian value, p does not have to be aligned
+double read_ply_value(const char* p, PlyType type);
+
+// Scale of a color property to [0, 1]: float colors are used as they are, ushort colors use
+// the full range and all other integers 0-255
+float ply_color_scale(PlyType type);
+
+struct PlyProperty {
+    std::string name;
+    PlyType     type       = PlyType::Float32;
+    bool        list       = false;
+    PlyType     count_type = PlyType::Uint8;
+};
+
+struct PlyElement {
+    std::string              name;
+    size_t                   count = 0;
+    std::vector<PlyProperty> properties;
+    // bytes per binary row, 0 if the element has list properties
+    size_t stride = 0;
+
+    int find(const char* property) const {
+        for (size_t k = 0; k < properties.size(); ++k) {
+            if (properties[k].name == property) {
+                return int(k);
+            }
+        }
+        return -1;
+    }
+};
+
+struct PlyHeader {
+    bool                    binary     = false;
+    size_t                  data_begin = 0;
+    std::vector<PlyElement> elements;
+};
+
+// Parses the header of an ascii or binary little endian PLY file, data_begin is the offset
+// of the first element row. Throws std::runtime_error if the header is invalid.
+PlyHeader parse_ply_header(const MappedFile& file);
+
+struct PlyScalars {
+    std::string        name;
+    std::vector<float> values;
+};
+
+// Per-element data of a PLY file that is not part of the mesh. red, green and blue become
+// colors scaled to [0, 1], every other scalar property becomes a PlyScalars in file order. The
+// face data matches the faces of the loaded mesh, so it can be passed to
+// VisualMesh::add_face_colors and add_face_scalars as it is.
+struct PlyProperties {
+    std::vector<glm::vec3>  vertex_colors;
+    std::vector<glm::vec3>  face_colors;
+    std::vector<PlyScalars> vertex_scalars;
+    std::vector<PlyScalars> face_scalars;
+};
+
+// Loads an ascii or binary little endian PLY file. Vertices provide x, y, z and optionally
+// nx, ny, nz and u, v (or s, t), which share the faces of the positions. Faces are read from
+// the vertex_indices list. Binary files are read with one pass over the mapped file, ascii
+// files are parsed in parallel. Throws std::runtime_error if the file is invalid.
+Mesh load_ply(std::string_view path);
+
+// Same and also reads all other vertex and face properties
+Mesh load_ply(std::string_view path, PlyProperties& properties);
+
+// The header of a PlyWriter. Element counts are part of the PLY header, so they are known
+// before the first element is written.
+struct PlyWriterLayout {
+    size_t                   num_vertices  = 0;
+    size_t                   num_faces     = 0;
+    bool                     normals       = false;
+    bool                     uvs           = false;
+    bool                     vertex_colors = false;
+    bool                     face_colors   = false;
+    std::vector<std::string> vertex_scalars;
+    std::vector<std::string> face_scalars;
+};
+
+// Optional data of consecutive elements, every array that is enabled in the layout holds one
+// entry per element. normals and uvs are only used for vertices.
+struct PlyElementData {
+    const glm::vec3*          normals = nullptr;
+    const glm::vec2*          uvs     = nullptr;
+    const glm::vec3*          colors  = nullptr;
+    std::vector<const float*> scalars;
+};
+
+// Writes a binary little endian PLY file piece by piece, e.g. the frames of a simulation that
+// do not fit into memory at once. All vertices have to be written before the first face. Rows
+// are packed into a buffer that is written whenever it is full. Throws std::runtime_error if
+// the file cannot be written.
+class PlyWriter {
+public:
+    PlyWriter(std::string_view path, const PlyWriterLayout& layout);
+    ~PlyWriter();
+
+    PlyWriter(const PlyWriter&)            = delete;
+    PlyWriter& operator=(const PlyWriter&) = delete;
+
+    void write_vertices(const glm::vec3* positions, size_t count, const PlyElementData& data = {});
+
+    // Faces have at most 255 corners
+    void write_faces(const FaceList& faces, const PlyElementData& data = {});
+
+    // Writes the rest of the buffer, throws std::runtime_error if fewer elements were written
+    // than the layout announced
+    void close();
+
+private:
+    template <typename T> void put(const T& value) {
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        m_buffer.insert(m_buffer.end(), bytes, bytes + sizeof(T));
+    }
+
+    void put_color(const glm::vec3& color);
+
+    void flush_if_full();
+
+    void flush();
+
+    std::string       m_path;
+    std::ofstream     m_file;
+    PlyWriterLayout   m_layout;
+    std::vector<char> m_buffer;
+    size_t            m_num_vertices = 0;
+    size_t            m_num_faces    = 0;
+};
+
+// Writes the mesh with a PlyWriter. PLY stores normals and uvs per vertex, so they are only
+// written if they are indexed like the positions, e.g. after load_ply or set_smooth_normals.
+void save_ply(std::string_view path, const Mesh& mesh, const PlyProperties& properties = {});
+
+} // namespace rr
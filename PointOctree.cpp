@@ -0,0 +1,480 @@
+#include "PointOctree.h"
+
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "Ply.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace rr {
+
+namespace {
+
+constexpr size_t chunk_points = size_t(1) << 20;
+
+// Calls f(points, count) for consecutive chunks of points
+using PointVisitor = std::function<void(const PointSprite*, size_t)>;
+using PointSource  = std::function<void(const PointVisitor&)>;
+
+// Vertex layout of a PLY file, only the first element may precede the data we need
+struct PlyVertexLayout {
+    bool                 binary     = false;
+    size_t               data_begin = 0;
+    size_t               count      = 0;
+    size_t               stride     = 0; // binary only
+    std::vector<PlyType> types;
+    std::vector<size_t>  offsets;
+    std::array<int, 6>   props = {-1, -1, -1, -1, -1, -1}; // x, y, z, red, green, blue
+};
+
+PlyVertexLayout vertex_layout(const MappedFile& file) {
+    PlyHeader header = parse_ply_header(file);
+    if (header.elements.empty() || header.elements[0].name != "vertex") {
+        throw std::runtime_error("PLY vertex element has to come first");
+    }
+    const PlyElement& vertex = header.elements[0];
+
+    PlyVertexLayout layout;
+    layout.binary     = header.binary;
+    layout.data_begin = header.data_begin;
+    layout.count      = vertex.count;
+    for (const PlyProperty& property : vertex.properties) {
+        if (property.list) {
+            throw std::runtime_error("Unsupported PLY vertex list property: " + property.name);
+        }
+        layout.types.push_back(property.type);
+        layout.offsets.push_back(layout.stride);
+        layout.stride += ply_type_size(property.type);
+    }
+    const std::array<const char*, 6> names = {"x", "y", "z", "red", "green", "blue"};
+    for (size_t k = 0; k < names.size(); ++k) {
+        layout.props[k] = vertex.find(names[k]);
+    }
+    if (layout.props[0] < 0 || layout.props[1] < 0 || layout.props[2] < 0) {
+        throw std::runtime_error("PLY file has no vertex positions");
+    }
+    if (layout.binary && layout.count > (file.size() - layout.data_begin) / layout.stride) {
+        throw std::runtime_error("PLY file is truncated");
+    }
+    return layout;
+}
+
+// Reads the input twice, once for the bounds and once to distribute the points, so the
+// file is mapped instead of loaded
+PointSource input_source(const MappedFile& file, const glm::vec3& default_color) {
+    uint32_t color = glm::packUnorm4x8(glm::vec4(default_color, 1.0f));
+    bool     ply   = file.size() >= 3 && std::memcmp(file.data(), "ply", 3) == 0;
+
+    if (!ply) {
+        if (file.size() % (3 * sizeof(float)) != 0) {
+            throw std::runtime_error("Input is neither a PLY file nor raw float x, y, z triples");
+        }
+        return [&file, color](const PointVisitor& visit) {
+            size_t                   count = file.size() / (3 * sizeof(float));
+            std::vector<PointSprite> points;
+            for (size_t begin = 0; begin < count; begin += chunk_points) {
+                size_t n = std::min(chunk_points, count - begin);
+                points.resize(n);
+                for (size_t i = 0; i < n; ++i) {
+                    std::memcpy(&points[i].position, file.data() + (begin + i) * 3 * sizeof(float),
+                                sizeof(glm::vec3));
+                    points[i].radius = 0;
+                    points[i].color  = color;
+                }
+                visit(points.data(), n);
+            }
+        };
+    }
+
+    PlyVertexLayout layout      = vertex_layout(file);
+    bool            has_color   = layout.props[3] >= 0 && layout.props[4] >= 0 && layout.props[5] >= 0;
+    float           color_scale = has_color ? ply_color_scale(layout.types[layout.props[3]]) : 1.0f;
+
+    return [&file, layout, has_color, color_scale, color](const PointVisitor& visit) {
+        std::vector<PointSprite> points;
+        points.reserve(chunk_points);
+        std::vector<double> values(layout.types.size());
+
+        auto emit = [&]() {
+            PointSprite p;
+            p.position = glm::vec3(values[layout.props[0]], values[layout.props[1]], values[layout.props[2]]);
+            p.radius   = 0;
+            p.color    = color;
+            if (has_color) {
+                glm::vec3 c(values[layout.props[3]], values[layout.props[4]], values[layout.props[5]]);
+                p.color = glm::packUnorm4x8(glm::vec4(c * color_scale, 1.0f));
+            }
+            points.push_back(p);
+            if (points.size() == chunk_points) {
+                visit(points.data(), points.size());
+                points.clear();
+            }
+        };
+
+        if (layout.binary) {
+            const char* data = file.data() + layout.data_begin;
+            for (size_t i = 0; i < layout.count; ++i) {
+                const char* vertex = data + i * layout.stride;
+                for (size_t k = 0; k < layout.types.size(); ++k) {
+                    values[k] = read_ply_value(vertex + layout.offsets[k], layout.types[k]);
+                }
+                emit();
+            }
+        } else {
+            const char* p   = file.data() + layout.data_begin;
+            const char* end = file.data() + file.size();
+            for (size_t i = 0; i < layout.count; ++i) {
+                for (size_t k = 0; k < layout.types.size(); ++k) {
+                    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+                        ++p;
+                    }
+                    auto [next, ec] = std::from_chars(p, end, values[k]);
+                    if (ec != std::errc()) {
+                        throw std::runtime_error("Invalid PLY vertex data");
+                    }
+                    p = next;
+                }
+                emit();
+            }
+        }
+        if (!points.empty()) {
+            visit(points.data(), points.size());
+        }
+    };
+}
+
+// Buffered temporary file of the points that are passed on to one child
+class PointFile {
+public:
+    explicit PointFile(std::string path) : m_path(std::move(path)) {}
+
+    void push(const PointSprite& point) {
+        if (!m_file.is_open()) {
+            m_file.open(m_path, std::ios::binary);
+            if (!m_file) {
+                throw std::runtime_error("Failed to open file: " + m_path);
+            }
+            m_buffer.reserve(4096);
+        }
+        m_buffer.push_back(point);
+        if (m_buffer.size() == m_buffer.capacity()) {
+            flush();
+        }
+        ++m_count;
+    }
+
+    void close() {
+        if (m_file.is_open()) {
+            flush();
+            m_file.close();
+        }
+    }
+
+    size_t count() const {
+        return m_count;
+    }
+
+    const std::string& path() const {
+        return m_path;
+    }
+
+private:
+    void flush() {
+        m_file.write(reinterpret_cast<const char*>(m_buffer.data()),
+                     std::streamsize(m_buffer.size() * sizeof(PointSprite)));
+        m_buffer.clear();
+    }
+
+    std::string              m_path;
+    std::ofstream            m_file;
+    std::vector<PointSprite> m_buffer;
+    size_t                   m_count = 0;
+};
+
+PointSource file_source(const std::string& path) {
+    return [path](const PointVisitor& visit) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Failed to open file: " + path);
+        }
+        std::vector<PointSprite> points(chunk_points);
+        while (file) {
+            file.read(reinterpret_cast<char*>(points.data()), std::streamsize(points.size() * sizeof(PointSprite)));
+            size_t n = size_t(file.gcount()) / sizeof(PointSprite);
+            if (n > 0) {
+                visit(points.data(), n);
+            }
+        }
+    };
+}
+
+struct BuildNode {
+    glm::vec3                                 lower;
+    float                                     size;
+    uint32_t                                  level       = 0;
+    uint64_t                                  first_point = 0;
+    uint32_t                                  num_points  = 0;
+    std::array<std::unique_ptr<BuildNode>, 8> children;
+};
+
+class OctreeBuilder {
+public:
+    OctreeBuilder(const std::string& octree_path, const PointOctreeBuildOptions& options)
+        : m_options(options), m_temp_dir(octree_path + ".tmp") {
+        fs::create_directories(m_temp_dir);
+        m_file.open(octree_path, std::ios::binary | std::ios::trunc);
+        if (!m_file) {
+            throw std::runtime_error("Failed to open file: " + octree_path);
+        }
+        PointOctreeHeader header;
+        m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    ~OctreeBuilder() {
+        std::error_code ec;
+        fs::remove_all(m_temp_dir, ec);
+    }
+
+    void build(const PointSource& input) {
+        // the root is the bounding cube, slightly enlarged so that the upper bounds fall inside
+        glm::vec3 lower(std::numeric_limits<float>::max());
+        glm::vec3 upper(-std::numeric_limits<float>::max());
+        size_t    count = 0;
+        input([&](const PointSprite* points, size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                lower = glm::min(lower, points[i].position);
+                upper = glm::max(upper, points[i].position);
+            }
+            count += n;
+        });
+        if (count == 0) {
+            throw std::runtime_error("Point cloud is empty");
+        }
+        glm::vec3 extent = upper - lower;
+        float     size   = std::max({extent.x, extent.y, extent.z, 1e-6f}) * 1.0001f;
+
+        m_root        = std::make_unique<BuildNode>();
+        m_root->lower = lower;
+        m_root->size  = size;
+        process(*m_root, count, input, "r", true);
+        write_nodes();
+    }
+
+private:
+    // Keeps one point per grid cell in the node and passes the others on to the children
+    void process(BuildNode& node, size_t count, const PointSource& source, const std::string& name,
+                 bool parallel_children) {
+        uint32_t grid   = m_options.grid_size;
+        uint32_t radius = glm::packHalf2x16(glm::vec2(m_options.radius_scale * node.size / float(grid), 0.0f));
+
+        // all points of identical positions end up in one leaf after at most 20 levels
+        if (count <= m_options.max_leaf_points || node.level >= 20) {
+            write_leaf(node, source, radius);
+            return;
+        }
+
+        std::vector<uint64_t>    occupied((size_t(grid) * grid * grid + 63) / 64, 0);
+        std::vector<PointSprite> selected;
+        std::vector<PointFile>   child_files;
+        child_files.reserve(8);
+        for (int c = 0; c < 8; ++c) {
+            child_files.emplace_back((m_temp_dir / (name + char('0' + c))).string());
+        }
+
+        glm::vec3 center = node.lower + 0.5f * node.size;
+        float     scale  = float(grid) / node.size;
+        source([&](const PointSprite* points, size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                const PointSprite& p = points[i];
+                glm::ivec3 cell = glm::clamp(glm::ivec3((p.position - node.lower) * scale), glm::ivec3(0),
+                                             glm::ivec3(int(grid) - 1));
+                size_t     index = (size_t(cell.z) * grid + size_t(cell.y)) * grid + size_t(cell.x);
+                uint64_t   bit   = uint64_t(1) << (index % 64);
+                if ((occupied[index / 64] & bit) == 0) {
+                    occupied[index / 64] |= bit;
+                    selected.push_back(p);
+                    selected.back().radius = radius;
+                } else {
+                    int octant = int(p.position.x >= center.x) | (int(p.position.y >= center.y) << 1) |
+                                 (int(p.position.z >= center.z) << 2);
+                    child_files[octant].push(p);
+                }
+            }
+        });
+        node.first_point = append(selected.data(), selected.size());
+        node.num_points  = uint32_t(selected.size());
+        selected         = {};
+        occupied         = {};
+
+        for (int c = 0; c < 8; ++c) {
+            child_files[c].close();
+            if (child_files[c].count() > 0) {
+                auto child   = std::make_unique<BuildNode>();
+                child->size  = 0.5f * node.size;
+                child->lower = node.lower + child->size * glm::vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1);
+                child->level = node.level + 1;
+                node.children[c] = std::move(child);
+            }
+        }
+
+        auto process_child = [&](int c) {
+            if (node.children[c]) {
+                const std::string& path = child_files[c].path();
+                process(*node.children[c], child_files[c].count(), file_source(path), name + char('0' + c), false);
+                fs::remove(path);
+            }
+        };
+        if (parallel_children) {
+            // an exception must not leave a worker thread, it is rethrown here once all have joined
+            std::array<std::exception_ptr, 8> errors;
+            parallel_for(
+                0, 8,
+                [&](size_t begin, size_t end) {
+                    for (size_t c = begin; c < end; ++c) {
+                        try {
+                            process_child(int(c));
+                        } catch (...) {
+                            errors[c] = std::current_exception();
+                        }
+                    }
+                },
+                1);
+            for (const std::exception_ptr& error : errors) {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
+        } else {
+            for (int c = 0; c < 8; ++c) {
+                process_child(c);
+            }
+        }
+    }
+
+    void write_leaf(BuildNode& node, const PointSource& source, uint32_t radius) {
+        // the points of a node have to be contiguous in the file, so the file stays locked
+        std::lock_guard<std::mutex> lock(m_mutex);
+        node.first_point = m_num_points;
+        source([&](const PointSprite* points, size_t n) {
+            std::vector<PointSprite> chunk(points, points + n);
+            for (PointSprite& p : chunk) {
+                p.radius = radius;
+            }
+            m_file.write(reinterpret_cast<const char*>(chunk.data()), std::streamsize(n * sizeof(PointSprite)));
+            m_num_points += n;
+        });
+        node.num_points = uint32_t(m_num_points - node.first_point);
+    }
+
+    uint64_t append(const PointSprite* points, size_t n) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint64_t                    first = m_num_points;
+        m_file.write(reinterpret_cast<const char*>(points), std::streamsize(n * sizeof(PointSprite)));
+        m_num_points += n;
+        return first;
+    }
+
+    // Breadth first, so that the children of every node are contiguous
+    void write_nodes() {
+        std::vector<PointOctreeNode>  nodes;
+        std::deque<const BuildNode*> queue = {m_root.get()};
+        while (!queue.empty()) {
+            const BuildNode* b = queue.front();
+            queue.pop_front();
+
+            PointOctreeNode n;
+            n.lower       = b->lower;
+            n.size        = b->size;
+            n.first_point = b->first_point;
+            n.num_points  = b->num_points;
+            n.level       = b->level;
+            n.first_child = uint32_t(nodes.size() + queue.size() + 1);
+            for (int c = 0; c < 8; ++c) {
+                if (b->children[c]) {
+                    n.child_mask |= 1u << c;
+                    queue.push_back(b->children[c].get());
+                }
+            }
+            nodes.push_back(n);
+        }
+
+        PointOctreeHeader header;
+        header.num_nodes   = uint32_t(nodes.size());
+        header.num_points  = m_num_points;
+        header.node_offset = sizeof(PointOctreeHeader) + m_num_points * sizeof(PointSprite);
+        header.lower       = m_root->lower;
+        header.size        = m_root->size;
+
+        m_file.write(reinterpret_cast<const char*>(nodes.data()),
+                     std::streamsize(nodes.size() * sizeof(PointOctreeNode)));
+        m_file.seekp(0);
+        m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        m_file.close();
+        if (!m_file) {
+            throw std::runtime_error("Failed to write point octree");
+        }
+    }
+
+    PointOctreeBuildOptions    m_options;
+    fs::path                   m_temp_dir;
+    std::ofstream              m_file;
+    std::mutex                 m_mutex;
+    uint64_t                   m_num_points = 0;
+    std::unique_ptr<BuildNode> m_root;
+};
+
+} // namespace
+
+void build_point_octree(std::string_view input_path, std::string_view octree_path,
+                        const PointOctreeBuildOptions& options) {
+    MappedFile    input(input_path);
+    OctreeBuilder builder{std::string(octree_path), options};
+    builder.build(input_source(input, options.color));
+}
+
+PointOctree::PointOctree(std::string_view path) : m_path(path) {
+    std::ifstream file(m_path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Failed to open file: " + m_path);
+    }
+    file.read(reinterpret_cast<char*>(&m_header), sizeof(m_header));
+    PointOctreeHeader expected;
+    if (!file || std::memcmp(m_header.magic, expected.magic, sizeof(expected.magic)) != 0 ||
+        m_header.version != expected.version) {
+        throw std::runtime_error("Not a point octree: " + m_path);
+    }
+    m_nodes.resize(m_header.num_nodes);
+    file.seekg(std::streamoff(m_header.node_offset));
+    file.read(reinterpret_cast<char*>(m_nodes.data()), std::streamsize(m_nodes.size() * sizeof(PointOctreeNode)));
+    if (!file) {
+        throw std::runtime_error("Failed to read point octree: " + m_path);
+    }
+}
+
+void PointOctree::read_points(std::ifstream& file, size_t i, std::vector<PointSprite>& points) const {
+    const PointOctreeNode& node = m_nodes[i];
+    points.resize(node.num_points);
+    file.seekg(std::streamoff(sizeof(PointOctreeHeader) + node.first_point * sizeof(PointSprite)));
+    file.read(reinterpret_cast<char*>(points.data()), std::streamsize(points.size() * sizeof(PointSprite)));
+    if (!file) {
+        throw std::runtime_error("Failed to read point octree: " + m_path);
+    }
+}
+
+} // namespace rr
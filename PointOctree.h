@@ -0,0 +1,91 @@
+#pragma once
+
+#include "PointSprites.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rr {
+
+// On-disk level of detail hierarchy of a point cloud, similar to Potree. Every node is a cube
+// that holds a subsample of the points inside it (one per cell of a grid_size^3 grid), the
+// points that were not selected are passed on to the children. Drawing a node and any subset
+// of its descendants therefore never draws a point twice. The points of a node are stored as
+// contiguous PointSprite records that can be uploaded to the GPU as they are.
+//
+// File layout: PointOctreeHeader, the point records of all nodes, the node table.
+struct PointOctreeHeader {
+    char      magic[8]    = {'R', 'R', 'O', 'C', 'T', 'R', 'E', 'E'};
+    uint32_t  version     = 1;
+    uint32_t  num_nodes   = 0;
+    uint64_t  num_points  = 0;
+    uint64_t  node_offset = 0; // byte offset of the node table
+    glm::vec3 lower       = glm::vec3(0.0f);
+    float     size        = 0.0f;
+};
+
+struct PointOctreeNode {
+    glm::vec3 lower;
+    float     size;
+    uint64_t  first_point = 0; // index of the first record in the file
+    uint32_t  num_points  = 0;
+    // the children are stored contiguously, in the order of the bits set in child_mask
+    uint32_t first_child = 0;
+    uint32_t child_mask  = 0;
+    uint32_t level       = 0;
+};
+
+static_assert(sizeof(PointOctreeHeader) == 48);
+static_assert(sizeof(PointOctreeNode) == 40);
+
+struct PointOctreeBuildOptions {
+    // nodes with more points are split
+    uint32_t max_leaf_points = 50000;
+    // resolution of the subsampling grid of inner nodes
+    uint32_t grid_size = 128;
+    // sprite radius relative to the grid spacing of the node
+    float radius_scale = 0.75f;
+    // used when the input has no colors
+    glm::vec3 color = glm::vec3(0.45f, 0.55f, 0.60f);
+};
+
+// Builds the octree of a point cloud without holding it in memory, the points are distributed
+// through temporary files next to the output. The input is either a PLY file with vertex
+// x, y, z and optional red, green, blue properties (ascii or binary little endian) or a raw
+// file of float x, y, z triples. Throws std::runtime_error if a file cannot be read or written.
+void build_point_octree(std::string_view input_path, std::string_view octree_path,
+                        const PointOctreeBuildOptions& options = {});
+
+// Reads the header and the node table, the points are read on demand
+class PointOctree {
+public:
+    explicit PointOctree(std::string_view path);
+
+    const PointOctreeHeader& header() const {
+        return m_header;
+    }
+
+    const std::vector<PointOctreeNode>& nodes() const {
+        return m_nodes;
+    }
+
+    const std::string& path() const {
+        return m_path;
+    }
+
+    // Reads the points of node i with the given stream, which has to be opened on path() in
+    // binary mode. Every loader thread uses its own stream.
+    void read_points(std::ifstream& file, size_t i, std::vector<PointSprite>& points) const;
+
+private:
+    std::string                  m_path;
+    PointOctreeHeader            m_header;
+    std::vector<PointOctreeNode> m_nodes;
+};
+
+} // namespace rr
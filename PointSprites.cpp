@@ -0,0 +1,262 @@
+#include "PointSprites.h"
+
+#include "PipelineCache.h"
+#include "Renderer.h"
+#include "ShaderCode.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <string>
+
+namespace rr {
+
+// 80 MB per buffer, well below the default limit of 256 MB
+constexpr size_t points_per_buffer = size_t(1) << 22;
+
+const char* pointSpriteShaderCode = R"(
+struct VertexInput {
+    @builtin(vertex_index) vertex_index: u32,
+    @location(0) position: vec3f,
+    @location(1) radius: vec2f,
+    @location(2) color: vec4f,
+}
+
+struct VertexOutput {
+    @builtin(position) position: vec4f,
+    @location(0) quad_pos: vec3f,
+    @location(1) @interpolate(flat) center: vec3f,
+    @location(2) @interpolate(flat) radius: f32,
+    @location(3) @interpolate(flat) color: vec4f,
+}
+
+struct FragmentOutput {
+    @location(0) color: vec4f,
+    @builtin(frag_depth) depth: f32,
+}
+
+struct Camera {
+    projection_matrix: mat4x4f,
+    view_matrix: mat4x4f,
+}
+
+@group(0) @binding(0)
+var<uniform> camera: Camera;
+
+// The quad lies in the plane through the sphere center that faces the eye. Every ray that
+// touches the sphere crosses this plane inside the circle where the tangent cone meets it,
+// the quad is the square around that circle.
+@vertex
+fn vs_main(input: VertexInput) -> VertexOutput {
+    var output: VertexOutput;
+
+    let center = (camera.view_matrix * vec4f(input.position, 1.0)).xyz;
+    let r = input.radius.x;
+    let l = length(center);
+    if (l <= r) {
+        // the eye is inside the sphere
+        output.position = vec4f(0.0, 0.0, 2.0, 1.0);
+        return output;
+    }
+
+    let axis = center / l;
+    let hint = select(vec3f(0.0, 1.0, 0.0), vec3f(1.0, 0.0, 0.0), abs(axis.y) > 0.99);
+    let right = normalize(cross(hint, axis));
+    let up = cross(axis, right);
+    let size = r * l / sqrt(l * l - r * r);
+
+    // triangle strip (-1, -1), (1, -1), (-1, 1), (1, 1)
+    let corner = vec2f(f32(input.vertex_index & 1u), f32(input.vertex_index >> 1u)) * 2.0 - 1.0;
+    let quad_pos = center + (corner.x * right + corner.y * up) * size;
+
+    output.position = camera.projection_matrix * vec4f(quad_pos, 1.0);
+    output.quad_pos = quad_pos;
+    output.center = center;
+    output.radius = r;
+    output.color = input.color;
+    return output;
+}
+
+@fragment
+fn fs_main(input: VertexOutput) -> FragmentOutput {
+    var output: FragmentOutput;
+
+    // Ray from the eye through the fragment, the distance of the center to the ray is computed
+    // directly to avoid the cancellation in b * b - c * c for small spheres
+    let dir = normalize(input.quad_pos);
+    let b = dot(dir, input.center);
+    let q = input.center - b * dir;
+    let disc = input.radius * input.radius - dot(q, q);
+    if (disc < 0.0) {
+        discard;
+    }
+    let view_pos = (b - sqrt(disc)) * dir;
+    let normal = (view_pos - input.center) / input.radius;
+
+    let clip = camera.projection_matrix * vec4f(view_pos, 1.0);
+    output.depth = clip.z / clip.w;
+
+    let view_dir = normalize(-view_pos);
+    let result = apply_lights(normal, view_pos, view_dir, input.color.rgb);
+    output.color = vec4f(result, input.color.a);
+    return output;
+}
+)";
+
+static uint32_t pack_radius(float radius) {
+    return glm::packHalf2x16(glm::vec2(radius, 0.0f));
+}
+
+static uint32_t pack_color(const glm::vec3& color) {
+    return glm::packUnorm4x8(glm::vec4(color, 1.0f));
+}
+
+WGPURenderPipeline point_sprite_pipeline(const Renderer& renderer) {
+    std::array<WGPUVertexAttribute, 3> attributes = {};
+    attributes[0].shaderLocation                  = 0;
+    attributes[0].format                          = WGPUVertexFormat_Float32x3;
+    attributes[0].offset                          = offsetof(PointSprite, position);
+    attributes[1].shaderLocation                  = 1;
+    attributes[1].format                          = WGPUVertexFormat_Float16x2;
+    attributes[1].offset                          = offsetof(PointSprite, radius);
+    attributes[2].shaderLocation                  = 2;
+    attributes[2].format                          = WGPUVertexFormat_Unorm8x4;
+    attributes[2].offset                          = offsetof(PointSprite, color);
+
+    // One record per quad, the corners come from the vertex index
+    WGPUVertexBufferLayout point_buffer_layout = {};
+    point_buffer_layout.attributeCount         = attributes.size();
+    point_buffer_layout.attributes             = attributes.data();
+    point_buffer_layout.arrayStride            = sizeof(PointSprite);
+    point_buffer_layout.stepMode               = WGPUVertexStepMode_Instance;
+
+    static const std::string source = std::string(lightingShaderCode) + pointSpriteShaderCode;
+
+    RenderPipelineDescription pipeline_desc;
+    pipeline_desc.shader_source  = source;
+    pipeline_desc.vertex_buffers = {point_buffer_layout};
+    pipeline_desc.bind_groups    = {{Renderer::camera_layout_entry()}};
+    pipeline_desc.topology       = WGPUPrimitiveTopology_TriangleStrip;
+    pipeline_desc.cull_mode      = WGPUCullMode_None;
+
+    pipeline_desc.blend.color.srcFactor = WGPUBlendFactor_SrcAlpha;
+    pipeline_desc.blend.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    pipeline_desc.blend.color.operation = WGPUBlendOperation_Add;
+    pipeline_desc.blend.alpha.srcFactor = WGPUBlendFactor_Zero;
+    pipeline_desc.blend.alpha.dstFactor = WGPUBlendFactor_One;
+    pipeline_desc.blend.alpha.operation = WGPUBlendOperation_Add;
+
+    pipeline_desc.color_format = renderer.m_swap_chain_format;
+    pipeline_desc.depth_format = renderer.m_depth_texture_format;
+
+    return renderer.m_pipeline_cache->get(pipeline_desc).pipeline;
+}
+
+PointSprites::PointSprites(const std::vector<glm::vec3>& positions, float radius, const glm::vec3& color,
+                           const Renderer& renderer)
+    : m_renderer(&renderer) {
+    m_points.resize(positions.size());
+    PointSprite point{glm::vec3(0.0f), pack_radius(radius), pack_color(color)};
+    for (size_t i = 0; i < positions.size(); ++i) {
+        point.position = positions[i];
+        m_points[i]    = point;
+    }
+    configure_render_pipeline();
+}
+
+PointSprites::~PointSprites() {
+    release();
+}
+
+void PointSprites::release() {
+    for (WGPUBuffer buffer : m_buffers) {
+        wgpuBufferDestroy(buffer);
+        wgpuBufferRelease(buffer);
+    }
+    m_buffers.clear();
+    // the pipeline belongs to the pipeline cache
+    m_pipeline = nullptr;
+}
+
+void PointSprites::configure_render_pipeline() {
+    release();
+    const Renderer& renderer = *m_renderer;
+
+    for (size_t first = 0; first < m_points.size(); first += points_per_buffer) {
+        size_t               count = std::min(points_per_buffer, m_points.size() - first);
+        WGPUBufferDescriptor desc  = {};
+        desc.size                  = count * sizeof(PointSprite);
+        desc.usage                 = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex;
+        desc.mappedAtCreation      = false;
+        m_buffers.push_back(wgpuDeviceCreateBuffer(renderer.m_device, &desc));
+    }
+    m_dirty = true;
+
+    m_pipeline = point_sprite_pipeline(renderer);
+}
+
+void PointSprites::upload() {
+    for (size_t b = 0; b < m_buffers.size(); ++b) {
+        size_t first = b * points_per_buffer;
+        size_t count = std::min(points_per_buffer, m_points.size() - first);
+        wgpuQueueWriteBuffer(m_renderer->m_queue, m_buffers[b], 0, &m_points[first], count * sizeof(PointSprite));
+    }
+    m_dirty = false;
+}
+
+void PointSprites::update() {
+    if (m_dirty && !m_points.empty()) {
+        upload();
+    }
+}
+
+void PointSprites::draw(RenderEncoder encoder) {
+    if (m_points.empty()) {
+        return;
+    }
+
+    encoder.set_pipeline(m_pipeline);
+    // Group 0 is the camera, bound by the renderer
+    for (size_t b = 0; b < m_buffers.size(); ++b) {
+        size_t count = std::min(points_per_buffer, m_points.size() - b * points_per_buffer);
+        encoder.set_vertex_buffer(0, m_buffers[b], 0, count * sizeof(PointSprite));
+        encoder.draw(4, uint32_t(count), 0, 0);
+    }
+}
+
+void PointSprites::set_radius(float radius) {
+    uint32_t packed = pack_radius(radius);
+    for (PointSprite& point : m_points) {
+        point.radius = packed;
+    }
+    m_dirty = true;
+}
+
+void PointSprites::set_radii(const std::vector<float>& radii) {
+    assert(radii.size() == m_points.size());
+    for (size_t i = 0; i < m_points.size(); ++i) {
+        m_points[i].radius = pack_radius(radii[i]);
+    }
+    m_dirty = true;
+}
+
+void PointSprites::set_color(const glm::vec3& color) {
+    uint32_t packed = pack_color(color);
+    for (PointSprite& point : m_points) {
+        point.color = packed;
+    }
+    m_dirty = true;
+}
+
+void PointSprites::set_colors(const std::vector<glm::vec3>& colors) {
+    assert(colors.size() == m_points.size());
+    for (size_t i = 0; i < m_points.size(); ++i) {
+        m_points[i].color = pack_color(colors[i]);
+    }
+    m_dirty = true;
+}
+
+} // namespace rr
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "RenderEncoder.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <webgpu/webgpu.h>
+
+namespace rr {
+
+class Renderer;
+
+// Compact per-point record, 20 bytes instead of the 80 of an InstanceData
+struct PointSprite {
+    glm::vec3 position;
+    uint32_t  radius; // half float in the low 16 bits
+    uint32_t  color;  // rgba8
+};
+
+static_assert(sizeof(PointSprite) == 20);
+
+// Draws one sprite per PointSprite record of vertex buffer 0 with Draw(4, count), owned by the
+// pipeline cache
+WGPURenderPipeline point_sprite_pipeline(const Renderer& renderer);
+
+// Points drawn as camera facing quads that the fragment shader turns into spheres by ray
+// casting (impostors). The fragment shader writes the depth of the sphere surface, so sprites
+// intersect correctly with each other and with meshes. A point costs 4 vertices instead of a
+// UV sphere instance.
+class PointSprites {
+public:
+    PointSprites(const std::vector<glm::vec3>& positions, float radius, const glm::vec3& color,
+                 const Renderer& renderer);
+    ~PointSprites();
+
+    PointSprites(const PointSprites&)            = delete;
+    PointSprites& operator=(const PointSprites&) = delete;
+
+    void release();
+
+    // Writes the points if they changed
+    void update();
+
+    void draw(RenderEncoder encoder);
+
+    void set_radius(float radius);
+
+    void set_radii(const std::vector<float>& radii);
+
+    void set_color(const glm::vec3& color);
+
+    void set_colors(const std::vector<glm::vec3>& colors);
+
+    size_t size() const {
+        return m_points.size();
+    }
+
+    size_t gpu_memory_bytes() const {
+        return m_points.size() * sizeof(PointSprite);
+    }
+
+private:
+    void configure_render_pipeline();
+
+    void upload();
+
+    const Renderer* m_renderer = nullptr;
+
+    std::vector<PointSprite> m_points;
+    bool                     m_dirty = true;
+
+    // Large clouds are split into several buffers to stay below the maximum buffer size
+    std::vector<WGPUBuffer> m_buffers;
+    WGPURenderPipeline      m_pipeline = nullptr;
+};
+
+} // namespace rr
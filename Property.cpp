@@ -6,6 +6,9 @@
 
 #include "glm/gtx/transform.hpp"
 
+#include <algorithm>
+#include <cassert>
+
 namespace rr {
 
 FaceVectorProperty::FaceVectorProperty(VisualMesh* vmesh, const std::vector<glm::vec3>& vectors) : m_vmesh(vmesh) {
@@ -141,6 +144,20 @@ void FaceVectorProperty::initialize_arrows(const std::vector<glm::vec3>& vectors
     m_instance_data_dirty = true;
 }
 
+void FaceVectorProperty::update_face_centers() {
+    const Mesh& mesh = m_vmesh->m_mesh;
+    for (size_t i = 0; i < m_face_centers.size(); ++i) {
+        const auto& f = mesh.position_faces[i];
+        glm::vec3   center(0.0f);
+        for (uint32_t v : f) {
+            center += mesh.positions[v];
+        }
+        m_face_centers[i] = center / float(f.size());
+        m_rigid[i][3]     = glm::vec4(m_face_centers[i], 1.0f);
+    }
+    m_instance_data_dirty = true;
+}
+
 void FaceVectorProperty::update_instance_data() {
     // Get the parent mesh's transform
     const glm::mat4& mesh_transform = *m_vmesh->get_transform();
@@ -164,20 +181,25 @@ void FaceVectorProperty::update_instance_data() {
     m_arrows->set_instance_data(m_transforms, m_color);
 }
 
-void FaceVectorProperty::draw(WGPURenderPassEncoder pass) {
-    if (!m_is_enabled) {
-        return;
-    }
-    if (m_instance_data_dirty) {
+void FaceVectorProperty::update() {
+    if (m_is_enabled && m_instance_data_dirty) {
         update_instance_data();
         m_arrows->upload_instance_data();
         m_instance_data_dirty = false;
     }
-    m_arrows->draw(pass);
 }
 
-void FaceVectorProperty::on_camera_update() {
-    m_arrows->on_camera_update();
+void FaceVectorProperty::draw(RenderEncoder encoder) {
+    if (m_is_enabled) {
+        m_arrows->draw(encoder);
+    }
+}
+
+void FaceVectorProperty::set_enabled(bool enabled) {
+    if (enabled != m_is_enabled) {
+        m_vmesh->invalidate_commands();
+    }
+    m_is_enabled = enabled;
 }
 
 void FaceVectorProperty::set_color(const glm::vec3& color) {
@@ -198,9 +220,72 @@ void FaceVectorProperty::set_length(float length) {
 FaceColorProperty::FaceColorProperty(VisualMesh* vmesh, const std::vector<glm::vec3>& colors)
     : m_vmesh(vmesh), m_colors(colors) {}
 
+FaceColorProperty::~FaceColorProperty() {
+    release();
+}
+
+void FaceColorProperty::release() {
+    if (m_buffer == nullptr) {
+        return;
+    }
+    wgpuBindGroupRelease(m_bind_group);
+    wgpuBufferDestroy(m_buffer);
+    wgpuBufferRelease(m_buffer);
+    m_bind_group = nullptr;
+    m_buffer     = nullptr;
+}
+
 void FaceColorProperty::set_colors(const std::vector<glm::vec3>& colors) {
+    // the storage buffer is created for one color per face and written in place
+    assert(colors.size() == m_colors.size());
     m_colors = colors;
-    m_vmesh->update_face_colors("");
+    m_dirty_faces.add(0, m_colors.size());
+}
+
+void FaceColorProperty::set_colors(size_t first_face, const std::vector<glm::vec3>& colors) {
+    assert(first_face + colors.size() <= m_colors.size());
+    std::copy(colors.begin(), colors.end(), m_colors.begin() + first_face);
+    m_dirty_faces.add(first_face, first_face + colors.size());
+}
+
+void FaceColorProperty::set_color(size_t face, const glm::vec3& color) {
+    m_colors[face] = color;
+    m_dirty_faces.add(face);
+}
+
+ScalarProperty::ScalarProperty(VisualMesh* vmesh, ScalarLocation location, const std::vector<float>& values)
+    : m_vmesh(vmesh), m_location(location) {
+    set_values(values);
+    m_range = m_data_range;
+}
+
+ScalarProperty::~ScalarProperty() {
+    release();
+}
+
+void ScalarProperty::release() {
+    if (m_buffer == nullptr) {
+        return;
+    }
+    wgpuBindGroupRelease(m_bind_group);
+    wgpuTextureViewRelease(m_colormap_view);
+    wgpuTextureDestroy(m_colormap_tex);
+    wgpuTextureRelease(m_colormap_tex);
+    wgpuBufferDestroy(m_buffer);
+    wgpuBufferRelease(m_buffer);
+    m_bind_group    = nullptr;
+    m_colormap_view = nullptr;
+    m_colormap_tex  = nullptr;
+    m_buffer        = nullptr;
+}
+
+void ScalarProperty::set_values(const std::vector<float>& values) {
+    m_values = values;
+    if (!m_values.empty()) {
+        auto [min, max] = std::minmax_element(m_values.begin(), m_values.end());
+        m_data_range    = glm::vec2(*min, *max);
+    }
+    m_values_dirty = true;
 }
 
 } // namespace rr
\ No newline at end of file
@@ -1,5 +1,9 @@
 #pragma once
 
+#include "Colormap.h"
+#include "DirtyRanges.h"
+#include "RenderEncoder.h"
+
 #include "glm/glm.hpp"
 #include <memory>
 #include <vector>
@@ -9,15 +13,15 @@ namespace rr {
 
 class VisualMesh;
 class InstancedMesh;
-struct VisualMeshVertexAttributes;
 
 class FaceVectorProperty {
 public:
     explicit FaceVectorProperty(VisualMesh* vmesh, const std::vector<glm::vec3>& vs);
 
-    void draw(WGPURenderPassEncoder);
+    // Rebuilds and writes the arrow instances if they changed
+    void update();
 
-    void on_camera_update();
+    void draw(RenderEncoder encoder);
 
     void set_color(const glm::vec3& color);
 
@@ -27,13 +31,14 @@ public:
 
     void initialize_arrows(const std::vector<glm::vec3>& vectors);
 
+    // Moves the arrows to the face centers after the mesh positions changed
+    void update_face_centers();
+
     bool is_enabled() const {
         return m_is_enabled;
     }
 
-    void set_enabled(bool enabled) {
-        m_is_enabled = enabled;
-    }
+    void set_enabled(bool enabled);
 
     glm::vec3 m_color = glm::vec3(0.882, 0.902, 0.376);
     // Note that radius and length are not absolute but with respect to m_scale.
@@ -57,12 +62,24 @@ public:
     bool        m_is_enabled = false;
 };
 
+// Per face colors of a VisualMesh. The colors are uploaded to a storage buffer owned by the
+// property the first time it is enabled, after that only the changed faces are uploaded.
 class FaceColorProperty {
 public:
     explicit FaceColorProperty(VisualMesh* vmesh, const std::vector<glm::vec3>& colors);
+    ~FaceColorProperty();
+
+    FaceColorProperty(const FaceColorProperty&)            = delete;
+    FaceColorProperty& operator=(const FaceColorProperty&) = delete;
 
+    // One color per face, like the colors the property was created with
     void set_colors(const std::vector<glm::vec3>& colors);
 
+    // Replaces the colors of faces [first_face, first_face + colors.size())
+    void set_colors(size_t first_face, const std::vector<glm::vec3>& colors);
+
+    void set_color(size_t face, const glm::vec3& color);
+
     bool is_enabled() const {
         return m_is_enabled;
     }
@@ -76,10 +93,94 @@ public:
     }
 
 private:
+    friend class VisualMesh;
+
+    void release();
+
     VisualMesh* m_vmesh      = nullptr;
     bool        m_is_enabled = false;
 
     std::vector<glm::vec3> m_colors;
+
+    // GPU resources, created by the mesh
+    WGPUBuffer    m_buffer     = nullptr;
+    WGPUBindGroup m_bind_group = nullptr;
+    DirtyRanges   m_dirty_faces;
+};
+
+enum class ScalarLocation { Vertex, Face };
+
+// One float per mesh vertex or face, mapped to colors in the fragment shader. The values are
+// uploaded once, changing the range or the colormap does not touch them.
+class ScalarProperty {
+public:
+    ScalarProperty(VisualMesh* vmesh, ScalarLocation location, const std::vector<float>& values);
+    ~ScalarProperty();
+
+    ScalarProperty(const ScalarProperty&)            = delete;
+    ScalarProperty& operator=(const ScalarProperty&) = delete;
+
+    void set_values(const std::vector<float>& values);
+
+    // Values outside of [min, max] are clamped to the ends of the colormap
+    void set_range(float min, float max) {
+        m_range = glm::vec2(min, max);
+    }
+
+    void set_colormap(Colormap colormap) {
+        m_colormap_dirty |= colormap != m_colormap;
+        m_colormap = colormap;
+    }
+
+    bool is_enabled() const {
+        return m_is_enabled;
+    }
+
+    void set_enabled(bool enabled) {
+        m_is_enabled = enabled;
+    }
+
+    ScalarLocation location() const {
+        return m_location;
+    }
+
+    const std::vector<float>& get_values() const {
+        return m_values;
+    }
+
+    glm::vec2 range() const {
+        return m_range;
+    }
+
+    // Smallest and largest value
+    glm::vec2 data_range() const {
+        return m_data_range;
+    }
+
+    Colormap colormap() const {
+        return m_colormap;
+    }
+
+private:
+    friend class VisualMesh;
+
+    void release();
+
+    VisualMesh*        m_vmesh = nullptr;
+    ScalarLocation     m_location;
+    bool               m_is_enabled = false;
+    std::vector<float> m_values;
+    glm::vec2          m_data_range = glm::vec2(0.0f, 1.0f);
+    glm::vec2          m_range      = glm::vec2(0.0f, 1.0f);
+    Colormap           m_colormap   = Colormap::Viridis;
+
+    // GPU resources, created by the mesh
+    WGPUBuffer      m_buffer         = nullptr;
+    WGPUTexture     m_colormap_tex   = nullptr;
+    WGPUTextureView m_colormap_view  = nullptr;
+    WGPUBindGroup   m_bind_group     = nullptr;
+    bool            m_values_dirty   = true;
+    bool            m_colormap_dirty = true;
 };
 
 } // namespace rr
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <webgpu/webgpu.h>
+
+#include <cstdint>
+
+namespace rr {
+
+// The draw commands of a render pass or of a render bundle, so drawables can encode into both.
+// Bundles start without any state, the renderer binds the camera group before the drawables
+// record into them.
+class RenderEncoder {
+public:
+    RenderEncoder(WGPURenderPassEncoder pass) : m_pass(pass) {}
+
+    RenderEncoder(WGPURenderBundleEncoder bundle) : m_bundle(bundle) {}
+
+    void set_pipeline(WGPURenderPipeline pipeline) {
+        if (m_pass) {
+            wgpuRenderPassEncoderSetPipeline(m_pass, pipeline);
+        } else {
+            wgpuRenderBundleEncoderSetPipeline(m_bundle, pipeline);
+        }
+    }
+
+    void set_bind_group(uint32_t index, WGPUBindGroup group) {
+        if (m_pass) {
+            wgpuRenderPassEncoderSetBindGroup(m_pass, index, group, 0, nullptr);
+        } else {
+            wgpuRenderBundleEncoderSetBindGroup(m_bundle, index, group, 0, nullptr);
+        }
+    }
+
+    void set_vertex_buffer(uint32_t slot, WGPUBuffer buffer, uint64_t offset, uint64_t size) {
+        if (m_pass) {
+            wgpuRenderPassEncoderSetVertexBuffer(m_pass, slot, buffer, offset, size);
+        } else {
+            wgpuRenderBundleEncoderSetVertexBuffer(m_bundle, slot, buffer, offset, size);
+        }
+    }
+
+    void draw(uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance) {
+        if (m_pass) {
+            wgpuRenderPassEncoderDraw(m_pass, vertex_count, instance_count, first_vertex, first_instance);
+        } else {
+            wgpuRenderBundleEncoderDraw(m_bundle, vertex_count, instance_count, first_vertex, first_instance);
+        }
+    }
+
+    void draw_indirect(WGPUBuffer buffer, uint64_t offset) {
+        if (m_pass) {
+            wgpuRenderPassEncoderDrawIndirect(m_pass, buffer, offset);
+        } else {
+            wgpuRenderBundleEncoderDrawIndirect(m_bundle, buffer, offset);
+        }
+    }
+
+private:
+    WGPURenderPassEncoder   m_pass   = nullptr;
+    WGPURenderBundleEncoder m_bundle = nullptr;
+};
+
+} // namespace rr
@@ -1,7 +1,12 @@
 // contains all the unser interface funtions for the renderrex library
 
 #include "RenderRex.h"
+#include "BinaryMesh.h"
 #include "Renderer.h"
+#include "Utils.h"
+
+#include <cassert>
+#include <filesystem>
 
 namespace rr {
 
@@ -32,6 +37,23 @@ VisualMesh* make_visual(std::string name, const Mesh& mesh) {
     return drawable;
 }
 
+VisualMesh* load_visual(std::string name, std::string_view path) {
+    std::optional<BinaryMeshFile> cache = open_mesh_cache(path);
+    if (!cache) {
+        return make_visual(name, load_mesh(path));
+    }
+    Mesh mesh = cache->mesh();
+    if (!cache->has_layout()) {
+        return make_visual(name, mesh);
+    }
+    if (mesh.normal_faces.empty()) {
+        // the cached layout was created with the same flat normals
+        set_flat_normals(mesh);
+    }
+    Renderer& renderer = Renderer::get();
+    return renderer.register_mesh(name, std::make_unique<VisualMesh>(std::move(mesh), cache->layout(), renderer));
+}
+
 VisualPointCloud* make_visual(std::string name, const std::vector<glm::vec3>& pos) {
     Renderer& renderer = Renderer::get();
 
@@ -47,6 +69,17 @@ VisualLineNetwork* make_visual(std::string name, const std::vector<glm::vec3>& p
     return drawable;
 }
 
+VisualPointOctree* make_point_octree(std::string name, std::string_view path) {
+    Renderer& renderer = Renderer::get();
+
+    std::string octree_path = std::string(path) + ".rroct";
+    if (!std::filesystem::exists(octree_path) ||
+        std::filesystem::last_write_time(octree_path) < std::filesystem::last_write_time(path)) {
+        build_point_octree(path, octree_path);
+    }
+    return renderer.register_point_octree(name, std::make_unique<VisualPointOctree>(octree_path, renderer));
+}
+
 /*InstancedMesh* make_instanced(std::string name, const Mesh& mesh, size_t num_instances) {
     Renderer& renderer = Renderer::get();
     assert(!mesh.normal_faces.empty());
@@ -67,4 +100,52 @@ void set_user_callback(std::function<void()> callback) {
     renderer.set_user_callback(callback);
 }
 
+void set_on_demand_rendering(bool enabled, double timeout_seconds) {
+    Renderer::get().set_on_demand_rendering(enabled, timeout_seconds);
+}
+
+void set_animating(bool animating) {
+    Renderer::get().set_animating(animating);
+}
+
+void request_redraw() {
+    Renderer::get().request_redraw();
+}
+
+uint64_t frame_count() {
+    return Renderer::get().frame_count();
+}
+
+void set_render_bundles(bool enabled) {
+    Renderer::get().set_render_bundles(enabled);
+}
+
+void set_parallel_encoding(bool enabled) {
+    Renderer::get().set_parallel_encoding(enabled);
+}
+
+void init_headless(uint32_t width, uint32_t height, bool software_adapter) {
+    RendererOptions options;
+    options.headless         = true;
+    options.software_adapter = software_adapter;
+    options.width            = width;
+    options.height           = height;
+    Renderer::set_options(options);
+    Renderer::get();
+}
+
+Image render_to_image(const Camera& camera) {
+    return Renderer::get().render_to_image(camera);
+}
+
+size_t render_to_files(const std::vector<Camera>& cameras, const std::vector<std::string>& paths) {
+    assert(cameras.size() == paths.size());
+    ImageWriter writer;
+    Renderer::get().render_images(cameras, [&](size_t index, Image&& image) {
+        writer.push(paths[index], std::move(image), image_format_from_path(paths[index]));
+    });
+    writer.wait();
+    return cameras.size() - writer.num_written();
+}
+
 } // namespace rr
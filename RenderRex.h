@@ -1,17 +1,21 @@
 // contains all the unser interface funtions for the renderrex library
 #pragma once
 
+#include "Camera.h"
 #include "Drawable.h"
+#include "ImageReadback.h"
 #include "InstancedMesh.h"
 #include "Mesh.h"
 #include "Primitives.h"
 #include "VisualMesh.h"
+#include "VisualPointOctree.h"
 
 #include "glm/glm.hpp"
 
 #include <array>
 #include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace rr {
@@ -23,13 +27,58 @@ VisualMesh* make_visual(std::string name, std::vector<glm::vec3>& positions,
 
 VisualMesh* make_visual(std::string name, const Mesh& mesh);
 
+// Loads an OBJ file through its binary cache <path>.rrmesh, see load_mesh_cached. Once the
+// cache exists the OBJ is not parsed and the vertex buffers are written straight from the
+// mapped cache.
+VisualMesh* load_visual(std::string name, std::string_view path);
+
 VisualPointCloud* make_visual(std::string name, const std::vector<glm::vec3>& pos);
 
 VisualLineNetwork* make_visual(std::string name, const std::vector<glm::vec3>& pos,
                                const std::vector<std::pair<int, int>>& lines);
 
+// Streams a point cloud that does not fit into memory, see VisualPointOctree. The octree is
+// built next to the input (PLY or raw float x, y, z) as <path>.rroct on first use and rebuilt
+// when the input is newer. Throws std::runtime_error if a file cannot be read or written.
+VisualPointOctree* make_point_octree(std::string name, std::string_view path);
+
 InstancedMesh* make_instanced(std::string name, const Mesh& mesh, size_t num_instances);
 
 void set_user_callback(std::function<void()> callback);
 
+// Only redraws when the camera, the GUI or a drawable changed instead of every frame, see
+// Renderer::set_on_demand_rendering. The user callback still runs at least every timeout_seconds.
+void set_on_demand_rendering(bool enabled, double timeout_seconds = 0.1);
+
+// Draws every frame in on-demand mode while set, e.g. during an animation
+void set_animating(bool animating);
+
+// Draws the next frame in on-demand mode, for changes the drawables cannot detect
+void request_redraw();
+
+// Number of frames drawn so far
+uint64_t frame_count();
+
+// Records static drawables into render bundles that are replayed every frame, which lowers the
+// per-frame CPU cost of scenes with many drawables
+void set_render_bundles(bool enabled);
+
+// Updates the drawables and records their draws on worker threads, for scenes with many
+// drawables. Only available when the device supports implicit synchronization.
+void set_parallel_encoding(bool enabled);
+
+// Renders into an offscreen texture instead of a window, e.g. on a server. Has to be called
+// before any other function. software_adapter selects the fallback adapter, which is Dawn's
+// CPU rasterizer when there is no GPU. show() returns immediately in this mode.
+void init_headless(uint32_t width, uint32_t height, bool software_adapter = false);
+
+// Headless mode only: renders the scene as seen from camera and reads it back
+Image render_to_image(const Camera& camera);
+
+// Headless mode only: renders one image per camera and writes it to the path with the same
+// index, as PNG if the path ends in .png and as raw RGBA otherwise. Rendering, readback and
+// writing overlap, the files are written on a background thread. Returns the number of images
+// that could not be written.
+size_t render_to_files(const std::vector<Camera>& cameras, const std::vector<std::string>& paths);
+
 } // namespace rr
@@ -1,6 +1,10 @@
 #include "Renderer.h"
 #include "Drawable.h"
+#include "Parallel.h"
+#include "PipelineCache.h"
 #include "VisualMesh.h"
+#include "VisualPointOctree.h"
+#include "WorkerPool.h"
 
 #include "glfw3webgpu/glfw3webgpu.h"
 #include <GLFW/glfw3.h>
@@ -10,6 +14,7 @@
 #include <backends/imgui_impl_wgpu.h>
 #include <imgui.h>
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <iostream>
@@ -22,6 +27,9 @@
 
 namespace rr {
 
+// ImGui reacts to some input only in the frame after the event, e.g. hover highlights
+constexpr uint32_t event_redraw_frames = 2;
+
 WGPUStringView to_string_view(const char* str) {
     WGPUStringView view;
     view.data   = str;
@@ -33,6 +41,18 @@ std::string to_string(const WGPUStringView& view) {
     return std::string(view.data, view.length);
 }
 
+WGPUBuffer create_buffer(const Renderer& renderer, const void* data, size_t size, WGPUBufferUsage usage) {
+    WGPUBufferDescriptor buffer_desc = {};
+    buffer_desc.size                 = std::max<size_t>(16, (size + 3) & ~size_t(3));
+    buffer_desc.usage                = WGPUBufferUsage_CopyDst | usage;
+    buffer_desc.mappedAtCreation     = false;
+    WGPUBuffer buffer                = wgpuDeviceCreateBuffer(renderer.m_device, &buffer_desc);
+    if (data != nullptr && size > 0) {
+        wgpuQueueWriteBuffer(renderer.m_queue, buffer, 0, data, size);
+    }
+    return buffer;
+}
+
 WGPUAdapter request_adapter_sync(WGPUInstance instance, WGPURequestAdapterOptions const* options) {
     struct UserData {
         WGPUAdapter adapter       = nullptr;
@@ -145,19 +165,41 @@ void Renderer::terminate_gui() {
 
 Renderer::~Renderer() {
     // terminate GUI
-    terminate_gui();
+    if (!m_headless) {
+        terminate_gui();
+    }
 
     // release resources
+    release_bundles();
+    m_readback.reset();
+    if (m_color_texture) {
+        wgpuTextureViewRelease(m_color_texture_view);
+        wgpuTextureDestroy(m_color_texture);
+        wgpuTextureRelease(m_color_texture);
+    }
     wgpuTextureViewRelease(m_depth_texture_view);
+    wgpuBindGroupRelease(m_camera_bind_group);
+    wgpuBindGroupLayoutRelease(m_camera_layout);
+    wgpuBufferDestroy(m_camera_buffer);
+    wgpuBufferRelease(m_camera_buffer);
+    m_mesh_batch.reset();
+    // stops the loader threads
+    m_point_octrees.clear();
+    m_property_defaults.reset();
+    m_pipeline_cache.reset();
 
     wgpuQueueRelease(m_queue);
     wgpuDeviceRelease(m_device);
-    wgpuSurfaceUnconfigure(m_surface);
-    wgpuSurfaceRelease(m_surface);
+    if (m_surface) {
+        wgpuSurfaceUnconfigure(m_surface);
+        wgpuSurfaceRelease(m_surface);
+    }
     wgpuInstanceRelease(m_instance);
 
-    glfwDestroyWindow(m_window);
-    glfwTerminate();
+    if (m_window) {
+        glfwDestroyWindow(m_window);
+        glfwTerminate();
+    }
 }
 
 WGPURenderPassEncoder Renderer::create_render_pass(WGPUTextureView next_texture, WGPUCommandEncoder encoder) {
@@ -199,6 +241,249 @@ WGPURenderPassEncoder Renderer::create_render_pass(WGPUTextureView next_texture,
     return wgpuCommandEncoderBeginRenderPass(encoder, &render_pass_desc);
 }
 
+void Renderer::draw_drawables(WGPURenderPassEncoder render_pass) {
+    m_batched_meshes.clear();
+    m_frame_drawables.clear();
+    for (auto& mesh : m_meshes) {
+        // the batch reads the uniforms of its meshes itself
+        if (m_batch_meshes && mesh.second->is_batchable()) {
+            m_batched_meshes.push_back(mesh.second.get());
+        } else {
+            m_frame_drawables.push_back(mesh.second.get());
+        }
+    }
+    // the batch is drawn after the other meshes
+    size_t batch_position = m_frame_drawables.size();
+    for (auto& point_cloud : m_point_clouds) {
+        m_frame_drawables.push_back(point_cloud.second.get());
+    }
+    for (auto& line_network : m_line_networks) {
+        m_frame_drawables.push_back(line_network.second.get());
+    }
+    update_drawables(m_frame_drawables);
+    // octrees talk to their loader thread while updating, so they stay on the main thread
+    for (auto& point_octree : m_point_octrees) {
+        point_octree.second->update();
+        m_frame_drawables.push_back(point_octree.second.get());
+    }
+
+    // Consecutive drawables that are drawn the same way form a run. The runs are drawn in order,
+    // so bundles do not change the draw order that blending and equal depths depend on.
+    m_draw_runs.clear();
+    m_bundle_ranges.clear();
+    for (size_t i = 0; i < m_frame_drawables.size(); ++i) {
+        bool bundled = m_use_bundles && m_frame_drawables[i]->is_static();
+        if (m_draw_runs.empty() || m_draw_runs.back().bundled != bundled || i == batch_position) {
+            m_draw_runs.push_back({i, i, bundled});
+        }
+        m_draw_runs.back().end = i + 1;
+    }
+    for (DrawRun& run : m_draw_runs) {
+        if (!run.bundled) {
+            continue;
+        }
+        run.first_bundle = m_bundle_ranges.size();
+        for (size_t begin = run.begin; begin < run.end; begin += drawables_per_bundle) {
+            m_bundle_ranges.emplace_back(begin, std::min(begin + drawables_per_bundle, run.end));
+        }
+        run.num_bundles = m_bundle_ranges.size() - run.first_bundle;
+    }
+    record_bundles();
+
+    // The camera group is compatible with group 0 of every pipeline, so it stays bound while
+    // the drawables switch pipelines. Executing bundles clears it, so it is bound again afterwards.
+    bool camera_bound = false;
+    auto bind_camera  = [&]() {
+        if (!camera_bound) {
+            wgpuRenderPassEncoderSetBindGroup(render_pass, 0, m_camera_bind_group, 0, nullptr);
+            camera_bound = true;
+        }
+    };
+    bool batch_drawn = false;
+    auto draw_batch  = [&]() {
+        if (m_mesh_batch) {
+            bind_camera();
+            m_mesh_batch->set_meshes(m_batched_meshes);
+            m_mesh_batch->draw(render_pass);
+        }
+        batch_drawn = true;
+    };
+
+    for (const DrawRun& run : m_draw_runs) {
+        if (!batch_drawn && run.begin >= batch_position) {
+            draw_batch();
+        }
+        if (run.bundled) {
+            const WGPURenderBundle* bundles = m_bundle_handles.data() + run.first_bundle;
+            wgpuRenderPassEncoderExecuteBundles(render_pass, run.num_bundles, bundles);
+            camera_bound = false;
+        } else if (m_parallel_encoding && run.end - run.begin >= 2 * min_draws_per_job) {
+            draw_parallel(render_pass, m_frame_drawables.data() + run.begin, run.end - run.begin);
+            camera_bound = false;
+        } else {
+            bind_camera();
+            for (size_t i = run.begin; i < run.end; ++i) {
+                m_frame_drawables[i]->draw(render_pass);
+            }
+        }
+    }
+    if (!batch_drawn) {
+        draw_batch();
+    }
+}
+
+void Renderer::update_drawables(const std::vector<Drawable*>& drawables) {
+    if (!m_parallel_encoding) {
+        for (Drawable* drawable : drawables) {
+            drawable->update();
+        }
+        return;
+    }
+    m_workers->for_ranges(drawables.size(), min_updates_per_job, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            drawables[i]->update();
+        }
+    });
+}
+
+void Renderer::draw_parallel(WGPURenderPassEncoder render_pass, Drawable* const* drawables, size_t count) {
+    size_t num_jobs = std::min(m_workers->num_threads(), (count + min_draws_per_job - 1) / min_draws_per_job);
+    size_t share    = (count + num_jobs - 1) / num_jobs;
+    m_frame_bundles.assign(num_jobs, nullptr);
+    m_workers->run(num_jobs, [&](size_t job) {
+        size_t first = std::min(job * share, count);
+        size_t last  = std::min(first + share, count);
+        if (first < last) {
+            m_frame_bundles[job] = record_bundle(drawables + first, last - first);
+        }
+    });
+
+    m_frame_bundles.erase(std::remove(m_frame_bundles.begin(), m_frame_bundles.end(), nullptr), m_frame_bundles.end());
+    wgpuRenderPassEncoderExecuteBundles(render_pass, m_frame_bundles.size(), m_frame_bundles.data());
+    // the pass keeps its own references
+    for (WGPURenderBundle bundle : m_frame_bundles) {
+        wgpuRenderBundleRelease(bundle);
+    }
+}
+
+WGPURenderBundle Renderer::record_bundle(Drawable* const* drawables, size_t count) const {
+    // stencilReadOnly matches the render pass, which has no stencil aspect
+    WGPURenderBundleEncoderDescriptor encoder_desc = {};
+    encoder_desc.label                             = to_string_view("Render bundle encoder");
+    encoder_desc.colorFormatCount                  = 1;
+    encoder_desc.colorFormats                      = &m_swap_chain_format;
+    encoder_desc.depthStencilFormat                = m_depth_texture_format;
+    encoder_desc.sampleCount                       = 1;
+    encoder_desc.depthReadOnly                     = false;
+    encoder_desc.stencilReadOnly                   = true;
+    WGPURenderBundleEncoder encoder                = wgpuDeviceCreateRenderBundleEncoder(m_device, &encoder_desc);
+
+    // bundles do not inherit the state of the pass
+    wgpuRenderBundleEncoderSetBindGroup(encoder, 0, m_camera_bind_group, 0, nullptr);
+    for (size_t i = 0; i < count; ++i) {
+        drawables[i]->draw(encoder);
+    }
+
+    WGPURenderBundleDescriptor bundle_desc = {};
+    bundle_desc.label                      = to_string_view("Render bundle");
+    WGPURenderBundle bundle                = wgpuRenderBundleEncoderFinish(encoder, &bundle_desc);
+    wgpuRenderBundleEncoderRelease(encoder);
+    return bundle;
+}
+
+void Renderer::record_bundles() {
+    size_t num_bundles = m_bundle_ranges.size();
+    for (size_t b = num_bundles; b < m_bundles.size(); ++b) {
+        wgpuRenderBundleRelease(m_bundles[b].bundle);
+    }
+    m_bundles.resize(num_bundles);
+    m_bundle_handles.resize(num_bundles);
+
+    std::vector<size_t> stale;
+    for (size_t b = 0; b < num_bundles; ++b) {
+        RenderBundle& bundle = m_bundles[b];
+        auto          first  = m_frame_drawables.begin() + m_bundle_ranges[b].first;
+        auto          last   = m_frame_drawables.begin() + m_bundle_ranges[b].second;
+
+        // a bundle is kept if it holds the same drawables with unchanged commands
+        bool valid = bundle.bundle && bundle.drawables.size() == size_t(last - first) &&
+                     std::equal(bundle.drawables.begin(), bundle.drawables.end(), first);
+        for (size_t i = 0; valid && i < bundle.drawables.size(); ++i) {
+            valid = bundle.versions[i] == bundle.drawables[i]->m_commands_version;
+        }
+
+        if (!valid) {
+            if (bundle.bundle) {
+                wgpuRenderBundleRelease(bundle.bundle);
+            }
+            bundle.drawables.assign(first, last);
+            bundle.versions.clear();
+            for (Drawable* drawable : bundle.drawables) {
+                bundle.versions.push_back(drawable->m_commands_version);
+            }
+            stale.push_back(b);
+        }
+    }
+
+    // the chunks are independent, so they are recorded on the workers with parallel encoding
+    auto record = [&](size_t i) {
+        RenderBundle& bundle = m_bundles[stale[i]];
+        bundle.bundle        = record_bundle(bundle.drawables.data(), bundle.drawables.size());
+    };
+    if (m_parallel_encoding) {
+        m_workers->run(stale.size(), record);
+    } else {
+        for (size_t i = 0; i < stale.size(); ++i) {
+            record(i);
+        }
+    }
+    m_bundles_recorded = stale.size();
+
+    for (size_t b = 0; b < num_bundles; ++b) {
+        m_bundle_handles[b] = m_bundles[b].bundle;
+    }
+}
+
+void Renderer::release_bundles() {
+    for (RenderBundle& bundle : m_bundles) {
+        wgpuRenderBundleRelease(bundle.bundle);
+    }
+    m_bundles.clear();
+}
+
+void Renderer::set_parallel_encoding(bool enabled) {
+    if (enabled && !m_device_thread_safe) {
+        std::cerr << "Parallel encoding needs a device with implicit synchronization, encoding stays on the "
+                     "main thread"
+                  << std::endl;
+        return;
+    }
+    if (enabled && !m_workers) {
+        m_workers = std::make_unique<WorkerPool>(num_worker_threads());
+    }
+    m_parallel_encoding = enabled;
+    request_redraw();
+}
+
+void Renderer::set_render_bundles(bool enabled) {
+    m_use_bundles = enabled;
+    if (!enabled) {
+        release_bundles();
+    }
+    request_redraw();
+}
+
+void Renderer::set_mesh_batching(bool enabled) {
+    m_batch_meshes = enabled;
+    if (enabled && !m_mesh_batch) {
+        m_mesh_batch = std::make_unique<VisualMeshBatch>(*this);
+    } else if (!enabled) {
+        m_mesh_batch.reset();
+    }
+    // the meshes move into or out of the batch with the next frame
+    request_redraw();
+}
+
 void Renderer::update_gui(WGPURenderPassEncoder render_pass) {
     // Start the Dear ImGui frame
     ImGui_ImplWGPU_NewFrame();
@@ -301,6 +586,60 @@ void Renderer::update_gui(WGPURenderPassEncoder render_pass) {
         }
     }
 
+    id = 0;
+    if (ImGui::CollapsingHeader("Point Octrees")) {
+        for (const auto& [name, point_octree] : m_point_octrees) {
+            ImGui::PushID(name.c_str());
+            ImGui::Text(name.c_str());
+            ImGui::SameLine();
+            if (ImGui::Checkbox("Points", &point_octree->m_visible)) {
+                point_octree->set_visible(point_octree->m_visible);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Options")) {
+                point_octree->m_show_options = !point_octree->m_show_options;
+            }
+            point_octree->update_ui(name);
+            ImGui::PopID();
+            if (id < m_point_octrees.size() - 1) {
+                ImGui::Separator();
+            }
+            ++id;
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Statistics")) {
+        ImGui::Text("Pipelines: %zu, cache hits: %zu, misses: %zu", m_pipeline_cache->num_pipelines(),
+                    m_pipeline_cache->hits(), m_pipeline_cache->misses());
+        bool batch_meshes = m_batch_meshes;
+        if (ImGui::Checkbox("Batch Meshes", &batch_meshes)) {
+            set_mesh_batching(batch_meshes);
+        }
+        if (m_mesh_batch) {
+            ImGui::Text("Batched meshes: %zu, triangles: %zu", m_mesh_batch->num_objects(),
+                        m_mesh_batch->num_triangles());
+        }
+        bool on_demand = m_on_demand;
+        if (ImGui::Checkbox("On-Demand Rendering", &on_demand)) {
+            set_on_demand_rendering(on_demand, m_wait_timeout);
+        }
+        ImGui::Text("Frames drawn: %zu, skipped: %zu", size_t(m_frame_count), size_t(m_skipped_frame_count));
+        ImGui::Text("Uniform uploads last frame: %zu", size_t(m_last_frame_uniform_uploads));
+        bool use_bundles = m_use_bundles;
+        if (ImGui::Checkbox("Render Bundles", &use_bundles)) {
+            set_render_bundles(use_bundles);
+        }
+        if (m_use_bundles) {
+            ImGui::Text("Render bundles: %zu, recorded last frame: %zu", m_bundles.size(), m_bundles_recorded);
+        }
+        if (m_device_thread_safe) {
+            bool parallel = m_parallel_encoding;
+            if (ImGui::Checkbox("Parallel Encoding", &parallel)) {
+                set_parallel_encoding(parallel);
+            }
+        }
+    }
+
     ImGui::End();
     ImGui::EndFrame();
     ImGui::Render();
@@ -308,7 +647,17 @@ void Renderer::update_gui(WGPURenderPassEncoder render_pass) {
 }
 
 void Renderer::update_frame() {
-    glfwPollEvents();
+    // there is no window to present to, see render_images
+    assert(!m_headless);
+    m_last_frame_uniform_uploads = m_uniform_uploads;
+    m_uniform_uploads            = 0;
+
+    if (m_on_demand && !m_animating && !redraw_pending()) {
+        glfwWaitEventsTimeout(m_wait_timeout);
+    } else {
+        glfwPollEvents();
+    }
+    apply_camera_input();
 
     // get framebuffersize from glfw
     int width, height;
@@ -317,6 +666,28 @@ void Renderer::update_frame() {
     if (m_user_callback) {
         m_user_callback();
     }
+
+    if (m_on_demand && !m_animating && !redraw_pending()) {
+        ++m_skipped_frame_count;
+        return;
+    }
+    // requests made while this frame is drawn are kept for the next one
+    if (m_pending_frames > 0) {
+        --m_pending_frames;
+    }
+    for (auto& mesh : m_meshes) {
+        mesh.second->m_redraw_requested = false;
+    }
+    for (auto& point_cloud : m_point_clouds) {
+        point_cloud.second->m_redraw_requested = false;
+    }
+    for (auto& line_network : m_line_networks) {
+        line_network.second->m_redraw_requested = false;
+    }
+    for (auto& point_octree : m_point_octrees) {
+        point_octree.second->m_redraw_requested = false;
+    }
+    ++m_frame_count;
     WGPUSurfaceTexture surface_texture;
     wgpuSurfaceGetCurrentTexture(m_surface, &surface_texture);
     WGPUTextureViewDescriptor view_desc = {};
@@ -341,16 +712,7 @@ void Renderer::update_frame() {
 
     WGPURenderPassEncoder render_pass = create_render_pass(next_texture, encoder);
 
-    // Draw all drawables
-    for (auto& mesh : m_meshes) {
-        mesh.second->draw(render_pass);
-    }
-    for (auto& point_cloud : m_point_clouds) {
-        point_cloud.second->draw(render_pass);
-    }
-    for (auto& line_network : m_line_networks) {
-        line_network.second->draw(render_pass);
-    }
+    draw_drawables(render_pass);
 
     // Update GUI and Guizmo manipulators
     update_gui(render_pass);
@@ -376,8 +738,55 @@ void Renderer::update_frame() {
 #endif
 }
 
+void Renderer::write_uniforms(WGPUBuffer buffer, const void* data, size_t size) const {
+    wgpuQueueWriteBuffer(m_queue, buffer, 0, data, size);
+    ++m_uniform_uploads;
+}
+
+void Renderer::set_on_demand_rendering(bool enabled, double timeout_seconds) {
+    m_on_demand    = enabled;
+    m_wait_timeout = timeout_seconds;
+    request_redraw();
+}
+
+void Renderer::set_animating(bool animating) {
+    m_animating = animating;
+    request_redraw();
+}
+
+void Renderer::request_redraw(uint32_t frames) {
+    m_pending_frames = std::max(m_pending_frames, frames);
+}
+
+bool Renderer::redraw_pending() const {
+    if (m_pending_frames > 0) {
+        return true;
+    }
+    for (auto& mesh : m_meshes) {
+        if (mesh.second->needs_redraw()) {
+            return true;
+        }
+    }
+    for (auto& point_cloud : m_point_clouds) {
+        if (point_cloud.second->needs_redraw()) {
+            return true;
+        }
+    }
+    for (auto& line_network : m_line_networks) {
+        if (line_network.second->needs_redraw()) {
+            return true;
+        }
+    }
+    for (auto& point_octree : m_point_octrees) {
+        if (point_octree.second->needs_redraw()) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool Renderer::should_close() {
-    return glfwWindowShouldClose(m_window);
+    return m_headless || glfwWindowShouldClose(m_window);
 }
 
 Renderer& Renderer::get() {
@@ -385,9 +794,66 @@ Renderer& Renderer::get() {
     return instance;
 }
 
+RendererOptions& Renderer::options() {
+    static RendererOptions options;
+    return options;
+}
+
+void Renderer::set_options(const RendererOptions& opts) {
+    options() = opts;
+}
+
+Image Renderer::render_to_image(const Camera& camera) {
+    Image image;
+    render_images({camera}, [&image](size_t, Image&& result) { image = std::move(result); });
+    return image;
+}
+
+void Renderer::render_images(const std::vector<Camera>& cameras, const ReadbackRing::Callback& on_image) {
+    assert(m_headless);
+    Camera camera = m_camera;
+
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        // queue writes are ordered with the submits, so this does not touch earlier frames
+        m_camera = cameras[i];
+        on_camera_update();
+
+        WGPUCommandEncoderDescriptor command_encoder_desc = {};
+        command_encoder_desc.label                        = to_string_view("Offscreen Command Encoder");
+        WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(m_device, &command_encoder_desc);
+
+        WGPURenderPassEncoder render_pass = create_render_pass(m_color_texture_view, encoder);
+        draw_drawables(render_pass);
+        wgpuRenderPassEncoderEnd(render_pass);
+        wgpuRenderPassEncoderRelease(render_pass);
+
+        // reads back frame i - num_readback_slots first if it is still in the buffer
+        m_readback->copy(encoder, m_color_texture, i, on_image);
+
+        WGPUCommandBufferDescriptor cmd_buffer_descriptor{};
+        cmd_buffer_descriptor.label = to_string_view("Offscreen command buffer");
+        WGPUCommandBuffer command   = wgpuCommandEncoderFinish(encoder, &cmd_buffer_descriptor);
+        wgpuCommandEncoderRelease(encoder);
+        wgpuQueueSubmit(m_queue, 1, &command);
+        wgpuCommandBufferRelease(command);
+
+        m_readback->map_last();
+    }
+    m_readback->finish(on_image);
+
+    m_camera = camera;
+    on_camera_update();
+}
+
 VisualMesh* Renderer::register_mesh(std::string_view name, std::unique_ptr<VisualMesh> mesh) {
+    // a replaced drawable is freed and its address may be reused
+    release_bundles();
     auto& slot = m_meshes[std::string(name)];
     slot       = std::move(mesh);
+    if (m_mesh_batch) {
+        // the replaced mesh may be in the batch
+        m_mesh_batch->invalidate();
+    }
 
     BoundingBox global_bb{};
     for (auto& p : m_meshes) {
@@ -406,6 +872,8 @@ VisualMesh* Renderer::register_mesh(std::string_view name, std::unique_ptr<Visua
 }
 
 VisualPointCloud* Renderer::register_point_cloud(std::string_view name, std::unique_ptr<VisualPointCloud> point_cloud) {
+    // a replaced drawable is freed and its address may be reused
+    release_bundles();
     auto& slot = m_point_clouds[std::string(name)];
     slot       = std::move(point_cloud);
 
@@ -427,6 +895,8 @@ VisualPointCloud* Renderer::register_point_cloud(std::string_view name, std::uni
 
 VisualLineNetwork* Renderer::register_line_network(std::string_view                   name,
                                                    std::unique_ptr<VisualLineNetwork> line_network) {
+    // a replaced drawable is freed and its address may be reused
+    release_bundles();
     auto& slot = m_line_networks[std::string(name)];
     slot       = std::move(line_network);
 
@@ -446,6 +916,17 @@ VisualLineNetwork* Renderer::register_line_network(std::string_view
     return slot.get();
 }
 
+VisualPointOctree* Renderer::register_point_octree(std::string_view                   name,
+                                                   std::unique_ptr<VisualPointOctree> point_octree) {
+    // a replaced drawable is freed and its address may be reused
+    release_bundles();
+    auto& slot = m_point_octrees[std::string(name)];
+    slot       = std::move(point_octree);
+    on_camera_update();
+
+    return slot.get();
+}
+
 void Renderer::set_user_callback(std::function<void()> callback) {
     m_user_callback = std::move(callback);
 }
@@ -475,6 +956,23 @@ void Renderer::initialize_depth_texture() { // Create the depth texture
     m_depth_texture_view                              = wgpuTextureCreateView(depth_texture, &depth_texture_view_desc);
 }
 
+void Renderer::initialize_offscreen_target() {
+    // RGBA so the read back rows can be written as they are
+    m_swap_chain_format                = WGPUTextureFormat_RGBA8Unorm;
+    WGPUTextureDescriptor texture_desc = {};
+    texture_desc.label                 = to_string_view("Offscreen color texture");
+    texture_desc.dimension             = WGPUTextureDimension_2D;
+    texture_desc.format                = m_swap_chain_format;
+    texture_desc.mipLevelCount         = 1;
+    texture_desc.sampleCount           = 1;
+    texture_desc.size                  = {m_width, m_height, 1};
+    texture_desc.usage                 = WGPUTextureUsage_RenderAttachment | WGPUTextureUsage_CopySrc;
+    m_color_texture                    = wgpuDeviceCreateTexture(m_device, &texture_desc);
+    m_color_texture_view               = wgpuTextureCreateView(m_color_texture, nullptr);
+
+    m_readback = std::make_unique<ReadbackRing>(m_device, m_instance, m_width, m_height, num_readback_slots);
+}
+
 void Renderer::initialize_window() {
     // initialize GLFW
     if (!glfwInit()) {
@@ -497,21 +995,55 @@ void Renderer::initialize_window() {
         renderer->resize(width, height);
     });
 
+    // Every input may change the GUI, so it draws frames in on-demand mode. ImGui installs its
+    // callbacks later and calls these ones from them.
+    glfwSetCursorEnterCallback(m_window, [](GLFWwindow* window, int) {
+        auto that = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
+        if (that != nullptr)
+            that->request_redraw(event_redraw_frames);
+    });
+    glfwSetKeyCallback(m_window, [](GLFWwindow* window, int, int, int, int) {
+        auto that = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
+        if (that != nullptr)
+            that->request_redraw(event_redraw_frames);
+    });
+    glfwSetCharCallback(m_window, [](GLFWwindow* window, unsigned int) {
+        auto that = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
+        if (that != nullptr)
+            that->request_redraw(event_redraw_frames);
+    });
+    glfwSetWindowFocusCallback(m_window, [](GLFWwindow* window, int) {
+        auto that = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
+        if (that != nullptr)
+            that->request_redraw(event_redraw_frames);
+    });
+    glfwSetWindowRefreshCallback(m_window, [](GLFWwindow* window) {
+        auto that = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
+        if (that != nullptr)
+            that->request_redraw();
+    });
+
     glfwSetWindowUserPointer(m_window, this);
     glfwSetCursorPosCallback(m_window, [](GLFWwindow* window, double xpos, double ypos) {
         auto that = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
-        if (that != nullptr)
+        if (that != nullptr) {
+            that->request_redraw(event_redraw_frames);
             that->on_mouse_move(xpos, ypos);
+        }
     });
     glfwSetMouseButtonCallback(m_window, [](GLFWwindow* window, int button, int action, int mods) {
         auto that = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
-        if (that != nullptr)
+        if (that != nullptr) {
+            that->request_redraw(event_redraw_frames);
             that->on_mouse_button(button, action, mods);
+        }
     });
     glfwSetScrollCallback(m_window, [](GLFWwindow* window, double xoffset, double yoffset) {
         auto that = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
-        if (that != nullptr)
+        if (that != nullptr) {
+            that->request_redraw(event_redraw_frames);
             that->on_scroll(xoffset, yoffset);
+        }
     });
 }
 
@@ -529,18 +1061,39 @@ void Renderer::initialize_device() {
         exit(EXIT_FAILURE);
     }
 
-    m_surface = glfwGetWGPUSurface(m_instance, m_window);
+    if (!m_headless) {
+        m_surface = glfwGetWGPUSurface(m_instance, m_window);
+    }
 
     WGPURequestAdapterOptions adapterOpts = {};
     adapterOpts.nextInChain               = nullptr;
     adapterOpts.compatibleSurface         = m_surface;
+    adapterOpts.forceFallbackAdapter      = options().software_adapter;
     WGPUAdapter adapter                   = request_adapter_sync(m_instance, &adapterOpts);
 
+    // Large meshes are read from storage buffers, so we ask for the largest buffers the adapter supports
+    // instead of the default 128 MB binding limit.
+    WGPUSupportedLimits supported_limits = {};
+    wgpuAdapterGetLimits(adapter, &supported_limits);
+    WGPURequiredLimits required_limits = {};
+    required_limits.limits             = supported_limits.limits;
+
+    // Dawn can lock the device internally, which lets worker threads record render bundles and
+    // write buffers, see set_parallel_encoding
+    std::vector<WGPUFeatureName> required_features;
+#ifdef WEBGPU_BACKEND_DAWN
+    if (wgpuAdapterHasFeature(adapter, WGPUFeatureName_ImplicitDeviceSynchronization)) {
+        required_features.push_back(WGPUFeatureName_ImplicitDeviceSynchronization);
+        m_device_thread_safe = true;
+    }
+#endif
+
     WGPUDeviceDescriptor deviceDesc     = {};
     deviceDesc.nextInChain              = nullptr;
     deviceDesc.label                    = to_string_view("My Device"); // anything works here, that's your call
-    deviceDesc.requiredFeatureCount     = 0;                           // we do not require any specific feature
-    deviceDesc.requiredLimits           = nullptr;                     // we do not require any specific limit
+    deviceDesc.requiredFeatureCount     = required_features.size();
+    deviceDesc.requiredFeatures         = required_features.data();
+    deviceDesc.requiredLimits           = &required_limits;
     deviceDesc.defaultQueue.nextInChain = nullptr;
     deviceDesc.defaultQueue.label       = to_string_view("The default queue");
     // deviceDesc.deviceLostCallback       = nullptr;
@@ -598,9 +1151,28 @@ void Renderer::initialize_gui() {
 }
 
 Renderer::Renderer() : m_camera({0, 0, 5}, {0, 0, 0}, {0, 1, 0}) {
+    m_headless = options().headless;
+    if (m_headless) {
+        m_width  = options().width;
+        m_height = options().height;
+        initialize_device();
+        initialize_queue();
+        m_pipeline_cache    = std::make_unique<PipelineCache>(m_device);
+        m_property_defaults = std::make_unique<MeshPropertyDefaults>(*this);
+        initialize_camera_uniforms();
+        on_camera_update();
+
+        initialize_offscreen_target();
+        initialize_depth_texture();
+        return;
+    }
+
     initialize_window();
     initialize_device();
     initialize_queue();
+    m_pipeline_cache    = std::make_unique<PipelineCache>(m_device);
+    m_property_defaults = std::make_unique<MeshPropertyDefaults>(*this);
+    initialize_camera_uniforms();
 
     // m_width and m_height are used to create the window, but that is not necessarily the same as the framebuffer size.
     // so we update them before configuring the surface in case they are not the same.
@@ -608,13 +1180,50 @@ Renderer::Renderer() : m_camera({0, 0, 5}, {0, 0, 0}, {0, 1, 0}) {
     glfwGetFramebufferSize(m_window, &fb_width, &fb_height);
     m_width  = fb_width;
     m_height = fb_height;
-    update_projection();
+    on_camera_update();
 
     configure_surface();
     initialize_depth_texture();
     initialize_gui();
 }
 
+WGPUBindGroupLayoutEntry Renderer::camera_layout_entry() {
+    WGPUBindGroupLayoutEntry entry = {};
+    entry.binding                  = 0;
+    entry.visibility               = WGPUShaderStage_Vertex | WGPUShaderStage_Fragment;
+    entry.buffer.type              = WGPUBufferBindingType_Uniform;
+    entry.buffer.minBindingSize    = sizeof(CameraUniforms);
+    return entry;
+}
+
+void Renderer::initialize_camera_uniforms() {
+    WGPUBufferDescriptor buffer_desc = {};
+    buffer_desc.size                 = sizeof(CameraUniforms);
+    buffer_desc.usage                = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Uniform;
+    buffer_desc.mappedAtCreation     = false;
+    m_camera_buffer                  = wgpuDeviceCreateBuffer(m_device, &buffer_desc);
+
+    // Pipelines create their own layout from camera_layout_entry, layouts with equal entries
+    // are compatible so this bind group can be used with all of them
+    WGPUBindGroupLayoutEntry      layout_entry = camera_layout_entry();
+    WGPUBindGroupLayoutDescriptor layout_desc  = {};
+    layout_desc.entryCount                     = 1;
+    layout_desc.entries                        = &layout_entry;
+    m_camera_layout                            = wgpuDeviceCreateBindGroupLayout(m_device, &layout_desc);
+
+    WGPUBindGroupEntry binding = {};
+    binding.binding            = 0;
+    binding.buffer             = m_camera_buffer;
+    binding.offset             = 0;
+    binding.size               = sizeof(CameraUniforms);
+
+    WGPUBindGroupDescriptor bind_group_desc = {};
+    bind_group_desc.layout                  = m_camera_layout;
+    bind_group_desc.entryCount              = 1;
+    bind_group_desc.entries                 = &binding;
+    m_camera_bind_group                     = wgpuDeviceCreateBindGroup(m_device, &bind_group_desc);
+}
+
 void Renderer::update_projection() {
     float aspect_ratio = static_cast<float>(m_width) / static_cast<float>(m_height);
     float far_plane    = 100.0f;
@@ -624,17 +1233,13 @@ void Renderer::update_projection() {
 }
 
 void Renderer::on_camera_update() {
+    request_redraw();
     update_projection();
 
-    for (auto& mesh : m_meshes) {
-        mesh.second->on_camera_update();
-    }
-    for (auto& point_cloud : m_point_clouds) {
-        point_cloud.second->on_camera_update();
-    }
-    for (auto& line_network : m_line_networks) {
-        line_network.second->on_camera_update();
-    }
+    CameraUniforms camera;
+    camera.projection_matrix = m_projection;
+    camera.view_matrix       = m_camera.transform();
+    write_uniforms(m_camera_buffer, &camera, sizeof(CameraUniforms));
 }
 
 glm::vec2 transform_mouse(glm::vec2 in, uint32_t width, uint32_t height) {
@@ -646,18 +1251,19 @@ void Renderer::on_mouse_move(double xpos, double ypos) {
         return;
     }
     if (m_drag.active) {
-        glm::vec2 current_pos = transform_mouse({xpos, ypos}, m_width, m_height);
-        glm::vec2 last_pos    = m_drag.last_pos;
-
+        DragMode mode = DragMode::None;
         if (glfwGetMouseButton(m_window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
-            m_camera.rotate(last_pos, current_pos);
+            mode = DragMode::Rotate;
         } else if (glfwGetMouseButton(m_window, GLFW_MOUSE_BUTTON_MIDDLE) == GLFW_PRESS) {
-            glm::vec2 delta = (current_pos - last_pos) * m_drag.pan_speed;
-            m_camera.pan(delta);
+            mode = DragMode::Pan;
         }
-
-        m_drag.last_pos = current_pos;
-        on_camera_update();
+        // the motion so far belongs to the other button
+        if (m_drag.moved && mode != m_drag.mode) {
+            apply_camera_input();
+        }
+        m_drag.mode        = mode;
+        m_drag.current_pos = transform_mouse({xpos, ypos}, m_width, m_height);
+        m_drag.moved       = true;
     }
 }
 
@@ -668,12 +1274,14 @@ void Renderer::on_mouse_button(int button, int action, int /* modifiers */) {
     if (button == GLFW_MOUSE_BUTTON_LEFT || button == GLFW_MOUSE_BUTTON_MIDDLE) {
         switch (action) {
         case GLFW_PRESS:
+            apply_camera_input();
             m_drag.active = true;
             double x, y;
             glfwGetCursorPos(m_window, &x, &y);
             m_drag.last_pos = transform_mouse({x, y}, m_width, m_height);
             break;
         case GLFW_RELEASE:
+            apply_camera_input();
             m_drag.active = false;
             break;
         }
@@ -684,8 +1292,31 @@ void Renderer::on_scroll(double /* xoffset */, double yoffset) {
     if (ImGui::GetIO().WantCaptureMouse) {
         return;
     }
-    m_camera.zoom(static_cast<float>(yoffset) * m_drag.scroll_sensitivity);
-    on_camera_update();
+    m_drag.pending_scroll += static_cast<float>(yoffset);
+}
+
+void Renderer::apply_camera_input() {
+    bool changed = false;
+    if (m_drag.moved) {
+        if (m_drag.mode == DragMode::Rotate) {
+            m_camera.rotate(m_drag.last_pos, m_drag.current_pos);
+            changed = true;
+        } else if (m_drag.mode == DragMode::Pan) {
+            m_camera.pan((m_drag.current_pos - m_drag.last_pos) * m_drag.pan_speed);
+            changed = true;
+        }
+        m_drag.last_pos = m_drag.current_pos;
+        m_drag.moved    = false;
+    }
+    // zooming translates along the view direction, so the offsets add up
+    if (m_drag.pending_scroll != 0.0f) {
+        m_camera.zoom(m_drag.pending_scroll * m_drag.scroll_sensitivity);
+        m_drag.pending_scroll = 0.0f;
+        changed               = true;
+    }
+    if (changed) {
+        on_camera_update();
+    }
 }
 
 void Renderer::resize(int width, int height) {
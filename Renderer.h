@@ -3,11 +3,13 @@
 
 #include "Camera.h"
 #include "BoundingBox.h"
+#include "ImageReadback.h"
 #include <GLFW/glfw3.h>
 #include <webgpu/webgpu.h>
 
 
 #include <array>
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <string>
@@ -19,11 +21,36 @@ struct ImGuiIO;
 namespace rr {
 
 class Drawable;
+class MeshPropertyDefaults;
+class PipelineCache;
 class VisualMesh;
+class VisualMeshBatch;
 class VisualPointCloud;
+class VisualPointOctree;
 class VisualLineNetwork;
+class WorkerPool;
 struct Mesh;
 
+// Frame-level camera data in bind group 0 of every pipeline, see Renderer::camera_layout_entry
+struct CameraUniforms {
+    glm::mat4x4 projection_matrix;
+    glm::mat4x4 view_matrix;
+};
+
+static_assert(sizeof(CameraUniforms) % 16 == 0);
+
+// Read when the renderer is created, see Renderer::set_options
+struct RendererOptions {
+    // Renders into an offscreen texture instead of a window, without GLFW, a surface or the GUI.
+    // Images are taken with render_to_image and render_images.
+    bool     headless = false;
+    // Requests the fallback adapter, e.g. Dawn's software rasterizer on machines without a GPU
+    bool     software_adapter = false;
+    // image size in headless mode
+    uint32_t width  = 1000;
+    uint32_t height = 1000;
+};
+
 class Renderer {
 public:
     // framebuffer size, not that this is not necessarily the same as the window size
@@ -41,10 +68,32 @@ public:
     Camera m_camera;
     glm::mat4 m_projection;
 
-    // Mouse drag state
+    // One camera uniform buffer for the whole scene, bound to group 0 once per render pass.
+    // Moving the camera writes this buffer and nothing else.
+    WGPUBuffer          m_camera_buffer     = nullptr;
+    WGPUBindGroupLayout m_camera_layout     = nullptr;
+    WGPUBindGroup       m_camera_bind_group = nullptr;
+
+    // shared by all drawables, see PipelineCache.h
+    std::unique_ptr<PipelineCache> m_pipeline_cache;
+    // shared by all meshes, see VisualMesh.h
+    std::unique_ptr<MeshPropertyDefaults> m_property_defaults;
+
+    // Batchable meshes are drawn by m_mesh_batch instead of one by one, see set_mesh_batching
+    bool                             m_batch_meshes = false;
+    std::unique_ptr<VisualMeshBatch> m_mesh_batch;
+    std::vector<VisualMesh*>         m_batched_meshes;
+
+    // Mouse drag state. Input events only accumulate the cursor motion and the scroll offset,
+    // apply_camera_input moves the camera once per frame.
+    enum class DragMode { None, Rotate, Pan };
     struct {
         bool      active = false;
-        glm::vec2 last_pos;
+        glm::vec2 last_pos;    // where the camera was last moved to
+        glm::vec2 current_pos; // latest cursor position
+        bool      moved              = false;
+        DragMode  mode               = DragMode::None;
+        float     pending_scroll     = 0.0f;
         float     rotation_speed     = 0.02f;
         float     pan_speed          = 1.f;
         float     scroll_sensitivity = 0.2f;
@@ -56,17 +105,96 @@ public:
     Renderer(const Renderer&)            = delete;
     Renderer& operator=(const Renderer&) = delete;
 
+    // Layout of bind group 0, pipelines put it first in their bind groups
+    static WGPUBindGroupLayoutEntry camera_layout_entry();
+
     WGPURenderPassEncoder create_render_pass(WGPUTextureView nextTexture, WGPUCommandEncoder encoder);
 
+    // Updates all drawables, binds the camera and encodes their draws
+    void draw_drawables(WGPURenderPassEncoder render_pass);
+
+    // Opt-in for scenes with many small meshes: all meshes that do not show a property are
+    // packed into shared buffers and drawn with a single draw call
+    void set_mesh_batching(bool enabled);
+
+    // Opt-in for large static scenes: static drawables are recorded into render bundles once and
+    // replayed every frame. A bundle is recorded again when one of its drawables calls
+    // invalidate_commands, so the encoding cost only depends on what changed. The draw order is
+    // the same as without bundles.
+    void set_render_bundles(bool enabled);
+
+    size_t num_render_bundles() const {
+        return m_bundles.size();
+    }
+
+    // Render bundles recorded during the last frame, 0 while nothing changes
+    size_t bundles_recorded_last_frame() const {
+        return m_bundles_recorded;
+    }
+
+    // Opt-in for scenes with many drawables: their update() runs on worker threads and each
+    // worker records its contiguous share of the draws into a render bundle, which are executed
+    // in draw order. Needs a device created with implicit synchronization (Dawn), otherwise it
+    // stays disabled. Point octrees and the mesh batch are still updated on the main thread.
+    void set_parallel_encoding(bool enabled);
+
+    bool parallel_encoding() const {
+        return m_parallel_encoding;
+    }
+
     void update_frame();
 
     bool should_close();
 
+    // Event driven loop for idle scenes: update_frame blocks until an input event arrives or
+    // timeout_seconds pass, runs the user callback and only draws a frame if the camera, the UI
+    // or a drawable changed, see Drawable::needs_redraw
+    void set_on_demand_rendering(bool enabled, double timeout_seconds = 0.1);
+
+    // Keeps drawing every frame in on-demand mode, e.g. while the user callback animates the scene
+    void set_animating(bool animating);
+
+    // Draws at least the next `frames` frames in on-demand mode
+    void request_redraw(uint32_t frames = 1);
+
+    // Frames drawn and update_frame calls that did not draw, idle scenes only add to the latter
+    uint64_t frame_count() const {
+        return m_frame_count;
+    }
+
+    uint64_t skipped_frame_count() const {
+        return m_skipped_frame_count;
+    }
+
+    // Writes a uniform buffer and counts the upload, see uniform_uploads_last_frame
+    void write_uniforms(WGPUBuffer buffer, const void* data, size_t size) const;
+
+    // Uniform buffer writes during the last update_frame, including the camera buffer
+    uint64_t uniform_uploads_last_frame() const {
+        return m_last_frame_uniform_uploads;
+    }
+
     static Renderer& get();
 
+    // Has to be called before the first call of get()
+    static void set_options(const RendererOptions& options);
+
+    bool is_headless() const {
+        return m_headless;
+    }
+
+    // Headless mode only: renders the scene as seen from camera and reads it back
+    Image render_to_image(const Camera& camera);
+
+    // Headless mode only: renders one image per camera. Up to num_readback_slots frames are in
+    // flight, so frame i + 1 is rendered while frame i is mapped. on_image is called in the order
+    // of the cameras, on the calling thread. The camera is restored afterwards.
+    void render_images(const std::vector<Camera>& cameras, const ReadbackRing::Callback& on_image);
+
     VisualMesh* register_mesh(std::string_view name, std::unique_ptr<VisualMesh> mesh);
     VisualPointCloud* register_point_cloud(std::string_view name, std::unique_ptr<VisualPointCloud> point_cloud);
     VisualLineNetwork* register_line_network(std::string_view name, std::unique_ptr<VisualLineNetwork> line_network);
+    VisualPointOctree* register_point_octree(std::string_view name, std::unique_ptr<VisualPointOctree> point_octree);
 
     void set_user_callback(std::function<void()> callback);
 
@@ -85,20 +213,101 @@ public:
     void initialize_depth_texture();
     void initialize_gui();
     void initialize_guizmo();
+    void initialize_camera_uniforms();
+    void initialize_offscreen_target();
 
     void update_projection();
     void on_camera_update();
     void resize(int width, int height);
 
-    GLFWwindow* m_window;
-    WGPUSurface m_surface;
+    // Applies the accumulated mouse motion and scroll to the camera with one on_camera_update
+    void apply_camera_input();
+
+    // Whether on-demand mode has to draw the next frame
+    bool redraw_pending() const;
+
+    // Records the bundles of m_bundle_ranges whose drawables changed and fills m_bundle_handles
+    void record_bundles();
+
+    void release_bundles();
+
+    // Records the draws of count drawables into a new bundle, safe to call from worker threads
+    // when m_device_thread_safe
+    WGPURenderBundle record_bundle(Drawable* const* drawables, size_t count) const;
+
+    // Updates the drawables on the worker threads if parallel encoding is enabled
+    void update_drawables(const std::vector<Drawable*>& drawables);
+
+    // Records the drawables into per-frame bundles, one for each worker, and executes them
+    void draw_parallel(WGPURenderPassEncoder render_pass, Drawable* const* drawables, size_t count);
+
+    static RendererOptions& options();
+
+    GLFWwindow* m_window  = nullptr;
+    WGPUSurface m_surface = nullptr;
+
+    // Headless mode renders into m_color_texture and reads it back through m_readback
+    bool                          m_headless           = false;
+    WGPUTexture                   m_color_texture      = nullptr;
+    WGPUTextureView               m_color_texture_view = nullptr;
+    std::unique_ptr<ReadbackRing> m_readback;
+    static constexpr size_t       num_readback_slots = 3;
 
     std::unordered_map<std::string, std::unique_ptr<VisualMesh>> m_meshes;
     std::unordered_map<std::string, std::unique_ptr<VisualPointCloud>> m_point_clouds;
     std::unordered_map<std::string, std::unique_ptr<VisualLineNetwork>> m_line_networks;
+    std::unordered_map<std::string, std::unique_ptr<VisualPointOctree>> m_point_octrees;
 
     std::function<void()> m_user_callback;
 
+    // On-demand rendering, see set_on_demand_rendering
+    bool     m_on_demand           = false;
+    bool     m_animating           = false;
+    double   m_wait_timeout        = 0.1;
+    uint32_t m_pending_frames      = 1;
+    uint64_t m_frame_count         = 0;
+    uint64_t m_skipped_frame_count = 0;
+
+    // Render bundles of up to drawables_per_bundle consecutive static drawables, one for each entry
+    // of m_bundle_ranges. versions holds the m_commands_version of each drawable at recording.
+    struct RenderBundle {
+        std::vector<Drawable*> drawables;
+        std::vector<uint64_t>  versions;
+        WGPURenderBundle       bundle = nullptr;
+    };
+    static constexpr size_t       drawables_per_bundle = 256;
+    bool                          m_use_bundles        = false;
+    std::vector<RenderBundle>     m_bundles;
+    std::vector<WGPURenderBundle> m_bundle_handles;
+    size_t                        m_bundles_recorded = 0;
+    // Consecutive drawables of the current frame that are either all replayed from the bundles
+    // [first_bundle, first_bundle + num_bundles) or all drawn directly
+    struct DrawRun {
+        size_t begin        = 0;
+        size_t end          = 0;
+        bool   bundled      = false;
+        size_t first_bundle = 0;
+        size_t num_bundles  = 0;
+    };
+    // drawables of the current frame in draw order, and the ranges of them that form the bundles
+    std::vector<Drawable*>                 m_frame_drawables;
+    std::vector<DrawRun>                   m_draw_runs;
+    std::vector<std::pair<size_t, size_t>> m_bundle_ranges;
+
+    // Smaller jobs cost more to hand to a worker than they save
+    static constexpr size_t       min_updates_per_job  = 64;
+    static constexpr size_t       min_draws_per_job    = 128;
+    bool                          m_device_thread_safe = false;
+    bool                          m_parallel_encoding  = false;
+    std::vector<WGPURenderBundle> m_frame_bundles;
+    // started the first time parallel encoding is enabled
+    std::unique_ptr<WorkerPool> m_workers;
+
+    // counted by write_uniforms, which drawables call through their const Renderer*, also from
+    // worker threads
+    mutable std::atomic<uint64_t> m_uniform_uploads            = 0;
+    uint64_t                      m_last_frame_uniform_uploads = 0;
+
     void terminate_gui();                              // called in onFinish
     void update_gui(WGPURenderPassEncoder renderPass); // called in onFrame
     void handle_guizmo(Drawable* drawable);
@@ -107,4 +316,8 @@ public:
 WGPUStringView to_string_view(const char* str);
 std::string    to_string(const WGPUStringView& view);
 
+// A buffer of at least size bytes with CopyDst | usage, filled with data unless it is null. The
+// size is rounded up to 4 bytes and to at least 16, so empty arrays still get a valid binding.
+WGPUBuffer create_buffer(const Renderer& renderer, const void* data, size_t size, WGPUBufferUsage usage);
+
 } // namespace rr
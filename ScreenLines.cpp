@@ -0,0 +1,243 @@
+#include "ScreenLines.h"
+
+#include "PipelineCache.h"
+#include "Renderer.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+namespace rr {
+
+const char* screenLinesShaderCode = R"(
+struct VertexInput {
+    @builtin(vertex_index) vertex_index: u32,
+    @location(0) line: vec2u,
+}
+
+struct VertexOutput {
+    @builtin(position) position: vec4f,
+    // pixels along the line from the first endpoint and across from the center
+    @location(0) @interpolate(linear) line_coord: vec2f,
+    @location(1) @interpolate(flat) screen_length: f32,
+}
+
+struct Camera {
+    projection_matrix: mat4x4f,
+    view_matrix: mat4x4f,
+}
+
+struct Uniforms {
+    color: vec4f,
+    viewport: vec2f,
+    width: f32,
+    round_caps: u32,
+}
+
+@group(0) @binding(0)
+var<uniform> camera: Camera;
+
+@group(1) @binding(0)
+var<uniform> uniforms: Uniforms;
+
+@group(1) @binding(1)
+var<storage, read> positions: array<f32>;
+
+fn load_position(i: u32) -> vec3f {
+    return vec3f(positions[3u * i], positions[3u * i + 1u], positions[3u * i + 2u]);
+}
+
+@vertex
+fn vs_main(input: VertexInput) -> VertexOutput {
+    var output: VertexOutput;
+
+    let view_projection = camera.projection_matrix * camera.view_matrix;
+    var a = view_projection * vec4f(load_position(input.line.x), 1.0);
+    var b = view_projection * vec4f(load_position(input.line.y), 1.0);
+
+    // Clip against a plane just in front of the eye, endpoints behind it do not project
+    let min_w = 1e-4;
+    if (a.w < min_w && b.w < min_w) {
+        output.position = vec4f(0.0, 0.0, 2.0, 1.0);
+        return output;
+    }
+    if (a.w < min_w) {
+        a = mix(a, b, (min_w - a.w) / (b.w - a.w));
+    } else if (b.w < min_w) {
+        b = mix(b, a, (min_w - b.w) / (a.w - b.w));
+    }
+
+    let half_viewport = 0.5 * uniforms.viewport;
+    let screen_a = a.xy / a.w * half_viewport;
+    let screen_b = b.xy / b.w * half_viewport;
+    let delta = screen_b - screen_a;
+    let screen_length = length(delta);
+    let dir = select(vec2f(1.0, 0.0), delta / screen_length, screen_length > 1e-6);
+    let normal = vec2f(-dir.y, dir.x);
+
+    // triangle strip (start, -), (end, -), (start, +), (end, +)
+    let at_end = f32(input.vertex_index & 1u);
+    let side = f32(input.vertex_index >> 1u) * 2.0 - 1.0;
+    let half_width = 0.5 * uniforms.width;
+    let cap = select(0.0, half_width, uniforms.round_caps != 0u) * (at_end * 2.0 - 1.0);
+    let offset = normal * side * half_width + dir * cap;
+
+    let corner = mix(a, b, at_end);
+    output.position = vec4f(corner.xy + offset / half_viewport * corner.w, corner.zw);
+    output.line_coord = vec2f(at_end * screen_length + cap, side * half_width);
+    output.screen_length = screen_length;
+    return output;
+}
+
+@fragment
+fn fs_main(input: VertexOutput) -> @location(0) vec4f {
+    if (uniforms.round_caps != 0u) {
+        let along = input.line_coord.x - clamp(input.line_coord.x, 0.0, input.screen_length);
+        if (along * along + input.line_coord.y * input.line_coord.y > 0.25 * uniforms.width * uniforms.width) {
+            discard;
+        }
+    }
+    return uniforms.color;
+}
+)";
+
+ScreenLines::ScreenLines(const std::vector<glm::vec3>& positions, const std::vector<std::pair<int, int>>& lines,
+                         float width, const glm::vec3& color, const Renderer& renderer)
+    : m_renderer(&renderer) {
+    m_uniforms.color      = glm::vec4(color, 1.0f);
+    m_uniforms.width      = width;
+    m_uniforms.round_caps = 1;
+    configure_render_pipeline(positions, lines);
+}
+
+ScreenLines::~ScreenLines() {
+    release();
+}
+
+void ScreenLines::release() {
+    if (m_position_buffer == nullptr) {
+        return;
+    }
+    for (WGPUBuffer buffer : {m_position_buffer, m_line_buffer, m_uniform_buffer}) {
+        wgpuBufferDestroy(buffer);
+        wgpuBufferRelease(buffer);
+    }
+    wgpuBindGroupRelease(m_bind_group);
+    m_position_buffer = nullptr;
+    m_bind_group      = nullptr;
+    // the pipeline belongs to the pipeline cache
+    m_pipeline = nullptr;
+}
+
+void ScreenLines::configure_render_pipeline(const std::vector<glm::vec3>&           positions,
+                                            const std::vector<std::pair<int, int>>& lines) {
+    release();
+    const Renderer& renderer = *m_renderer;
+
+    std::vector<uint32_t> line_indices;
+    line_indices.reserve(2 * lines.size());
+    for (const auto& [a, b] : lines) {
+        line_indices.push_back(uint32_t(a));
+        line_indices.push_back(uint32_t(b));
+    }
+
+    m_num_positions   = uint32_t(positions.size());
+    m_num_lines       = uint32_t(lines.size());
+    m_position_buffer = create_buffer(renderer, positions.data(), positions.size() * sizeof(glm::vec3),
+                                      WGPUBufferUsage_Storage);
+    m_line_buffer     = create_buffer(renderer, line_indices.data(), line_indices.size() * sizeof(uint32_t),
+                                      WGPUBufferUsage_Vertex);
+    m_uniform_buffer  = create_buffer(renderer, nullptr, sizeof(ScreenLinesUniforms), WGPUBufferUsage_Uniform);
+    m_uniforms_dirty  = true;
+
+    std::vector<WGPUBindGroupLayoutEntry> bindings(2);
+    bindings[0].binding               = 0;
+    bindings[0].visibility            = WGPUShaderStage_Vertex | WGPUShaderStage_Fragment;
+    bindings[0].buffer.type           = WGPUBufferBindingType_Uniform;
+    bindings[0].buffer.minBindingSize = sizeof(ScreenLinesUniforms);
+    bindings[1].binding               = 1;
+    bindings[1].visibility            = WGPUShaderStage_Vertex;
+    bindings[1].buffer.type           = WGPUBufferBindingType_ReadOnlyStorage;
+
+    WGPUVertexAttribute line_attribute = {};
+    line_attribute.shaderLocation      = 0;
+    line_attribute.format              = WGPUVertexFormat_Uint32x2;
+    line_attribute.offset              = 0;
+
+    // One record per quad, the corners come from the vertex index
+    WGPUVertexBufferLayout line_layout = {};
+    line_layout.attributeCount         = 1;
+    line_layout.attributes             = &line_attribute;
+    line_layout.arrayStride            = 2 * sizeof(uint32_t);
+    line_layout.stepMode               = WGPUVertexStepMode_Instance;
+
+    RenderPipelineDescription pipeline_desc;
+    pipeline_desc.shader_source  = screenLinesShaderCode;
+    pipeline_desc.vertex_buffers = {line_layout};
+    pipeline_desc.bind_groups    = {{Renderer::camera_layout_entry()}, bindings};
+    pipeline_desc.topology       = WGPUPrimitiveTopology_TriangleStrip;
+    pipeline_desc.cull_mode      = WGPUCullMode_None;
+
+    pipeline_desc.blend.color.srcFactor = WGPUBlendFactor_SrcAlpha;
+    pipeline_desc.blend.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    pipeline_desc.blend.color.operation = WGPUBlendOperation_Add;
+    pipeline_desc.blend.alpha.srcFactor = WGPUBlendFactor_Zero;
+    pipeline_desc.blend.alpha.dstFactor = WGPUBlendFactor_One;
+    pipeline_desc.blend.alpha.operation = WGPUBlendOperation_Add;
+
+    pipeline_desc.color_format = renderer.m_swap_chain_format;
+    pipeline_desc.depth_format = renderer.m_depth_texture_format;
+
+    const CachedPipeline& cached = renderer.m_pipeline_cache->get(pipeline_desc);
+    m_pipeline                   = cached.pipeline;
+
+    std::array<WGPUBuffer, 2>         buffers = {m_uniform_buffer, m_position_buffer};
+    std::array<WGPUBindGroupEntry, 2> entries = {};
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        entries[i].binding = i;
+        entries[i].buffer  = buffers[i];
+        entries[i].offset  = 0;
+        entries[i].size    = wgpuBufferGetSize(buffers[i]);
+    }
+
+    WGPUBindGroupDescriptor bind_group_desc = {};
+    bind_group_desc.layout                  = cached.bind_group_layouts[1];
+    bind_group_desc.entryCount              = entries.size();
+    bind_group_desc.entries                 = entries.data();
+    m_bind_group                            = wgpuDeviceCreateBindGroup(renderer.m_device, &bind_group_desc);
+}
+
+void ScreenLines::update_positions(const glm::vec3* positions, size_t count) {
+    assert(count == m_num_positions);
+    if (count > 0) {
+        wgpuQueueWriteBuffer(m_renderer->m_queue, m_position_buffer, 0, positions, count * sizeof(glm::vec3));
+    }
+}
+
+void ScreenLines::update() {
+    if (m_num_lines == 0) {
+        return;
+    }
+    glm::vec2 viewport(float(m_renderer->m_width), float(m_renderer->m_height));
+    if (m_uniforms.viewport != viewport) {
+        m_uniforms.viewport = viewport;
+        m_uniforms_dirty    = true;
+    }
+    if (m_uniforms_dirty) {
+        m_renderer->write_uniforms(m_uniform_buffer, &m_uniforms, sizeof(ScreenLinesUniforms));
+        m_uniforms_dirty = false;
+    }
+}
+
+void ScreenLines::draw(RenderEncoder encoder) {
+    if (m_num_lines == 0) {
+        return;
+    }
+    // Group 0 is the camera, bound by the renderer
+    encoder.set_pipeline(m_pipeline);
+    encoder.set_bind_group(1, m_bind_group);
+    encoder.set_vertex_buffer(0, m_line_buffer, 0, m_num_lines * 2 * sizeof(uint32_t));
+    encoder.draw(4, m_num_lines, 0, 0);
+}
+
+} // namespace rr
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "RenderEncoder.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <webgpu/webgpu.h>
+
+namespace rr {
+
+class Renderer;
+
+struct ScreenLinesUniforms {
+    glm::vec4 color;
+    glm::vec2 viewport; // framebuffer size in pixels
+    float     width;    // in pixels
+    uint32_t  round_caps;
+};
+
+static_assert(sizeof(ScreenLinesUniforms) % 16 == 0);
+
+// Lines drawn as quads of constant width in pixels, 4 vertices per line instead of a cylinder
+// mesh. The vertex shader projects both endpoints and expands the quad on screen. With round
+// caps the quad is extended by half the width at both ends and the fragment shader cuts the
+// caps, which also closes the gaps at joints.
+class ScreenLines {
+public:
+    ScreenLines(const std::vector<glm::vec3>& positions, const std::vector<std::pair<int, int>>& lines, float width,
+                const glm::vec3& color, const Renderer& renderer);
+    ~ScreenLines();
+
+    ScreenLines(const ScreenLines&)            = delete;
+    ScreenLines& operator=(const ScreenLines&) = delete;
+
+    void release();
+
+    // Writes the uniforms if they or the framebuffer size changed
+    void update();
+
+    void draw(RenderEncoder encoder);
+
+    void set_width(float pixels) {
+        m_uniforms.width = pixels;
+        m_uniforms_dirty = true;
+    }
+
+    void set_round_caps(bool round_caps) {
+        m_uniforms.round_caps = round_caps ? 1 : 0;
+        m_uniforms_dirty      = true;
+    }
+
+    void set_color(const glm::vec3& color) {
+        m_uniforms.color = glm::vec4(color, 1.0f);
+        m_uniforms_dirty = true;
+    }
+
+    // The number of vertices has to stay the same
+    void update_positions(const glm::vec3* positions, size_t count);
+
+private:
+    void configure_render_pipeline(const std::vector<glm::vec3>& positions,
+                                   const std::vector<std::pair<int, int>>& lines);
+
+    const Renderer* m_renderer = nullptr;
+
+    ScreenLinesUniforms m_uniforms       = {};
+    bool                m_uniforms_dirty = true;
+
+    uint32_t m_num_positions = 0;
+    uint32_t m_num_lines     = 0;
+
+    WGPUBuffer         m_position_buffer = nullptr;
+    WGPUBuffer         m_line_buffer     = nullptr;
+    WGPUBuffer         m_uniform_buffer  = nullptr;
+    WGPUBindGroup      m_bind_group      = nullptr;
+    WGPURenderPipeline m_pipeline        = nullptr;
+};
+
+} // namespace rr
@@ -1,34 +1,86 @@
 #pragma once
 
-const char* shaderCode = R"shader(
-struct VertexInput {
-    @location(0) position: vec3f,
-    @location(1) normal: vec3f,
-    @location(2) bary: vec3f,
-    @location(3) edge_mask: vec3f,
-	@location(4) color: vec3f,
-};
+// The visual mesh does not use vertex buffers. Every triangle stores the ids of its three
+// shared vertices and a mask of the edges that were introduced by fan triangulation, the
+// vertex shader pulls positions, normals and colors from storage buffers using the vertex
+// index. Corner k of a triangle gets the barycentric coordinate e_k, which the fragment
+// shader uses for the wireframe.
+//
+// The storage layout is selected by prepending one of the fetch variants below and
+// visualMeshShading to shaderCode.
+// Both define fetch_corner(), which returns the decoded data of one triangle corner, and the
+// loads of the property data in bind group 2. Every face color and scalar property owns its
+// bind group, so switching between them only swaps the bind group.
 
-struct VertexOutput {
-    @builtin(position) position: vec4f,
-    @location(0) bary: vec3f,
-    @location(1) edge_mask: vec3f,
-    @location(2) world_normal: vec3f,
-    @location(3) world_pos: vec3f,
-    @location(4) view_pos: vec3f,
-	@location(5) color: vec3f,
-};
+// VisualMeshVertexFormat::Full, 32 bit floats for everything
+inline const char* visualMeshFetchFull = R"shader(
+@group(1) @binding(1) var<storage, read> positions: array<f32>;
+@group(1) @binding(2) var<storage, read> normals: array<f32>;
+@group(1) @binding(3) var<storage, read> triangles: array<vec4u>;
+@group(2) @binding(0) var<storage, read> property_data: array<f32>;
 
-struct VisualMeshUniforms {
-    projectionMatrix: mat4x4f,
-    viewMatrix: mat4x4f,
-    modelMatrix: mat4x4f,
-    wireframeColor: vec4f,
-    options : vec4f,
-};
+fn fetch_corner(triangle_id: u32, corner: u32) -> Corner {
+    let triangle = triangles[triangle_id];
+    let v = triangle[corner];
+    var c: Corner;
+    c.vertex = v;
+    c.position = vec3f(positions[3u * v], positions[3u * v + 1u], positions[3u * v + 2u]);
+    c.normal = vec3f(normals[3u * v], normals[3u * v + 1u], normals[3u * v + 2u]);
+    c.edge_mask = vec3f(f32(triangle.w & 1u), f32((triangle.w >> 1u) & 1u), f32((triangle.w >> 2u) & 1u));
+    return c;
+}
+
+fn load_face_color(face: u32) -> vec3f {
+    return vec3f(property_data[3u * face], property_data[3u * face + 1u], property_data[3u * face + 2u]);
+}
+
+fn load_scalar(i: u32) -> f32 {
+    return property_data[i];
+}
+)shader";
+
+// VisualMeshVertexFormat::Compact. Positions are unorm16 relative to the bounding box (two
+// words per vertex), normals are octahedral encoded snorm16x2 and colors are rgba8. Triangles
+// are three vertex ids, the top bit of id k hides the edge opposite to corner k.
+inline const char* visualMeshFetchCompact = R"shader(
+@group(1) @binding(1) var<storage, read> positions: array<u32>;
+@group(1) @binding(2) var<storage, read> normals: array<u32>;
+@group(1) @binding(3) var<storage, read> triangles: array<u32>;
+@group(2) @binding(0) var<storage, read> property_data: array<u32>;
+
+fn oct_decode(e: vec2f) -> vec3f {
+    var n = vec3f(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+    let t = max(-n.z, 0.0);
+    n.x += select(t, -t, n.x >= 0.0);
+    n.y += select(t, -t, n.y >= 0.0);
+    return normalize(n);
+}
+
+fn fetch_corner(triangle_id: u32, corner: u32) -> Corner {
+    let ids = vec3u(triangles[3u * triangle_id], triangles[3u * triangle_id + 1u], triangles[3u * triangle_id + 2u]);
+    let v = ids[corner] & 0x7fffffffu;
+    let q = vec3f(unpack2x16unorm(positions[2u * v]), unpack2x16unorm(positions[2u * v + 1u]).x);
+    var c: Corner;
+    c.vertex = v;
+    c.position = uVmUniforms.positionOffset.xyz + q * uVmUniforms.positionScale.xyz;
+    c.normal = oct_decode(unpack2x16snorm(normals[v]));
+    c.edge_mask = vec3f(ids >> vec3u(31u));
+    return c;
+}
+
+fn load_face_color(face: u32) -> vec3f {
+    return unpack4x8unorm(property_data[face]).rgb;
+}
 
-@group(0) @binding(0) var<uniform> uVmUniforms: VisualMeshUniforms;
+// scalars are not quantized
+fn load_scalar(i: u32) -> f32 {
+    return bitcast<f32>(property_data[i]);
+}
+)shader";
 
+// Key, fill and back light of every lit shader, in view space. Prepended to the shader source
+// of the visual meshes, the point sprites and the tubes, so the lighting is changed in one place.
+inline const char* lightingShaderCode = R"shader(
 struct Light {
     position: vec3f,
     color: vec3f,
@@ -51,21 +103,26 @@ fn calculate_lighting(light: Light, normal: vec3f, view_pos: vec3f, view_dir: ve
     return (diffuse + specular) * light.intensity * attenuation;
 }
 
-@vertex
-fn vs_main(in: VertexInput) -> VertexOutput {
-    var out: VertexOutput;
-    let modelPos = uVmUniforms.modelMatrix * vec4f(in.position, 1.0);
-    out.world_pos = modelPos.xyz;
-    out.position = uVmUniforms.projectionMatrix * uVmUniforms.viewMatrix * modelPos;
-    let world_normal = normalize((uVmUniforms.modelMatrix * vec4f(in.normal, 0.0)).xyz);
-    out.world_normal = (uVmUniforms.viewMatrix * vec4f(world_normal, 0.0)).xyz;
-    out.bary = in.bary;
-    out.edge_mask = in.edge_mask;
-    out.view_pos = (uVmUniforms.viewMatrix * modelPos).xyz;
-	out.color = in.color;
-    return out;
+// All lights and the ambient term applied to base_color, before tone mapping
+fn apply_lights(normal: vec3f, view_pos: vec3f, view_dir: vec3f, base_color: vec3f) -> vec3f {
+    let key_light = Light(vec3f(10.0, 10.0, 10.0), vec3f(1.0, 0.98, 0.95), 0.8);   // warm white
+    let fill_light = Light(vec3f(-6.0, 4.0, 8.0), vec3f(0.9, 0.9, 1.0), 0.4);      // cool white
+    let back_light = Light(vec3f(-2.0, 6.0, -8.0), vec3f(1.0, 1.0, 1.0), 0.3);     // white
+
+    var result = vec3f(0.0);
+    result += calculate_lighting(key_light, normal, view_pos, view_dir) * base_color;
+    result += calculate_lighting(fill_light, normal, view_pos, view_dir) * base_color;
+
+    let rim_effect = 1.0 - max(dot(view_dir, normal), 0.0);
+    result += calculate_lighting(back_light, normal, view_pos, view_dir) * rim_effect * base_color;
+
+    return result + vec3f(0.15) * base_color;
 }
+)shader";
 
+// Lighting and wireframe shared by the visual mesh shaders, needs lightingShaderCode. options
+// are the VisualMeshOptions: x shows the wireframe and z the surface.
+inline const char* visualMeshShading = R"shader(
 fn aces_tone_mapping(color: vec3f) -> vec3f {
     let a = 2.51;
     let b = 0.03;
@@ -75,46 +132,12 @@ fn aces_tone_mapping(color: vec3f) -> vec3f {
     return clamp((color * (a * color + b)) / (color * (c * color + d) + e), vec3f(0.0), vec3f(1.0));
 }
 
-@fragment
-fn fs_main(@builtin(front_facing) is_front: bool, in: VertexOutput) -> @location(0) vec4f {
-    let normal = (f32(is_front) * 2.0 - 1.0) * normalize(in.world_normal);
-    let view_dir = normalize(-in.view_pos);
-
-    // Key light (main illumination)
-    let key_light = Light(
-        vec3f(10.0, 10.0, 10.0),   // position
-        vec3f(1.0, 0.98, 0.95),    // warm white
-        0.8                        // intensity
-    );
-
-    // Fill light
-    let fill_light = Light(
-        vec3f(-6.0, 4.0, 8.0),       
-        vec3f(0.9, 0.9, 1.0),          // cool white
-        0.4                      
-    );
-
-    // Back light
-    let back_light = Light(
-        vec3f(-2.0, 6.0, -8.0),       
-        vec3f(1.0, 1.0, 1.0),          // white
-        0.3                           
-    );
-
-    let meshColor = in.color;
-    let wireframe_color = uVmUniforms.wireframeColor.xyz;
-    var result = vec3f(0.0);
-
-    // Calculate lighting contributions
-    result += calculate_lighting(key_light, normal, in.view_pos, view_dir) * meshColor;
-    result += calculate_lighting(fill_light, normal, in.view_pos, view_dir) * meshColor;
+fn shade_mesh(is_front: bool, world_normal: vec3f, view_pos: vec3f, meshColor: vec3f, bary: vec3f,
+              edge_mask: vec3f, wireframe_color: vec3f, options: vec4f) -> vec4f {
+    let normal = (f32(is_front) * 2.0 - 1.0) * normalize(world_normal);
+    let view_dir = normalize(-view_pos);
 
-    let rim_effect = 1.0 - max(dot(view_dir, normal), 0.0);
-    result += calculate_lighting(back_light, normal, in.view_pos, view_dir) * rim_effect * meshColor;
-
-    // Add ambient light
-    let ambient = vec3f(0.15) * meshColor;
-    result += ambient;
+    var result = apply_lights(normal, view_pos, view_dir, meshColor);
 
     // Tone mapping and gamma correction
     result = aces_tone_mapping(result);
@@ -122,26 +145,194 @@ fn fs_main(@builtin(front_facing) is_front: bool, in: VertexOutput) -> @location
 
 	var final_color = vec4f(result, 1.0);
 
-    let show_mesh = uVmUniforms.options.z;
+    let show_mesh = options.z;
     if (show_mesh == 0.0) {
         final_color = vec4f(0.0, 0.0, 0.0, 0.0);
     }
 
-    if (uVmUniforms.options.x == 1.0) {
+    // fwidth needs uniform control flow, options are not uniform in the batched shader
+    let d = fwidth(bary);
+    if (options.x == 1.0) {
 		// Wire frame calculation (preserved from original)
-        let d = fwidth(in.bary);
-        let factor = smoothstep(vec3(0.0), d*1.5, in.bary);
-        let factor_masked = max(factor, in.edge_mask);
+        let factor = smoothstep(vec3(0.0), d*1.5, bary);
+        let factor_masked = max(factor, edge_mask);
         let nearest = min(min(factor_masked.x, factor_masked.y), factor_masked.z);
         let wc4 = vec4f(wireframe_color, 1.0);
         // Mix wireframe with shaded mesh
         final_color = mix(wc4, final_color, nearest);
 	}
 
+    return final_color;
+}
+)shader";
+
+inline const char* shaderCode = R"shader(
+struct VertexOutput {
+    @builtin(position) position: vec4f,
+    @location(0) bary: vec3f,
+    @location(1) edge_mask: vec3f,
+    @location(2) world_normal: vec3f,
+    @location(3) world_pos: vec3f,
+    @location(4) view_pos: vec3f,
+	@location(5) color: vec3f,
+    @location(6) scalar: f32,
+};
+
+struct Camera {
+    projectionMatrix: mat4x4f,
+    viewMatrix: mat4x4f,
+};
+
+struct VisualMeshUniforms {
+    modelMatrix: mat4x4f,
+    wireframeColor: vec4f,
+    options : vec4f,
+    positionOffset: vec4f,
+    positionScale: vec4f,
+    meshColor: vec4f,
+    // x: 0 mesh color, 1 face colors, 2 vertex scalars, 3 face scalars
+    // y: triangles need the face id lookup
+    colorOptions: vec4f,
+    scalarRange: vec4f,
+};
+
+struct Corner {
+    vertex: u32,
+    position: vec3f,
+    normal: vec3f,
+    edge_mask: vec3f,
+};
+
+@group(0) @binding(0) var<uniform> camera: Camera;
+@group(1) @binding(0) var<uniform> uVmUniforms: VisualMeshUniforms;
+@group(1) @binding(4) var<storage, read> face_ids: array<u32>;
+@group(2) @binding(1) var colormap: texture_1d<f32>;
+@group(2) @binding(2) var colormap_sampler: sampler;
+
+@vertex
+fn vs_main(@builtin(vertex_index) vertex_index: u32) -> VertexOutput {
+    var out: VertexOutput;
+    let triangle_id = vertex_index / 3u;
+    let corner = vertex_index % 3u;
+    let c = fetch_corner(triangle_id, corner);
+
+    let modelPos = uVmUniforms.modelMatrix * vec4f(c.position, 1.0);
+    out.world_pos = modelPos.xyz;
+    out.position = camera.projectionMatrix * camera.viewMatrix * modelPos;
+    let world_normal = normalize((uVmUniforms.modelMatrix * vec4f(c.normal, 0.0)).xyz);
+    out.world_normal = (camera.viewMatrix * vec4f(world_normal, 0.0)).xyz;
+    out.bary = vec3f(f32(corner == 0u), f32(corner == 1u), f32(corner == 2u));
+    out.edge_mask = c.edge_mask;
+    out.view_pos = (camera.viewMatrix * modelPos).xyz;
+    out.color = uVmUniforms.meshColor.xyz;
+    out.scalar = 0.0;
+    let source = uVmUniforms.colorOptions.x;
+    if (source == 2.0) {
+        out.scalar = load_scalar(c.vertex);
+    } else if (source == 1.0 || source == 3.0) {
+        var face = triangle_id;
+        if (uVmUniforms.colorOptions.y == 1.0) {
+            face = face_ids[triangle_id];
+        }
+        if (source == 1.0) {
+            out.color = load_face_color(face);
+        } else {
+            out.scalar = load_scalar(face);
+        }
+    }
+    return out;
+}
+
+@fragment
+fn fs_main(@builtin(front_facing) is_front: bool, in: VertexOutput) -> @location(0) vec4f {
+    // Scalars are mapped to the texel centers of the colormap
+    let range = uVmUniforms.scalarRange.xy;
+    let extent = range.y - range.x;
+    let t = clamp(select(0.5, (in.scalar - range.x) / extent, extent != 0.0), 0.0, 1.0);
+    let texels = f32(textureDimensions(colormap));
+    let mapped = textureSample(colormap, colormap_sampler, (t * (texels - 1.0) + 0.5) / texels).rgb;
+    let meshColor = select(in.color, mapped, uVmUniforms.colorOptions.x >= 2.0);
+
+    let final_color = shade_mesh(is_front, in.world_normal, in.view_pos, meshColor, in.bary, in.edge_mask,
+                                 uVmUniforms.wireframeColor.xyz, uVmUniforms.options);
+    if (final_color.a < 0.05) {
+        discard;
+    }
+
+    return final_color;
+}
+)shader";
+// VisualMeshBatch, many meshes in one draw. The geometry of all meshes is concatenated in the
+// full format, the w component of a triangle holds the edge mask in the low 3 bits and the
+// object id above. Per-object data is read from a storage buffer instead of a uniform.
+inline const char* visualMeshBatchCode = R"shader(
+struct VertexOutput {
+    @builtin(position) position: vec4f,
+    @location(0) bary: vec3f,
+    @location(1) edge_mask: vec3f,
+    @location(2) world_normal: vec3f,
+    @location(3) view_pos: vec3f,
+    @location(4) @interpolate(flat) object_id: u32,
+};
+
+struct Camera {
+    projectionMatrix: mat4x4f,
+    viewMatrix: mat4x4f,
+};
+
+struct BatchObject {
+    modelMatrix: mat4x4f,
+    meshColor: vec4f,
+    wireframeColor: vec4f,
+    options: vec4f,
+};
+
+@group(0) @binding(0) var<uniform> camera: Camera;
+@group(1) @binding(0) var<storage, read> objects: array<BatchObject>;
+@group(1) @binding(1) var<storage, read> positions: array<f32>;
+@group(1) @binding(2) var<storage, read> normals: array<f32>;
+@group(1) @binding(3) var<storage, read> triangles: array<vec4u>;
+
+@vertex
+fn vs_main(@builtin(vertex_index) vertex_index: u32) -> VertexOutput {
+    var out: VertexOutput;
+    let triangle_id = vertex_index / 3u;
+    let corner = vertex_index % 3u;
+    let triangle = triangles[triangle_id];
+    let object_id = triangle.w >> 3u;
+    let modelMatrix = objects[object_id].modelMatrix;
+    let options = objects[object_id].options;
+
+    // hidden objects collapse to a point outside the clip volume
+    if (options.x == 0.0 && options.z == 0.0) {
+        out.position = vec4f(0.0, 0.0, 2.0, 1.0);
+        return out;
+    }
+
+    let v = triangle[corner];
+    let position = vec3f(positions[3u * v], positions[3u * v + 1u], positions[3u * v + 2u]);
+    let normal = vec3f(normals[3u * v], normals[3u * v + 1u], normals[3u * v + 2u]);
+
+    let modelPos = modelMatrix * vec4f(position, 1.0);
+    out.position = camera.projectionMatrix * camera.viewMatrix * modelPos;
+    let world_normal = normalize((modelMatrix * vec4f(normal, 0.0)).xyz);
+    out.world_normal = (camera.viewMatrix * vec4f(world_normal, 0.0)).xyz;
+    out.bary = vec3f(f32(corner == 0u), f32(corner == 1u), f32(corner == 2u));
+    out.edge_mask = vec3f(f32(triangle.w & 1u), f32((triangle.w >> 1u) & 1u), f32((triangle.w >> 2u) & 1u));
+    out.view_pos = (camera.viewMatrix * modelPos).xyz;
+    out.object_id = object_id;
+    return out;
+}
+
+@fragment
+fn fs_main(@builtin(front_facing) is_front: bool, in: VertexOutput) -> @location(0) vec4f {
+    let o = objects[in.object_id];
+    let final_color = shade_mesh(is_front, in.world_normal, in.view_pos, o.meshColor.xyz, in.bary, in.edge_mask,
+                                 o.wireframeColor.xyz, o.options);
     if (final_color.a < 0.05) {
         discard;
     }
 
     return final_color;
 }
-)shader";
\ No newline at end of file
+)shader";
@@ -0,0 +1,288 @@
+#include "TubeNetwork.h"
+
+#include "InstancedMesh.h"
+#include "PipelineCache.h"
+#include "Primitives.h"
+#include "Renderer.h"
+#include "ShaderCode.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <string>
+
+namespace rr {
+
+const char* tubeNetworkShading = R"(
+struct VertexOutput {
+    @builtin(position) position: vec4f,
+    @location(0) view_normal: vec3f,
+    @location(1) view_pos: vec3f,
+}
+
+struct Camera {
+    projection_matrix: mat4x4f,
+    view_matrix: mat4x4f,
+}
+
+struct Uniforms {
+    color: vec4f,
+    radius: f32,
+}
+
+@group(0) @binding(0)
+var<uniform> camera: Camera;
+
+@group(1) @binding(0)
+var<uniform> uniforms: Uniforms;
+
+// Tightly packed x, y, z, the same buffer can be written directly from a std::vector<glm::vec3>
+@group(1) @binding(1)
+var<storage, read> positions: array<f32>;
+
+fn load_position(i: u32) -> vec3f {
+    return vec3f(positions[3u * i], positions[3u * i + 1u], positions[3u * i + 2u]);
+}
+
+fn to_view(world_pos: vec3f, world_normal: vec3f) -> VertexOutput {
+    var output: VertexOutput;
+    let view_pos = camera.view_matrix * vec4f(world_pos, 1.0);
+    output.position = camera.projection_matrix * view_pos;
+    output.view_pos = view_pos.xyz;
+    output.view_normal = (camera.view_matrix * vec4f(world_normal, 0.0)).xyz;
+    return output;
+}
+
+@fragment
+fn fs_main(@builtin(front_facing) is_front: bool, input: VertexOutput) -> @location(0) vec4f {
+    let normal = (f32(is_front) * 2.0 - 1.0) * normalize(input.view_normal);
+    let view_dir = normalize(-input.view_pos);
+    let result = apply_lights(normal, input.view_pos, view_dir, uniforms.color.rgb);
+    return vec4f(result, uniforms.color.a);
+}
+)";
+
+// Unit cylinder around the y axis from -0.5 to 0.5, one instance per line
+const char* tubeNetworkLineCode = R"(
+struct VertexInput {
+    @location(0) position: vec3f,
+    @location(1) normal: vec3f,
+    @location(2) line: vec2u,
+}
+
+@vertex
+fn vs_main(input: VertexInput) -> VertexOutput {
+    let p0 = load_position(input.line.x);
+    let p1 = load_position(input.line.y);
+    let d = p1 - p0;
+    let l = length(d);
+    if (l < 1e-6) {
+        // zero length lines are clipped
+        var output: VertexOutput;
+        output.position = vec4f(0.0, 0.0, 2.0, 1.0);
+        return output;
+    }
+
+    // right handed frame with the cylinder axis along the line
+    let axis = d / l;
+    let hint = select(vec3f(1.0, 0.0, 0.0), vec3f(0.0, 0.0, 1.0), abs(axis.x) > 0.9);
+    let u = normalize(cross(axis, hint));
+    let w = cross(u, axis);
+
+    let p = input.position;
+    let world_pos = 0.5 * (p0 + p1) + (p.x * u + p.z * w) * uniforms.radius + p.y * l * axis;
+    let world_normal = input.normal.x * u + input.normal.y * axis + input.normal.z * w;
+    return to_view(world_pos, world_normal);
+}
+)";
+
+// Unit sphere, one instance per vertex
+const char* tubeNetworkVertexCode = R"(
+struct VertexInput {
+    @builtin(instance_index) instance_index: u32,
+    @location(0) position: vec3f,
+    @location(1) normal: vec3f,
+}
+
+@vertex
+fn vs_main(input: VertexInput) -> VertexOutput {
+    let center = load_position(input.instance_index);
+    return to_view(center + input.position * uniforms.radius, input.normal);
+}
+)";
+
+TubeNetwork::TubeNetwork(const std::vector<glm::vec3>& positions, const std::vector<std::pair<int, int>>& lines,
+                         float radius, const glm::vec3& color, const Renderer& renderer)
+    : m_renderer(&renderer) {
+    m_uniforms.color  = glm::vec4(color, 1.0f);
+    m_uniforms.radius = radius;
+    configure_render_pipeline(positions, lines);
+}
+
+TubeNetwork::~TubeNetwork() {
+    release();
+}
+
+void TubeNetwork::release() {
+    if (m_position_buffer == nullptr) {
+        return;
+    }
+    std::array<WGPUBuffer, 5> buffers = {m_position_buffer, m_line_buffer, m_uniform_buffer, m_cylinder_buffer,
+                                         m_sphere_buffer};
+    for (WGPUBuffer buffer : buffers) {
+        wgpuBufferDestroy(buffer);
+        wgpuBufferRelease(buffer);
+    }
+    wgpuBindGroupRelease(m_bind_group);
+    m_position_buffer = nullptr;
+    m_bind_group      = nullptr;
+    // the pipelines belong to the pipeline cache
+    m_line_pipeline   = nullptr;
+    m_vertex_pipeline = nullptr;
+}
+
+void TubeNetwork::configure_render_pipeline(const std::vector<glm::vec3>&           positions,
+                                            const std::vector<std::pair<int, int>>& lines) {
+    release();
+    const Renderer& renderer = *m_renderer;
+
+    std::vector<uint32_t> line_indices;
+    line_indices.reserve(2 * lines.size());
+    for (const auto& [a, b] : lines) {
+        line_indices.push_back(uint32_t(a));
+        line_indices.push_back(uint32_t(b));
+    }
+
+    Mesh cylinder_mesh = create_cylinder(16);
+    Mesh sphere_mesh   = create_sphere(16, 16);
+    set_smooth_normals(sphere_mesh);
+    std::vector<InstancedMeshVertexAttributes> cylinder = create_vertex_attributes(cylinder_mesh);
+    std::vector<InstancedMeshVertexAttributes> sphere   = create_vertex_attributes(sphere_mesh);
+
+    m_num_positions         = uint32_t(positions.size());
+    m_num_lines             = uint32_t(lines.size());
+    m_num_cylinder_vertices = uint32_t(cylinder.size());
+    m_num_sphere_vertices   = uint32_t(sphere.size());
+
+    size_t vertex_size = sizeof(InstancedMeshVertexAttributes);
+    m_position_buffer  = create_buffer(renderer, positions.data(), positions.size() * sizeof(glm::vec3),
+                                       WGPUBufferUsage_Storage);
+    m_line_buffer      = create_buffer(renderer, line_indices.data(), line_indices.size() * sizeof(uint32_t),
+                                       WGPUBufferUsage_Vertex);
+    m_uniform_buffer   = create_buffer(renderer, nullptr, sizeof(TubeNetworkUniforms), WGPUBufferUsage_Uniform);
+    m_cylinder_buffer  = create_buffer(renderer, cylinder.data(), cylinder.size() * vertex_size,
+                                       WGPUBufferUsage_Vertex);
+    m_sphere_buffer    = create_buffer(renderer, sphere.data(), sphere.size() * vertex_size, WGPUBufferUsage_Vertex);
+    m_uniforms_dirty   = true;
+
+    std::vector<WGPUBindGroupLayoutEntry> bindings(2);
+    bindings[0].binding               = 0;
+    bindings[0].visibility            = WGPUShaderStage_Vertex | WGPUShaderStage_Fragment;
+    bindings[0].buffer.type           = WGPUBufferBindingType_Uniform;
+    bindings[0].buffer.minBindingSize = sizeof(TubeNetworkUniforms);
+    bindings[1].binding               = 1;
+    bindings[1].visibility            = WGPUShaderStage_Vertex;
+    bindings[1].buffer.type           = WGPUBufferBindingType_ReadOnlyStorage;
+
+    std::array<WGPUVertexAttribute, 3> attributes = {};
+    attributes[0].shaderLocation                  = 0;
+    attributes[0].format                          = WGPUVertexFormat_Float32x3;
+    attributes[0].offset                          = offsetof(InstancedMeshVertexAttributes, position);
+    attributes[1].shaderLocation                  = 1;
+    attributes[1].format                          = WGPUVertexFormat_Float32x3;
+    attributes[1].offset                          = offsetof(InstancedMeshVertexAttributes, normal);
+    attributes[2].shaderLocation                  = 2;
+    attributes[2].format                          = WGPUVertexFormat_Uint32x2;
+    attributes[2].offset                          = 0;
+
+    WGPUVertexBufferLayout mesh_layout = {};
+    mesh_layout.attributeCount         = 2;
+    mesh_layout.attributes             = attributes.data();
+    mesh_layout.arrayStride            = sizeof(InstancedMeshVertexAttributes);
+    mesh_layout.stepMode               = WGPUVertexStepMode_Vertex;
+
+    WGPUVertexBufferLayout line_layout = {};
+    line_layout.attributeCount         = 1;
+    line_layout.attributes             = attributes.data() + 2;
+    line_layout.arrayStride            = 2 * sizeof(uint32_t);
+    line_layout.stepMode               = WGPUVertexStepMode_Instance;
+
+    static const std::string line_source =
+        std::string(lightingShaderCode) + tubeNetworkShading + tubeNetworkLineCode;
+    static const std::string vertex_source =
+        std::string(lightingShaderCode) + tubeNetworkShading + tubeNetworkVertexCode;
+
+    RenderPipelineDescription pipeline_desc;
+    pipeline_desc.shader_source  = line_source;
+    pipeline_desc.vertex_buffers = {mesh_layout, line_layout};
+    pipeline_desc.bind_groups    = {{Renderer::camera_layout_entry()}, bindings};
+    pipeline_desc.cull_mode      = WGPUCullMode_None;
+
+    pipeline_desc.blend.color.srcFactor = WGPUBlendFactor_SrcAlpha;
+    pipeline_desc.blend.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    pipeline_desc.blend.color.operation = WGPUBlendOperation_Add;
+    pipeline_desc.blend.alpha.srcFactor = WGPUBlendFactor_Zero;
+    pipeline_desc.blend.alpha.dstFactor = WGPUBlendFactor_One;
+    pipeline_desc.blend.alpha.operation = WGPUBlendOperation_Add;
+
+    pipeline_desc.color_format = renderer.m_swap_chain_format;
+    pipeline_desc.depth_format = renderer.m_depth_texture_format;
+
+    const CachedPipeline& cached = renderer.m_pipeline_cache->get(pipeline_desc);
+    m_line_pipeline              = cached.pipeline;
+
+    // The spheres share group 1, a bind group for one layout works with the identical other one
+    pipeline_desc.shader_source  = vertex_source;
+    pipeline_desc.vertex_buffers = {mesh_layout};
+    m_vertex_pipeline            = renderer.m_pipeline_cache->get(pipeline_desc).pipeline;
+
+    std::array<WGPUBuffer, 2>         buffers = {m_uniform_buffer, m_position_buffer};
+    std::array<WGPUBindGroupEntry, 2> entries = {};
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        entries[i].binding = i;
+        entries[i].buffer  = buffers[i];
+        entries[i].offset  = 0;
+        entries[i].size    = wgpuBufferGetSize(buffers[i]);
+    }
+
+    WGPUBindGroupDescriptor bind_group_desc = {};
+    bind_group_desc.layout                  = cached.bind_group_layouts[1];
+    bind_group_desc.entryCount              = entries.size();
+    bind_group_desc.entries                 = entries.data();
+    m_bind_group                            = wgpuDeviceCreateBindGroup(renderer.m_device, &bind_group_desc);
+}
+
+void TubeNetwork::update_positions(const glm::vec3* positions, size_t count) {
+    assert(count == m_num_positions);
+    if (count > 0) {
+        wgpuQueueWriteBuffer(m_renderer->m_queue, m_position_buffer, 0, positions, count * sizeof(glm::vec3));
+    }
+}
+
+void TubeNetwork::update() {
+    if (m_uniforms_dirty) {
+        m_renderer->write_uniforms(m_uniform_buffer, &m_uniforms, sizeof(TubeNetworkUniforms));
+        m_uniforms_dirty = false;
+    }
+}
+
+void TubeNetwork::draw(RenderEncoder encoder) {
+    // Group 0 is the camera, bound by the renderer
+    if (m_num_lines > 0) {
+        encoder.set_pipeline(m_line_pipeline);
+        encoder.set_bind_group(1, m_bind_group);
+        encoder.set_vertex_buffer(0, m_cylinder_buffer, 0,
+                                  m_num_cylinder_vertices * sizeof(InstancedMeshVertexAttributes));
+        encoder.set_vertex_buffer(1, m_line_buffer, 0, m_num_lines * 2 * sizeof(uint32_t));
+        encoder.draw(m_num_cylinder_vertices, m_num_lines, 0, 0);
+    }
+    if (m_num_positions > 0) {
+        encoder.set_pipeline(m_vertex_pipeline);
+        encoder.set_bind_group(1, m_bind_group);
+        encoder.set_vertex_buffer(0, m_sphere_buffer, 0, m_num_sphere_vertices * sizeof(InstancedMeshVertexAttributes));
+        encoder.draw(m_num_sphere_vertices, m_num_positions, 0, 0);
+    }
+}
+
+} // namespace rr
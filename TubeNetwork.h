@@ -0,0 +1,81 @@
+#pragma once
+
+#include "RenderEncoder.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <webgpu/webgpu.h>
+
+namespace rr {
+
+class Renderer;
+
+struct TubeNetworkUniforms {
+    glm::vec4 color;
+    float     radius;
+    float     padding[3];
+};
+
+static_assert(sizeof(TubeNetworkUniforms) % 16 == 0);
+
+// Lines drawn as cylinders and vertices as spheres. The instances of the cylinders are the
+// endpoint indices of the lines, the vertex shader fetches the endpoints from the position
+// buffer and orients the cylinder itself. Radius and color are uniforms and moving the vertices
+// writes the position buffer and nothing else.
+class TubeNetwork {
+public:
+    TubeNetwork(const std::vector<glm::vec3>& positions, const std::vector<std::pair<int, int>>& lines, float radius,
+                const glm::vec3& color, const Renderer& renderer);
+    ~TubeNetwork();
+
+    TubeNetwork(const TubeNetwork&)            = delete;
+    TubeNetwork& operator=(const TubeNetwork&) = delete;
+
+    void release();
+
+    // Writes the uniforms if they changed
+    void update();
+
+    void draw(RenderEncoder encoder);
+
+    void set_radius(float radius) {
+        m_uniforms.radius = radius;
+        m_uniforms_dirty  = true;
+    }
+
+    void set_color(const glm::vec3& color) {
+        m_uniforms.color = glm::vec4(color, 1.0f);
+        m_uniforms_dirty = true;
+    }
+
+    // The number of vertices has to stay the same
+    void update_positions(const glm::vec3* positions, size_t count);
+
+private:
+    void configure_render_pipeline(const std::vector<glm::vec3>& positions,
+                                   const std::vector<std::pair<int, int>>& lines);
+
+    const Renderer* m_renderer = nullptr;
+
+    TubeNetworkUniforms m_uniforms       = {};
+    bool                m_uniforms_dirty = true;
+
+    uint32_t m_num_positions         = 0;
+    uint32_t m_num_lines             = 0;
+    uint32_t m_num_cylinder_vertices = 0;
+    uint32_t m_num_sphere_vertices   = 0;
+
+    WGPUBuffer         m_position_buffer = nullptr;
+    WGPUBuffer         m_line_buffer     = nullptr;
+    WGPUBuffer         m_uniform_buffer  = nullptr;
+    WGPUBuffer         m_cylinder_buffer = nullptr;
+    WGPUBuffer         m_sphere_buffer   = nullptr;
+    WGPUBindGroup      m_bind_group      = nullptr;
+    WGPURenderPipeline m_line_pipeline   = nullptr;
+    WGPURenderPipeline m_vertex_pipeline = nullptr;
+};
+
+} // namespace rr
@@ -1,10 +1,17 @@
 
 #include "Utils.h"
+#include "MappedFile.h"
 #include "Mesh.h"
+#include "Parallel.h"
 
+#include <algorithm>
 #include <array>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <sstream>
+#include <stdexcept>
 
 namespace rr {
 
@@ -76,12 +83,289 @@ Mesh load_mesh(std::istream& input_file) {
     return mesh;
 }
 
-Mesh load_mesh(std::string_view path) {
-    std::ifstream input_file(std::string{path});
-    if (!input_file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + std::string(path));
+namespace {
+
+// Per-chunk parse result. Face corners are stored flattened, faces only record their size
+// and which optional index streams they carry. Indices are zero based. Negative (relative)
+// OBJ indices can only be resolved against the element counts of the whole file, so they
+// are stored relative to the chunk start, tagged with RelativeIndex, and fixed up during
+// the merge. They may point into a previous chunk, i.e. be negative before the fixup.
+struct ObjChunk {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;
+
+    std::vector<int64_t>  position_indices;
+    std::vector<int64_t>  uv_indices;
+    std::vector<int64_t>  normal_indices;
+    std::vector<uint32_t> face_sizes;
+    std::vector<uint8_t>  face_flags;
+
+    size_t num_uv_faces     = 0;
+    size_t num_normal_faces = 0;
+};
+
+enum : uint8_t { FaceHasUvs = 1, FaceHasNormals = 2 };
+
+constexpr int64_t RelativeIndex = int64_t(1) << 62;
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char* skip_spaces(const char* p, const char* end) {
+    while (p < end && is_space(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+inline const char* parse_float(const char* p, const char* end, float& out) {
+    p = skip_spaces(p, end);
+    if (p < end && *p == '+') {
+        ++p;
+    }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    auto result = std::from_chars(p, end, out);
+    if (result.ec != std::errc()) {
+        out = 0.0f;
+    }
+    return result.ptr;
+#else
+    // No floating point from_chars in this standard library. strtof needs a terminated
+    // string, which the mapping does not provide, so copy the token to the stack.
+    char        buffer[64];
+    const char* token_end = p;
+    while (token_end < end && !is_space(*token_end) && token_end - p < 63) {
+        ++token_end;
+    }
+    size_t length = size_t(token_end - p);
+    std::memcpy(buffer, p, length);
+    buffer[length] = '\0';
+    char* parsed_end;
+    out = std::strtof(buffer, &parsed_end);
+    return p + (parsed_end - buffer);
+#endif
+}
+
+// Parses one index of a face corner. Returns false if there is no number at p.
+inline bool parse_index(const char*& p, const char* end, size_t local_count, int64_t& out) {
+    int64_t value  = 0;
+    auto    result = std::from_chars(p, end, value);
+    if (result.ec != std::errc() || value == 0) {
+        return false;
+    }
+    p   = result.ptr;
+    out = value > 0 ? value - 1 : RelativeIndex + int64_t(local_count) + value;
+    return true;
+}
+
+void parse_face(const char* p, const char* end, ObjChunk& chunk) {
+    size_t   first_uv     = chunk.uv_indices.size();
+    size_t   first_normal = chunk.normal_indices.size();
+    uint32_t num_corners  = 0;
+
+    while (true) {
+        p = skip_spaces(p, end);
+        if (p >= end) {
+            break;
+        }
+        int64_t index;
+        if (!parse_index(p, end, chunk.positions.size(), index)) {
+            break;
+        }
+        chunk.position_indices.push_back(index);
+        ++num_corners;
+
+        if (p < end && *p == '/') {
+            ++p;
+            if (parse_index(p, end, chunk.uvs.size(), index)) {
+                chunk.uv_indices.push_back(index);
+            }
+            if (p < end && *p == '/') {
+                ++p;
+                if (parse_index(p, end, chunk.normals.size(), index)) {
+                    chunk.normal_indices.push_back(index);
+                }
+            }
+        }
+        // skip whatever is left of a malformed corner
+        while (p < end && !is_space(*p)) {
+            ++p;
+        }
+    }
+
+    // A uv or normal face is only kept if every corner referenced one
+    uint8_t flags = 0;
+    if (chunk.uv_indices.size() - first_uv == num_corners && num_corners > 0) {
+        flags |= FaceHasUvs;
+        ++chunk.num_uv_faces;
+    } else {
+        chunk.uv_indices.resize(first_uv);
     }
-    return load_mesh(input_file);
+    if (chunk.normal_indices.size() - first_normal == num_corners && num_corners > 0) {
+        flags |= FaceHasNormals;
+        ++chunk.num_normal_faces;
+    } else {
+        chunk.normal_indices.resize(first_normal);
+    }
+
+    chunk.face_sizes.push_back(num_corners);
+    chunk.face_flags.push_back(flags);
+}
+
+void parse_obj_chunk(const char* p, const char* end, ObjChunk& chunk) {
+    while (p < end) {
+        const char* line_end = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+        if (line_end == nullptr) {
+            line_end = end;
+        }
+
+        const char* q = skip_spaces(p, line_end);
+        if (line_end - q >= 2) {
+            if (q[0] == 'v' && is_space(q[1])) {
+                glm::vec3 position;
+                q = parse_float(q + 1, line_end, position.x);
+                q = parse_float(q, line_end, position.y);
+                parse_float(q, line_end, position.z);
+                chunk.positions.push_back(position);
+            } else if (q[0] == 'v' && q[1] == 't') {
+                glm::vec2 uv;
+                q = parse_float(q + 2, line_end, uv.x);
+                parse_float(q, line_end, uv.y);
+                chunk.uvs.push_back(uv);
+            } else if (q[0] == 'v' && q[1] == 'n') {
+                glm::vec3 normal;
+                q = parse_float(q + 2, line_end, normal.x);
+                q = parse_float(q, line_end, normal.y);
+                parse_float(q, line_end, normal.z);
+                chunk.normals.push_back(normal);
+            } else if (q[0] == 'f' && is_space(q[1])) {
+                parse_face(q + 1, line_end, chunk);
+            }
+        }
+
+        p = line_end + 1;
+    }
+}
+
+inline uint32_t resolve_index(int64_t index, size_t base) {
+    return index < RelativeIndex / 2 ? uint32_t(index) : uint32_t(int64_t(base) + (index - RelativeIndex));
+}
+
+} // namespace
+
+Mesh parse_obj(const char* data, size_t size) {
+    // Split the input into newline aligned chunks of at least 1 MB and parse them in parallel
+    size_t num_chunks = std::min(num_worker_threads(), size / (size_t(1) << 20) + 1);
+
+    std::vector<const char*> bounds(num_chunks + 1);
+    bounds[0]          = data;
+    bounds[num_chunks] = data + size;
+    for (size_t c = 1; c < num_chunks; ++c) {
+        const char* p = std::max(data + c * (size / num_chunks), bounds[c - 1]);
+        const char* n = static_cast<const char*>(std::memchr(p, '\n', size_t(data + size - p)));
+        bounds[c]     = n ? n + 1 : data + size;
+    }
+
+    std::vector<ObjChunk> chunks(num_chunks);
+    parallel_for(
+        0, num_chunks,
+        [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; ++c) {
+                parse_obj_chunk(bounds[c], bounds[c + 1], chunks[c]);
+            }
+        },
+        1);
+
+    // Prefix sums give every chunk its place in the merged arrays
+    struct Offsets {
+        size_t positions = 0, normals = 0, uvs = 0, faces = 0, uv_faces = 0, normal_faces = 0;
+        size_t corners = 0, uv_corners = 0, normal_corners = 0;
+    };
+    std::vector<Offsets> offsets(num_chunks + 1);
+    for (size_t c = 0; c < num_chunks; ++c) {
+        offsets[c + 1].positions    = offsets[c].positions + chunks[c].positions.size();
+        offsets[c + 1].normals      = offsets[c].normals + chunks[c].normals.size();
+        offsets[c + 1].uvs          = offsets[c].uvs + chunks[c].uvs.size();
+        offsets[c + 1].faces        = offsets[c].faces + chunks[c].face_sizes.size();
+        offsets[c + 1].uv_faces     = offsets[c].uv_faces + chunks[c].num_uv_faces;
+        offsets[c + 1].normal_faces = offsets[c].normal_faces + chunks[c].num_normal_faces;
+
+        offsets[c + 1].corners        = offsets[c].corners + chunks[c].position_indices.size();
+        offsets[c + 1].uv_corners     = offsets[c].uv_corners + chunks[c].uv_indices.size();
+        offsets[c + 1].normal_corners = offsets[c].normal_corners + chunks[c].normal_indices.size();
+    }
+
+    Mesh           mesh;
+    const Offsets& total = offsets[num_chunks];
+    mesh.positions.resize(total.positions);
+    mesh.normals.resize(total.normals);
+    mesh.uvs.resize(total.uvs);
+
+    // The faces are written as CSR arrays, every chunk fills its own ranges
+    struct FaceArrays {
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> offsets;
+
+        FaceArrays(size_t num_faces, size_t num_corners) : indices(num_corners), offsets(num_faces + 1) {
+            offsets[num_faces] = uint32_t(num_corners);
+        }
+    };
+    FaceArrays position_faces(total.faces, total.corners);
+    FaceArrays uv_faces(total.uv_faces, total.uv_corners);
+    FaceArrays normal_faces(total.normal_faces, total.normal_corners);
+
+    parallel_for(
+        0, num_chunks,
+        [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; ++c) {
+                const ObjChunk& chunk = chunks[c];
+                const Offsets&  off   = offsets[c];
+
+                std::copy(chunk.positions.begin(), chunk.positions.end(), mesh.positions.begin() + off.positions);
+                std::copy(chunk.normals.begin(), chunk.normals.end(), mesh.normals.begin() + off.normals);
+                std::copy(chunk.uvs.begin(), chunk.uvs.end(), mesh.uvs.begin() + off.uvs);
+
+                for (size_t i = 0; i < chunk.position_indices.size(); ++i) {
+                    position_faces.indices[off.corners + i] = resolve_index(chunk.position_indices[i], off.positions);
+                }
+                for (size_t i = 0; i < chunk.uv_indices.size(); ++i) {
+                    uv_faces.indices[off.uv_corners + i] = resolve_index(chunk.uv_indices[i], off.uvs);
+                }
+                for (size_t i = 0; i < chunk.normal_indices.size(); ++i) {
+                    normal_faces.indices[off.normal_corners + i] = resolve_index(chunk.normal_indices[i], off.normals);
+                }
+
+                size_t corner = off.corners, uv_corner = off.uv_corners, normal_corner = off.normal_corners;
+                size_t uv_face = off.uv_faces, normal_face = off.normal_faces;
+                for (size_t f = 0; f < chunk.face_sizes.size(); ++f) {
+                    uint32_t n = chunk.face_sizes[f];
+
+                    position_faces.offsets[off.faces + f] = uint32_t(corner);
+                    corner += n;
+                    if (chunk.face_flags[f] & FaceHasUvs) {
+                        uv_faces.offsets[uv_face++] = uint32_t(uv_corner);
+                        uv_corner += n;
+                    }
+                    if (chunk.face_flags[f] & FaceHasNormals) {
+                        normal_faces.offsets[normal_face++] = uint32_t(normal_corner);
+                        normal_corner += n;
+                    }
+                }
+            }
+        },
+        1);
+
+    mesh.position_faces.assign(std::move(position_faces.indices), std::move(position_faces.offsets));
+    mesh.uv_faces.assign(std::move(uv_faces.indices), std::move(uv_faces.offsets));
+    mesh.normal_faces.assign(std::move(normal_faces.indices), std::move(normal_faces.offsets));
+    return mesh;
+}
+
+Mesh load_mesh(std::string_view path) {
+    MappedFile file(path);
+    return parse_obj(file.data(), file.size());
 }
 
 void load_mesh(std::string_view path, std::vector<glm::vec3>& positions,
@@ -121,9 +405,9 @@ void save_obj(std::string_view path, const Mesh& mesh) {
 
     for (size_t i = 0; i < mesh.num_faces(); ++i) {
         file << "f ";
-        const auto& pos_face    = mesh.position_faces[i];
-        const auto& normal_face = !mesh.normal_faces.empty() ? mesh.normal_faces[i] : Mesh::Face();
-        const auto& uv_face     = !mesh.uv_faces.empty() ? mesh.uv_faces[i] : Mesh::Face();
+        auto pos_face    = mesh.position_faces[i];
+        auto normal_face = !mesh.normal_faces.empty() ? mesh.normal_faces[i] : FaceList::ConstFace();
+        auto uv_face     = !mesh.uv_faces.empty() ? mesh.uv_faces[i] : FaceList::ConstFace();
 
         for (size_t j = 0; j < pos_face.size(); ++j) {
             file << (pos_face[j] + 1);
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "glm/fwd.hpp"
+#include <array>
+#include <istream>
 #include <string_view>
 #include <vector>
 
@@ -11,8 +13,13 @@ struct Mesh;
 void load_mesh(std::string_view path, std::vector<glm::vec3>& positions,
                std::vector<std::array<uint32_t, 3>>& triangles);
 
+// Memory maps the OBJ file and parses it in parallel.
 Mesh load_mesh(std::string_view path);
 
+// Parses OBJ text that is already in memory, e.g. a mapped file or an embedded string.
+Mesh parse_obj(const char* data, size_t size);
+
+// Line by line stream parser, slower than the path overload but works on any istream.
 Mesh load_mesh(std::istream& stream);
 
 void save_obj(std::string_view path, const Mesh& mesh);
@@ -1,352 +1,522 @@
 #include "VisualMesh.h"
 
 #include "Camera.h"
+#include "Colormap.h"
 #include "InstancedMesh.h"
 #include "Mesh.h"
+#include "NormalCompute.h"
+#include "Parallel.h"
+#include "PipelineCache.h"
 #include "Primitives.h"
 #include "Property.h"
 #include "Renderer.h"
 #include "ShaderCode.h"
 #include "Utils.h"
 
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <iostream>
+#include <limits>
 
 namespace rr {
 
-static std::vector<VisualMeshVertexAttributes> create_vertex_attributes(const Mesh& mesh, glm::vec3 color) {
-    std::vector<VisualMeshVertexAttributes> vertex_attributes;
-    vertex_attributes.reserve(3 * mesh.num_faces());
+VisualMeshLayout create_vertex_layout(const Mesh& mesh) {
+    VisualMeshLayout layout;
 
     assert(!mesh.normal_faces.empty());
 
+    constexpr uint32_t invalid = std::numeric_limits<uint32_t>::max();
+
+    // Most meshes use at most one normal per position (smooth normals share the position
+    // topology), so the first vertex of every position is found with a direct lookup. Only
+    // positions with several normals fall back to the hash map.
+    std::vector<uint32_t>                  first_vertex(mesh.num_vertices(), invalid);
+    std::unordered_map<uint64_t, uint32_t> split_vertices;
+
+    auto get_vertex = [&](uint32_t p, uint32_t n) -> uint32_t {
+        uint32_t v = first_vertex[p];
+        if (v == invalid) {
+            v               = uint32_t(layout.positions.size());
+            first_vertex[p] = v;
+        } else if (layout.normal_ids[v] == n) {
+            return v;
+        } else {
+            uint64_t key = (uint64_t(p) << 32) | n;
+            auto [it, inserted] = split_vertices.try_emplace(key, uint32_t(layout.positions.size()));
+            if (!inserted) {
+                return it->second;
+            }
+            v = it->second;
+        }
+        layout.positions.push_back(mesh.positions[p]);
+        layout.normals.push_back(mesh.normals[n]);
+        layout.position_ids.push_back(p);
+        layout.normal_ids.push_back(n);
+        return v;
+    };
+
     size_t num_faces = mesh.num_faces();
+    layout.face_offsets.resize(num_faces + 1);
+    layout.face_offsets[0] = 0;
+    for (size_t i = 0; i < num_faces; ++i) {
+        layout.face_offsets[i + 1] = layout.face_offsets[i] + uint32_t(mesh.position_faces[i].size() - 2);
+    }
+    layout.triangles.reserve(layout.face_offsets[num_faces]);
+    layout.positions.reserve(mesh.num_vertices());
+    layout.normals.reserve(mesh.num_vertices());
+    layout.position_ids.reserve(mesh.num_vertices());
+    layout.normal_ids.reserve(mesh.num_vertices());
+
     for (size_t i = 0; i < num_faces; ++i) {
         const auto& f  = mesh.position_faces[i];
         const auto& nf = mesh.normal_faces[i];
 
         // For faces with more than 3 vertices, we need to triangulate
         // We use fan triangulation: connect first vertex to all other vertices in sequence
-        size_t num_triangles = f.size() - 2;
+        size_t   num_triangles = f.size() - 2;
+        uint32_t center        = get_vertex(f[0], nf[0]);
 
         for (size_t j = 0; j < num_triangles; ++j) {
-            // For each triangle in the fan, we need to determine which edges are real
-            // and which are internal triangulation edges
-
-            // A triangle has vertices: center(0), j+1, j+2
-            // An edge is real if:
-            // - It's part of the original face boundary
-            // - For fan triangulation, this means either:
-            //   a) It connects to consecutive vertices in the original face
-            //   b) It's the first or last edge connected to the center vertex
-
-            glm::vec3 edge_mask(1.0f);
-
-            edge_mask[0] = 0.0f;
-
-            if (j == num_triangles - 1) {
-                edge_mask[1] = 0.0f;
+            // A triangle has vertices: center(0), j+1, j+2. The edge opposite to corner 0 is
+            // always part of the face boundary, the edges adjacent to the center vertex are
+            // only real for the first and last triangle of the fan.
+            uint32_t edge_mask = 0;
+            if (j != num_triangles - 1) {
+                edge_mask |= 2u;
             }
-
-            if (j == 0) {
-                edge_mask[2] = 0.0f;
+            if (j != 0) {
+                edge_mask |= 4u;
             }
 
-            vertex_attributes.push_back({mesh.positions[f[0]], mesh.normals[nf[0]],
-                                         glm::vec3(1.0f, 0.0f, 0.0f), // Barycentric coordinates (1,0,0)
-                                         edge_mask, color});
-
-            vertex_attributes.push_back({mesh.positions[f[j + 1]], mesh.normals[nf[j + 1]],
-                                         glm::vec3(0.0f, 1.0f, 0.0f), // Barycentric coordinates (0,1,0)
-                                         edge_mask, color});
-
-            vertex_attributes.push_back({mesh.positions[f[j + 2]], mesh.normals[nf[j + 2]],
-                                         glm::vec3(0.0f, 0.0f, 1.0f), // Barycentric coordinates (0,0,1)
-                                         edge_mask, color});
+            layout.triangles.emplace_back(center, get_vertex(f[j + 1], nf[j + 1]), get_vertex(f[j + 2], nf[j + 2]),
+                                          edge_mask);
         }
     }
 
-    return vertex_attributes;
+    return layout;
 }
 
-VisualMesh::VisualMesh(const Mesh& mesh, const Renderer& renderer)
-    : Drawable(&renderer, BoundingBox(mesh.positions)), m_mesh(mesh) {
-
-    configure_render_pipeline();
+// Octahedral encoding of a normal, the inverse of oct_decode in the compact shader
+static uint32_t encode_octahedral(const glm::vec3& n) {
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 == 0.0f) {
+        return glm::packSnorm2x16(glm::vec2(0.0f));
+    }
+    glm::vec3 p = n / l1;
+    glm::vec2 e(p.x, p.y);
+    if (p.z < 0.0f) {
+        e = (1.0f - glm::abs(glm::vec2(p.y, p.x))) *
+            glm::vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return glm::packSnorm2x16(e);
 }
 
-void VisualMesh::release() {
-    // Release resources
-    if (m_vertex_buffer == nullptr) {
-        return;
+// Compact positions are quantized relative to the bounding box
+static void quantization_range(const BoundingBox& bbox, glm::vec3& offset, glm::vec3& scale) {
+    offset = bbox.lower;
+    scale  = bbox.upper - bbox.lower;
+    for (int i = 0; i < 3; ++i) {
+        // flat meshes have a zero extent along one axis
+        if (!(scale[i] > 0.0f)) {
+            scale[i] = 1.0f;
+        }
     }
-    wgpuBufferDestroy(m_vertex_buffer);
-    wgpuBufferRelease(m_vertex_buffer);
-    wgpuBufferDestroy(m_uniform_buffer);
-    wgpuBufferRelease(m_uniform_buffer);
-    wgpuBindGroupRelease(m_bind_group);
-    wgpuRenderPipelineRelease(m_pipeline);
 }
 
-VisualMesh::~VisualMesh() {
-    release();
+static void encode_position(const glm::vec3& p, const glm::vec3& offset, const glm::vec3& scale, uint32_t* out) {
+    glm::vec3 q = (p - offset) / scale;
+    out[0]      = glm::packUnorm2x16(glm::vec2(q.x, q.y));
+    out[1]      = glm::packUnorm2x16(glm::vec2(q.z, 0.0f));
 }
 
-void shaderCompilationCallback(WGPUCompilationInfoRequestStatus, WGPUCompilationInfo const* compilation_info, void*,
-                               void*) {
-    if (compilation_info) {
-        for (uint32_t i = 0; i < compilation_info->messageCount; ++i) {
-            WGPUCompilationMessage const& message = compilation_info->messages[i];
-
-            const char* message_type;
-            switch (message.type) {
-            case WGPUCompilationMessageType_Error:
-                message_type = "Error";
-                break;
-            case WGPUCompilationMessageType_Warning:
-                message_type = "Warning";
-                break;
-            case WGPUCompilationMessageType_Info:
-                message_type = "Info";
-                break;
-            default:
-                message_type = "Unknown";
-                break;
-            }
+CompactVisualMeshLayout compress_vertex_layout(const VisualMeshLayoutView& layout, const BoundingBox& bbox) {
+    CompactVisualMeshLayout compact;
+    quantization_range(bbox, compact.position_offset, compact.position_scale);
 
-            std::cerr << message_type << " at line " << message.lineNum << ", column " << message.linePos << ": "
-                      << to_string(message.message) << std::endl;
+    compact.positions.resize(2 * layout.num_vertices);
+    compact.normals.resize(layout.num_vertices);
+    for (size_t i = 0; i < layout.num_vertices; ++i) {
+        uint32_t* position = &compact.positions[2 * i];
+        encode_position(layout.positions[i], compact.position_offset, compact.position_scale, position);
+        compact.normals[i] = encode_octahedral(layout.normals[i]);
+    }
+
+    assert(layout.num_vertices < (size_t(1) << 31));
+    compact.triangles.resize(3 * layout.num_triangles);
+    for (size_t i = 0; i < layout.num_triangles; ++i) {
+        const glm::uvec4& t = layout.triangles[i];
+        for (int k = 0; k < 3; ++k) {
+            compact.triangles[3 * i + k] = t[k] | (((t.w >> k) & 1u) << 31);
         }
     }
+    return compact;
 }
 
-WGPUShaderModule createShaderModule(WGPUDevice device, const char* shader_source) {
-    WGPUShaderModuleDescriptor     shader_desc{};
-    WGPUShaderModuleWGSLDescriptor shader_code_desc{};
-
-    shader_code_desc.chain.next  = nullptr;
-    shader_code_desc.chain.sType = WGPUSType_ShaderSourceWGSL;
-    shader_desc.nextInChain      = &shader_code_desc.chain;
-    shader_code_desc.code        = to_string_view(shader_source);
-
-    WGPUShaderModule shader_module = wgpuDeviceCreateShaderModule(device, &shader_desc);
-
-    WGPUCompilationInfoCallbackInfo callback_info = {};
-    callback_info.callback                        = shaderCompilationCallback;
-    callback_info.mode                            = WGPUCallbackMode_AllowSpontaneous;
-
-    wgpuShaderModuleGetCompilationInfo(shader_module, callback_info);
-
-    return shader_module;
+// Same as the normals of set_flat_normals
+static glm::vec3 face_normal(const Mesh& mesh, size_t f) {
+    auto      face = mesh.position_faces[f];
+    glm::vec3 e1   = mesh.positions[face[1]] - mesh.positions[face[0]];
+    glm::vec3 e2   = mesh.positions[face[2]] - mesh.positions[face[0]];
+    return glm::normalize(glm::cross(e1, e2));
 }
 
-void VisualMesh::configure_render_pipeline() {
-    release();
-    const Renderer& renderer = *m_renderer;
-
-    m_vertex_attributes = create_vertex_attributes(m_mesh, m_mesh_color);
-
-    WGPUShaderModule shader_module = createShaderModule(renderer.m_device, shaderCode);
-
-    // Vertex fetch
-    std::vector<WGPUVertexAttribute> vertex_attribs(5);
-
-    // Position attribute
-    vertex_attribs[0].shaderLocation = 0;
-    vertex_attribs[0].format         = WGPUVertexFormat_Float32x3;
-    vertex_attribs[0].offset         = 0;
-
-    // Normal attribute
-    vertex_attribs[1].shaderLocation = 1;
-    vertex_attribs[1].format         = WGPUVertexFormat_Float32x3;
-    vertex_attribs[1].offset         = offsetof(VisualMeshVertexAttributes, normal);
+// Finds out whether the normals of a mesh are the result of set_flat_normals or set_smooth_normals
+static NormalMode detect_normal_mode(const Mesh& mesh) {
+    size_t num_faces = mesh.num_faces();
+    if (mesh.normal_faces.size() != num_faces) {
+        return NormalMode::Keep;
+    }
+    bool flat   = mesh.normals.size() == num_faces;
+    bool smooth = mesh.normals.size() == mesh.num_vertices();
+    for (size_t f = 0; f < num_faces && (flat || smooth); ++f) {
+        auto nf = mesh.normal_faces[f];
+        auto pf = mesh.position_faces[f];
+        for (size_t k = 0; k < nf.size(); ++k) {
+            flat   = flat && nf[k] == f;
+            smooth = smooth && nf.size() == pf.size() && nf[k] == pf[k];
+        }
+    }
+    return flat ? NormalMode::Flat : smooth ? NormalMode::Smooth : NormalMode::Keep;
+}
 
-    // Bary attribute
-    vertex_attribs[2].shaderLocation = 2;
-    vertex_attribs[2].format         = WGPUVertexFormat_Float32x3;
-    vertex_attribs[2].offset         = offsetof(VisualMeshVertexAttributes, bary);
+MeshPropertyDefaults::MeshPropertyDefaults(const Renderer& renderer) : m_device(renderer.m_device) {
+    std::vector<WGPUBindGroupLayoutEntry> entries     = layout_entries();
+    WGPUBindGroupLayoutDescriptor         layout_desc = {};
+    layout_desc.entryCount                            = entries.size();
+    layout_desc.entries                               = entries.data();
+    m_layout = wgpuDeviceCreateBindGroupLayout(m_device, &layout_desc);
+
+    WGPUSamplerDescriptor sampler_desc = {};
+    sampler_desc.addressModeU          = WGPUAddressMode_ClampToEdge;
+    sampler_desc.addressModeV          = WGPUAddressMode_ClampToEdge;
+    sampler_desc.addressModeW          = WGPUAddressMode_ClampToEdge;
+    sampler_desc.magFilter             = WGPUFilterMode_Linear;
+    sampler_desc.minFilter             = WGPUFilterMode_Linear;
+    sampler_desc.mipmapFilter          = WGPUMipmapFilterMode_Nearest;
+    sampler_desc.lodMinClamp           = 0.0f;
+    sampler_desc.lodMaxClamp           = 1.0f;
+    sampler_desc.compare               = WGPUCompareFunction_Undefined;
+    sampler_desc.maxAnisotropy         = 1;
+    m_sampler                          = wgpuDeviceCreateSampler(m_device, &sampler_desc);
+
+    m_data          = create_buffer(renderer, nullptr, 0, WGPUBufferUsage_Storage);
+    m_colormap      = create_colormap_texture(m_device, renderer.m_queue, Colormap::Viridis);
+    m_colormap_view = wgpuTextureCreateView(m_colormap, nullptr);
+    m_bind_group    = create_bind_group(m_data, m_colormap_view);
+}
 
-    // Edge mask attribute
-    vertex_attribs[3].shaderLocation = 3;
-    vertex_attribs[3].format         = WGPUVertexFormat_Float32x3;
-    vertex_attribs[3].offset         = offsetof(VisualMeshVertexAttributes, edge_mask);
+MeshPropertyDefaults::~MeshPropertyDefaults() {
+    wgpuBindGroupRelease(m_bind_group);
+    wgpuTextureViewRelease(m_colormap_view);
+    wgpuTextureDestroy(m_colormap);
+    wgpuTextureRelease(m_colormap);
+    wgpuBufferDestroy(m_data);
+    wgpuBufferRelease(m_data);
+    wgpuSamplerRelease(m_sampler);
+    wgpuBindGroupLayoutRelease(m_layout);
+}
 
-    vertex_attribs[4].shaderLocation = 4;
-    vertex_attribs[4].format         = WGPUVertexFormat_Float32x3;
-    vertex_attribs[4].offset         = offsetof(VisualMeshVertexAttributes, color);
+std::vector<WGPUBindGroupLayoutEntry> MeshPropertyDefaults::layout_entries() {
+    std::vector<WGPUBindGroupLayoutEntry> entries(3);
+    entries[0].binding               = 0;
+    entries[0].visibility            = WGPUShaderStage_Vertex;
+    entries[0].buffer.type           = WGPUBufferBindingType_ReadOnlyStorage;
+    entries[1].binding               = 1;
+    entries[1].visibility            = WGPUShaderStage_Fragment;
+    entries[1].texture.sampleType    = WGPUTextureSampleType_Float;
+    entries[1].texture.viewDimension = WGPUTextureViewDimension_1D;
+    entries[2].binding               = 2;
+    entries[2].visibility            = WGPUShaderStage_Fragment;
+    entries[2].sampler.type          = WGPUSamplerBindingType_Filtering;
+    return entries;
+}
 
-    WGPUVertexBufferLayout vertex_buffer_layout = {};
-    vertex_buffer_layout.attributeCount         = (uint32_t)vertex_attribs.size();
-    vertex_buffer_layout.attributes             = vertex_attribs.data();
-    vertex_buffer_layout.arrayStride            = sizeof(VisualMeshVertexAttributes);
+WGPUBindGroup MeshPropertyDefaults::create_bind_group(WGPUBuffer buffer, WGPUTextureView colormap) const {
+    std::array<WGPUBindGroupEntry, 3> bindings = {};
+    bindings[0].binding                        = 0;
+    bindings[0].buffer                         = buffer;
+    bindings[0].offset                         = 0;
+    bindings[0].size                           = wgpuBufferGetSize(buffer);
+    bindings[1].binding                        = 1;
+    bindings[1].textureView                    = colormap;
+    bindings[2].binding                        = 2;
+    bindings[2].sampler                        = m_sampler;
 
-    vertex_buffer_layout.stepMode = WGPUVertexStepMode_Vertex;
+    WGPUBindGroupDescriptor bind_group_desc = {};
+    bind_group_desc.layout                  = m_layout;
+    bind_group_desc.entryCount              = bindings.size();
+    bind_group_desc.entries                 = bindings.data();
+    return wgpuDeviceCreateBindGroup(m_device, &bind_group_desc);
+}
 
-    WGPURenderPipelineDescriptor pipeline_desc = {};
+VisualMesh::VisualMesh(const Mesh& mesh, const Renderer& renderer, VisualMeshVertexFormat format)
+    : Drawable(&renderer, BoundingBox(mesh.positions)), m_mesh(mesh), m_vertex_format(format),
+      m_normal_mode(detect_normal_mode(mesh)) {
 
-    pipeline_desc.vertex.bufferCount = 1;
-    pipeline_desc.vertex.buffers     = &vertex_buffer_layout;
+    configure_render_pipeline();
+}
 
-    pipeline_desc.vertex.module        = shader_module;
-    pipeline_desc.vertex.entryPoint    = to_string_view("vs_main");
-    pipeline_desc.vertex.constantCount = 0;
-    pipeline_desc.vertex.constants     = nullptr;
+VisualMesh::VisualMesh(Mesh mesh, const VisualMeshLayoutView& layout, const Renderer& renderer,
+                       VisualMeshVertexFormat format)
+    : Drawable(&renderer, BoundingBox(mesh.positions)), m_mesh(std::move(mesh)), m_vertex_format(format),
+      m_normal_mode(detect_normal_mode(m_mesh)) {
+    assert(layout.num_faces == m_mesh.num_faces());
+    m_face_offsets.assign(layout.face_offsets, layout.face_offsets + layout.num_faces + 1);
+    m_position_ids.assign(layout.position_ids, layout.position_ids + layout.num_vertices);
+    m_normal_ids.assign(layout.normal_ids, layout.normal_ids + layout.num_vertices);
+    configure_render_pipeline(layout);
+}
 
-    pipeline_desc.primitive.topology         = WGPUPrimitiveTopology_TriangleList;
-    pipeline_desc.primitive.stripIndexFormat = WGPUIndexFormat_Undefined;
-    pipeline_desc.primitive.frontFace        = WGPUFrontFace_CCW;
-    pipeline_desc.primitive.cullMode         = WGPUCullMode_None;
+void VisualMesh::release() {
+    // Release resources, the normal compute binds the vertex buffers
+    m_normal_compute.reset();
+    if (m_position_buffer == nullptr) {
+        return;
+    }
+    for (WGPUBuffer buffer :
+         {m_position_buffer, m_normal_buffer, m_triangle_buffer, m_face_id_buffer, m_uniform_buffer}) {
+        wgpuBufferDestroy(buffer);
+        wgpuBufferRelease(buffer);
+    }
+    wgpuBindGroupRelease(m_bind_group);
+    // the pipeline and the layouts belong to the pipeline cache
+    m_pipeline        = nullptr;
+    m_position_buffer = nullptr;
 
-    WGPUFragmentState fragment_state = {};
-    pipeline_desc.fragment           = &fragment_state;
-    fragment_state.module            = shader_module;
-    fragment_state.entryPoint        = to_string_view("fs_main");
-    fragment_state.constantCount     = 0;
-    fragment_state.constants         = nullptr;
+    // property buffers depend on the vertex format and the vertex layout, they are recreated
+    // on demand
+    for (auto& [name, prop] : m_color_properties) {
+        prop->release();
+    }
+    for (auto& [name, prop] : m_scalar_properties) {
+        prop->release();
+    }
+}
 
-    WGPUBlendState blend_state  = {};
-    blend_state.color.srcFactor = WGPUBlendFactor_SrcAlpha;
-    blend_state.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
-    blend_state.color.operation = WGPUBlendOperation_Add;
+VisualMesh::~VisualMesh() {
+    release();
+}
 
-    blend_state.alpha.srcFactor = WGPUBlendFactor_One;
-    blend_state.alpha.dstFactor = WGPUBlendFactor_Zero;
-    blend_state.alpha.operation = WGPUBlendOperation_Add;
+void VisualMesh::configure_render_pipeline() {
+    VisualMeshLayout     layout = create_vertex_layout(m_mesh);
+    VisualMeshLayoutView view(layout);
+    // moving keeps the storage of the arrays, so the view stays valid
+    m_face_offsets = std::move(layout.face_offsets);
+    m_position_ids = std::move(layout.position_ids);
+    m_normal_ids   = std::move(layout.normal_ids);
+    configure_render_pipeline(view);
+}
 
-    WGPUColorTargetState color_target = {};
-    color_target.format               = renderer.m_swap_chain_format;
-    color_target.blend                = &blend_state;
-    color_target.writeMask            = WGPUColorWriteMask_All;
+void VisualMesh::configure_render_pipeline(const VisualMeshLayoutView& layout) {
+    release();
+    invalidate_commands();
+    const Renderer& renderer = *m_renderer;
 
-    fragment_state.targetCount = 1;
-    fragment_state.targets     = &color_target;
+    m_num_vertices  = layout.num_vertices;
+    m_num_triangles = layout.num_triangles;
 
-    WGPUDepthStencilState depth_stencil_state = {};
-    depth_stencil_state.depthCompare          = WGPUCompareFunction_Less;
-    depth_stencil_state.depthWriteEnabled     = WGPUOptionalBool_True;
-    depth_stencil_state.format                = renderer.m_depth_texture_format;
-    depth_stencil_state.stencilReadMask       = 0;
-    depth_stencil_state.stencilWriteMask      = 0;
+    // Triangles only need to look up their face if the mesh has polygons
+    size_t                num_faces = m_face_offsets.size() - 1;
+    std::vector<uint32_t> face_ids;
+    if (m_num_triangles != num_faces) {
+        face_ids.resize(m_num_triangles);
+        for (size_t f = 0; f < num_faces; ++f) {
+            std::fill(face_ids.begin() + m_face_offsets[f], face_ids.begin() + m_face_offsets[f + 1], uint32_t(f));
+        }
+    }
+    m_uniforms.color_options.y = face_ids.empty() ? 0.0f : 1.0f;
 
-    pipeline_desc.depthStencil = &depth_stencil_state;
+    // Create binding layout (don't forget to = Default)
+    std::vector<WGPUBindGroupLayoutEntry> mesh_bindings(5);
+    mesh_bindings[0].binding               = 0;
+    mesh_bindings[0].visibility            = WGPUShaderStage_Vertex | WGPUShaderStage_Fragment;
+    mesh_bindings[0].buffer.type           = WGPUBufferBindingType_Uniform;
+    mesh_bindings[0].buffer.minBindingSize = sizeof(VisualMeshUniforms);
+    for (uint32_t i = 1; i < mesh_bindings.size(); ++i) {
+        mesh_bindings[i].binding     = i;
+        mesh_bindings[i].visibility  = WGPUShaderStage_Vertex;
+        mesh_bindings[i].buffer.type = WGPUBufferBindingType_ReadOnlyStorage;
+    }
 
-    pipeline_desc.multisample.count                  = 1;
-    pipeline_desc.multisample.mask                   = ~0u;
-    pipeline_desc.multisample.alphaToCoverageEnabled = false;
+    static const std::string full_source =
+        std::string(lightingShaderCode) + visualMeshFetchFull + visualMeshShading + shaderCode;
+    static const std::string compact_source =
+        std::string(lightingShaderCode) + visualMeshFetchCompact + visualMeshShading + shaderCode;
+
+    bool                      compact = m_vertex_format == VisualMeshVertexFormat::Compact;
+    RenderPipelineDescription pipeline_desc;
+    pipeline_desc.shader_source = compact ? compact_source : full_source;
+    // All vertex data is pulled from storage buffers
+    pipeline_desc.vertex_buffers = {};
+    // properties are in their own group
+    pipeline_desc.bind_groups = {{Renderer::camera_layout_entry()}, mesh_bindings,
+                                 MeshPropertyDefaults::layout_entries()};
+
+    pipeline_desc.blend.color.srcFactor = WGPUBlendFactor_SrcAlpha;
+    pipeline_desc.blend.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    pipeline_desc.blend.color.operation = WGPUBlendOperation_Add;
+    pipeline_desc.blend.alpha.srcFactor = WGPUBlendFactor_One;
+    pipeline_desc.blend.alpha.dstFactor = WGPUBlendFactor_Zero;
+    pipeline_desc.blend.alpha.operation = WGPUBlendOperation_Add;
+
+    pipeline_desc.color_format = renderer.m_swap_chain_format;
+    pipeline_desc.depth_format = renderer.m_depth_texture_format;
+
+    const CachedPipeline& cached = renderer.m_pipeline_cache->get(pipeline_desc);
+    m_pipeline                   = cached.pipeline;
+
+    // Create the vertex and triangle storage buffers
+    if (compact) {
+        CompactVisualMeshLayout packed = compress_vertex_layout(layout, m_bbox);
+        m_uniforms.position_offset     = glm::vec4(packed.position_offset, 0.0f);
+        m_uniforms.position_scale      = glm::vec4(packed.position_scale, 0.0f);
+        m_position_buffer = create_buffer(renderer, packed.positions.data(), packed.positions.size() * sizeof(uint32_t),
+                                          WGPUBufferUsage_Storage);
+        m_normal_buffer   = create_buffer(renderer, packed.normals.data(), packed.normals.size() * sizeof(uint32_t),
+                                          WGPUBufferUsage_Storage);
+        m_triangle_buffer = create_buffer(renderer, packed.triangles.data(),
+                                          packed.triangles.size() * sizeof(uint32_t), WGPUBufferUsage_Storage);
+    } else {
+        m_position_buffer = create_buffer(renderer, layout.positions, layout.num_vertices * sizeof(glm::vec3),
+                                          WGPUBufferUsage_Storage);
+        m_normal_buffer   = create_buffer(renderer, layout.normals, layout.num_vertices * sizeof(glm::vec3),
+                                          WGPUBufferUsage_Storage);
+        m_triangle_buffer = create_buffer(renderer, layout.triangles, layout.num_triangles * sizeof(glm::uvec4),
+                                          WGPUBufferUsage_Storage);
+    }
+    m_face_id_buffer = create_buffer(renderer, face_ids.data(), face_ids.size() * sizeof(uint32_t),
+                                     WGPUBufferUsage_Storage);
 
-    // Create binding layout (don't forget to = Default)
-    WGPUBindGroupLayoutEntry binding_layout = {};
-    binding_layout.binding                  = 0;
-    binding_layout.visibility               = WGPUShaderStage_Vertex | WGPUShaderStage_Fragment;
-    binding_layout.buffer.type              = WGPUBufferBindingType_Uniform;
-    binding_layout.buffer.minBindingSize    = sizeof(VisualMeshUniforms);
-
-    // Create a bind group layout
-    WGPUBindGroupLayoutDescriptor bind_group_layout_desc{};
-    bind_group_layout_desc.entryCount     = 1;
-    bind_group_layout_desc.entries        = &binding_layout;
-    WGPUBindGroupLayout bind_group_layout = wgpuDeviceCreateBindGroupLayout(renderer.m_device, &bind_group_layout_desc);
-
-    // Create the pipeline layout
-    WGPUPipelineLayoutDescriptor layout_desc{};
-    layout_desc.bindGroupLayoutCount = 1;
-    layout_desc.bindGroupLayouts     = (WGPUBindGroupLayout*)&bind_group_layout;
-    WGPUPipelineLayout layout        = wgpuDeviceCreatePipelineLayout(renderer.m_device, &layout_desc);
-    pipeline_desc.layout             = layout;
-
-    // Create vertex buffer
+    // Create uniform buffer
     WGPUBufferDescriptor buffer_desc = {};
-    buffer_desc.size                 = m_vertex_attributes.size() * sizeof(VisualMeshVertexAttributes);
-    buffer_desc.usage                = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex;
+    buffer_desc.size                 = sizeof(VisualMeshUniforms);
+    buffer_desc.usage                = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Uniform;
     buffer_desc.mappedAtCreation     = false;
-    m_vertex_buffer                  = wgpuDeviceCreateBuffer(renderer.m_device, &buffer_desc);
-    wgpuQueueWriteBuffer(renderer.m_queue, m_vertex_buffer, 0, m_vertex_attributes.data(), buffer_desc.size);
-
-    // Create uniform buffer
-    buffer_desc.size             = sizeof(VisualMeshUniforms);
-    buffer_desc.usage            = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Uniform;
-    buffer_desc.mappedAtCreation = false;
-    m_uniform_buffer             = wgpuDeviceCreateBuffer(renderer.m_device, &buffer_desc);
-
-    // Create a binding
-    WGPUBindGroupEntry binding{};
-    binding.binding = 0;
-    binding.buffer  = m_uniform_buffer;
-    binding.offset  = 0;
-    binding.size    = sizeof(VisualMeshUniforms);
+    m_uniform_buffer                 = wgpuDeviceCreateBuffer(renderer.m_device, &buffer_desc);
+
+    // Create the bindings
+    std::array<WGPUBuffer, 5>         buffers  = {m_uniform_buffer, m_position_buffer, m_normal_buffer,
+                                                  m_triangle_buffer, m_face_id_buffer};
+    std::array<WGPUBindGroupEntry, 5> bindings = {};
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+        bindings[i].binding = i;
+        bindings[i].buffer  = buffers[i];
+        bindings[i].offset  = 0;
+        bindings[i].size    = wgpuBufferGetSize(buffers[i]);
+    }
 
     // A bind group contains one or multiple bindings
     WGPUBindGroupDescriptor bind_group_desc = {};
-    bind_group_desc.layout                  = bind_group_layout;
-    bind_group_desc.entryCount              = bind_group_layout_desc.entryCount;
-    bind_group_desc.entries                 = &binding;
+    bind_group_desc.layout                  = cached.bind_group_layouts[1];
+    bind_group_desc.entryCount              = bindings.size();
+    bind_group_desc.entries                 = bindings.data();
     m_bind_group                            = wgpuDeviceCreateBindGroup(renderer.m_device, &bind_group_desc);
 
-    m_pipeline = wgpuDeviceCreateRenderPipeline(renderer.m_device, &pipeline_desc);
-    wgpuShaderModuleRelease(shader_module);
+    m_uniforms_dirty = true;
 
-    // This has to be called here because the camera uniforms are cleared when reconfiguring
-    // the pipeline. When the mesh is registered this is called from the renderer, but when
-    // an attribute is registered the pipeline is reconfigured and the camera uniforms are lost.
-    on_camera_update();
+    // the normals uploaded above are outdated, compute them again from the new position buffer
+    if (m_normals_on_gpu) {
+        dispatch_normal_compute();
+    }
 }
 
-void VisualMesh::draw(WGPURenderPassEncoder render_pass) {
+void VisualMesh::update() {
     if (!m_visible_mesh && !m_show_wireframe)
         return;
 
-    if (m_attributes_dirty) {
-        size_t size = m_vertex_attributes.size() * sizeof(VisualMeshVertexAttributes);
-        wgpuQueueWriteBuffer(Renderer::get().m_queue, m_vertex_buffer, 0, m_vertex_attributes.data(), size);
-        m_attributes_dirty = false;
+    if (m_active_colors != nullptr) {
+        upload_face_colors(*m_active_colors);
+    } else if (m_active_scalars != nullptr) {
+        upload_scalars(*m_active_scalars);
+
+        glm::vec4 range(m_active_scalars->range(), 0.0f, 0.0f);
+        if (range != m_uniforms.scalar_range) {
+            m_uniforms.scalar_range = range;
+            m_uniforms_dirty        = true;
+        }
     }
 
-    if (m_uniforms_dirty) {
-        wgpuQueueWriteBuffer(m_renderer->m_queue, m_uniform_buffer, 0, &m_uniforms, sizeof(VisualMeshUniforms));
-        m_uniforms_dirty = false;
+    if (m_uniforms_dirty || m_uniform_buffer_stale) {
+        m_renderer->write_uniforms(m_uniform_buffer, &m_uniforms, sizeof(VisualMeshUniforms));
+        m_uniforms_dirty       = false;
+        m_uniform_buffer_stale = false;
     }
 
-    wgpuRenderPassEncoderSetPipeline(render_pass, m_pipeline);
-    wgpuRenderPassEncoderSetVertexBuffer(render_pass, 0, m_vertex_buffer, 0,
-                                         m_vertex_attributes.size() * sizeof(VisualMeshVertexAttributes));
+    for (auto& [name, prop] : m_vector_properties) {
+        prop->update();
+    }
+}
 
-    // Set binding group
-    wgpuRenderPassEncoderSetBindGroup(render_pass, 0, m_bind_group, 0, nullptr);
-    wgpuRenderPassEncoderDraw(render_pass, uint32_t(m_vertex_attributes.size()), 1, 0, 0);
+void VisualMesh::draw(RenderEncoder encoder) {
+    if (!m_visible_mesh && !m_show_wireframe)
+        return;
+
+    // the property bind groups are created by update
+    WGPUBindGroup property_group = m_renderer->m_property_defaults->m_bind_group;
+    if (m_active_colors != nullptr) {
+        property_group = m_active_colors->m_bind_group;
+    } else if (m_active_scalars != nullptr) {
+        property_group = m_active_scalars->m_bind_group;
+    }
+
+    encoder.set_pipeline(m_pipeline);
+
+    // Group 0 is the camera, bound by the renderer
+    encoder.set_bind_group(1, m_bind_group);
+    encoder.set_bind_group(2, property_group);
+    encoder.draw(uint32_t(3 * m_num_triangles), 1, 0, 0);
 
     for (auto& [name, prop] : m_vector_properties) {
-        prop->draw(render_pass);
+        prop->draw(encoder);
     }
 }
 
-void VisualMesh::on_camera_update() {
-    m_uniforms.view_matrix       = m_renderer->m_camera.transform();
-    m_uniforms.projection_matrix = m_renderer->m_projection;
-    m_uniforms_dirty             = true;
-
-    // update vector properties
+bool VisualMesh::needs_redraw() const {
+    // update skips hidden meshes, so their dirty state is only consumed once they are shown
+    if (!m_visible_mesh && !m_show_wireframe) {
+        return m_redraw_requested;
+    }
+    // m_uniform_buffer_stale is left out, it is set by the batch every time it uploads the
+    // uniforms and only cleared once the mesh is drawn on its own again. Leaving the batch
+    // requests a redraw itself.
+    if (m_redraw_requested || m_uniforms_dirty) {
+        return true;
+    }
+    // the property uploads and the scalar range are applied in update
+    if (m_active_colors && !m_active_colors->m_dirty_faces.empty()) {
+        return true;
+    }
+    if (m_active_scalars && (m_active_scalars->m_values_dirty || m_active_scalars->m_colormap_dirty ||
+                             m_active_scalars->range() != glm::vec2(m_uniforms.scalar_range))) {
+        return true;
+    }
     for (auto& [name, prop] : m_vector_properties) {
-        prop->on_camera_update();
+        if (prop->is_enabled() && prop->m_instance_data_dirty) {
+            return true;
+        }
     }
+    return false;
 }
 
 void VisualMesh::update_ui(std::string) {
     bool update_uniforms = false;
-    bool update_color    = false;
     if (m_show_options) {
 
-        update_color |= ImGui::ColorEdit3("Color", (float*)&m_mesh_color);
+        update_uniforms |= ImGui::ColorEdit3("Color", (float*)&m_uniforms.mesh_color);
         update_uniforms |= ImGui::ColorEdit3("Wireframe Color", (float*)&m_uniforms.wireframe_color);
 
-        if (update_color) {
-            auto it = std::find_if(m_color_properties.begin(), m_color_properties.end(),
-                                   [](const auto& pair) { return pair.second->is_enabled(); });
-            if (it == m_color_properties.end()) {
-                for (auto& attr : m_vertex_attributes) {
-                    attr.color = m_mesh_color;
-                }
-                m_attributes_dirty = true;
-            }
+        bool compact = m_vertex_format == VisualMeshVertexFormat::Compact;
+        if (ImGui::Checkbox("Compact Vertices", &compact)) {
+            set_vertex_format(compact ? VisualMeshVertexFormat::Compact : VisualMeshVertexFormat::Full);
         }
+
+        size_t bytes = gpu_memory_bytes();
+        ImGui::Text("GPU memory: %.1f MB, %.1f bytes/triangle", double(bytes) / (1024.0 * 1024.0),
+                    m_num_triangles ? double(bytes) / double(m_num_triangles) : 0.0);
+
         // face color properties
         if (ImGui::TreeNode("Face Color Properties")) {
 
@@ -361,6 +531,37 @@ void VisualMesh::update_ui(std::string) {
             ImGui::TreePop();
         }
 
+        // scalar properties, the range and the colormap are applied without touching the values
+        if (ImGui::TreeNode("Scalar Properties")) {
+            for (auto& [name, prop] : m_scalar_properties) {
+                ImGui::PushID(name.c_str());
+                bool is_enabled = prop->is_enabled();
+                if (ImGui::Checkbox(name.c_str(), &is_enabled)) {
+                    prop->set_enabled(is_enabled);
+                    update_scalars(name);
+                }
+                if (prop->is_enabled()) {
+                    glm::vec2 range  = prop->range();
+                    glm::vec2 limits = prop->data_range();
+                    float     speed  = std::max((limits.y - limits.x) / 500.0f, 1e-6f);
+                    if (ImGui::DragFloatRange2("Range", &range.x, &range.y, speed)) {
+                        prop->set_range(range.x, range.y);
+                    }
+                    ImGui::SameLine();
+                    if (ImGui::Button("Reset")) {
+                        prop->set_range(limits.x, limits.y);
+                    }
+                    int  colormap = int(prop->colormap());
+                    auto name_of  = [](void*, int i) { return colormap_name(Colormap(i)); };
+                    if (ImGui::Combo("Colormap", &colormap, name_of, nullptr, int(Colormap::Count))) {
+                        prop->set_colormap(Colormap(colormap));
+                    }
+                }
+                ImGui::PopID();
+            }
+            ImGui::TreePop();
+        }
+
         // vector properties
         std::string changed_name;
         if (ImGui::TreeNode("Vector Properties")) {
@@ -425,71 +626,655 @@ FaceVectorProperty* VisualMesh::add_face_vectors(std::string_view name, const st
     auto  property = std::make_unique<FaceVectorProperty>(this, vs);
     auto& slot     = m_vector_properties[std::string(name)];
     slot           = std::move(property);
+    // the arrows are drawn with the mesh, a replaced property also destroyed its buffers
+    invalidate_commands();
     return slot.get();
 }
 
 FaceColorProperty* VisualMesh::add_face_colors(std::string_view name, const std::vector<glm::vec3>& colors) {
     auto  property = std::make_unique<FaceColorProperty>(this, colors);
     auto& slot     = m_color_properties[std::string(name)];
-    slot           = std::move(property);
+    if (slot && slot.get() == m_active_colors) {
+        // the replaced property was shown, keep showing the one with the same name
+        property->set_enabled(true);
+        m_active_colors = property.get();
+    }
+    if (slot) {
+        // the replaced property destroys its buffers, which recorded commands may still use
+        invalidate_commands();
+    }
+    slot = std::move(property);
     return slot.get();
 }
 
 void VisualMesh::update_face_colors(const std::string& changed_name) {
-    bool using_face_property = false;
+    FaceColorProperty* shown = nullptr;
+    auto               it    = m_color_properties.find(changed_name);
+    if (it != m_color_properties.end() && it->second->is_enabled()) {
+        shown = it->second.get();
+    }
+    set_color_source(shown, nullptr);
+}
+
+ScalarProperty* VisualMesh::add_vertex_scalars(std::string_view name, const std::vector<float>& values) {
+    assert(values.size() == m_mesh.num_vertices());
+    return add_scalars(name, ScalarLocation::Vertex, values);
+}
+
+ScalarProperty* VisualMesh::add_face_scalars(std::string_view name, const std::vector<float>& values) {
+    assert(values.size() == m_mesh.num_faces());
+    return add_scalars(name, ScalarLocation::Face, values);
+}
+
+ScalarProperty* VisualMesh::add_scalars(std::string_view name, ScalarLocation location,
+                                        const std::vector<float>& values) {
+    auto  property = std::make_unique<ScalarProperty>(this, location, values);
+    auto& slot     = m_scalar_properties[std::string(name)];
+    bool  shown    = slot && slot.get() == m_active_scalars;
+    if (slot) {
+        // the replaced property destroys its buffers, which recorded commands may still use
+        invalidate_commands();
+    }
+    slot = std::move(property);
+    if (shown) {
+        // the replaced property was shown, keep showing the one with the same name
+        set_color_source(nullptr, slot.get());
+    }
+    return slot.get();
+}
+
+void VisualMesh::update_scalars(const std::string& changed_name) {
+    ScalarProperty* shown = nullptr;
+    auto            it    = m_scalar_properties.find(changed_name);
+    if (it != m_scalar_properties.end() && it->second->is_enabled()) {
+        shown = it->second.get();
+    }
+    set_color_source(nullptr, shown);
+}
+
+void VisualMesh::set_color_source(FaceColorProperty* colors, ScalarProperty* scalars) {
     for (auto& [name, prop] : m_color_properties) {
-        if (name == changed_name && prop->is_enabled()) {
-            using_face_property                  = true;
-            const std::vector<glm::vec3>& colors = prop->get_colors();
+        prop->set_enabled(prop.get() == colors);
+    }
+    for (auto& [name, prop] : m_scalar_properties) {
+        prop->set_enabled(prop.get() == scalars);
+    }
+    m_active_colors  = colors;
+    m_active_scalars = scalars;
+
+    ColorSource source = ColorSource::Mesh;
+    if (colors) {
+        source = ColorSource::FaceColors;
+    } else if (scalars) {
+        source = scalars->location() == ScalarLocation::Vertex ? ColorSource::VertexScalars : ColorSource::FaceScalars;
+    }
+    m_uniforms.color_options.x = float(source);
+    m_uniforms_dirty           = true;
+    invalidate_commands();
+}
+
+WGPUBindGroup VisualMesh::create_property_bind_group(WGPUBuffer buffer, WGPUTextureView colormap) const {
+    return m_renderer->m_property_defaults->create_bind_group(buffer, colormap);
+}
 
-            size_t num_attributes = m_vertex_attributes.size();
-            for (size_t i = 0; i < num_attributes; ++i) {
-                m_vertex_attributes[i].color = colors[i / 3];
+void VisualMesh::upload_face_colors(FaceColorProperty& prop) {
+    bool                          compact = m_vertex_format == VisualMeshVertexFormat::Compact;
+    size_t                        stride  = compact ? sizeof(uint32_t) : sizeof(glm::vec3);
+    const std::vector<glm::vec3>& colors  = prop.m_colors;
+
+    if (prop.m_buffer == nullptr) {
+        prop.m_buffer     = create_buffer(*m_renderer, nullptr, colors.size() * stride, WGPUBufferUsage_Storage);
+        prop.m_bind_group = create_property_bind_group(prop.m_buffer, m_renderer->m_property_defaults->m_colormap_view);
+        prop.m_dirty_faces.clear();
+        prop.m_dirty_faces.add(0, colors.size());
+    }
+    if (prop.m_dirty_faces.empty()) {
+        return;
+    }
+
+    WGPUQueue             queue = m_renderer->m_queue;
+    std::vector<uint32_t> packed;
+    for (auto [begin, end] : prop.m_dirty_faces.ranges()) {
+        if (compact) {
+            packed.resize(end - begin);
+            for (size_t i = begin; i < end; ++i) {
+                packed[i - begin] = glm::packUnorm4x8(glm::vec4(colors[i], 1.0f));
             }
+            wgpuQueueWriteBuffer(queue, prop.m_buffer, begin * stride, packed.data(), packed.size() * stride);
         } else {
-            prop->set_enabled(false);
+            wgpuQueueWriteBuffer(queue, prop.m_buffer, begin * stride, &colors[begin], (end - begin) * stride);
         }
     }
+    prop.m_dirty_faces.clear();
+}
+
+void VisualMesh::upload_scalars(ScalarProperty& prop) {
+    const Renderer& renderer = *m_renderer;
+    if (prop.m_buffer == nullptr) {
+        size_t count          = prop.m_location == ScalarLocation::Vertex ? m_num_vertices : prop.m_values.size();
+        prop.m_buffer         = create_buffer(renderer, nullptr, count * sizeof(float), WGPUBufferUsage_Storage);
+        prop.m_colormap_tex   = create_colormap_texture(renderer.m_device, renderer.m_queue, prop.m_colormap);
+        prop.m_colormap_view  = wgpuTextureCreateView(prop.m_colormap_tex, nullptr);
+        prop.m_bind_group     = create_property_bind_group(prop.m_buffer, prop.m_colormap_view);
+        prop.m_values_dirty   = true;
+        prop.m_colormap_dirty = false;
+    }
 
-    if (!using_face_property) {
-        size_t num_attributes = m_vertex_attributes.size();
-        for (size_t i = 0; i < num_attributes; ++i) {
-            m_vertex_attributes[i].color = m_mesh_color;
+    if (prop.m_values_dirty) {
+        if (prop.m_location == ScalarLocation::Vertex) {
+            // the GPU vertices are split by normals, every one gets the value of its position
+            std::vector<float> values(m_num_vertices);
+            for (size_t v = 0; v < m_num_vertices; ++v) {
+                values[v] = prop.m_values[m_position_ids[v]];
+            }
+            wgpuQueueWriteBuffer(renderer.m_queue, prop.m_buffer, 0, values.data(), values.size() * sizeof(float));
+        } else {
+            wgpuQueueWriteBuffer(renderer.m_queue, prop.m_buffer, 0, prop.m_values.data(),
+                                 prop.m_values.size() * sizeof(float));
         }
+        prop.m_values_dirty = false;
+    }
+
+    if (prop.m_colormap_dirty) {
+        write_colormap_texture(renderer.m_queue, prop.m_colormap_tex, prop.m_colormap);
+        prop.m_colormap_dirty = false;
+    }
+}
+
+void VisualMesh::set_vertex_format(VisualMeshVertexFormat format) {
+    if (format == m_vertex_format) {
+        return;
+    }
+    m_vertex_format = format;
+    configure_render_pipeline();
+}
+
+size_t VisualMesh::gpu_memory_bytes() const {
+    size_t bytes = sizeof(VisualMeshUniforms);
+    for (WGPUBuffer buffer : {m_position_buffer, m_normal_buffer, m_triangle_buffer, m_face_id_buffer}) {
+        if (buffer) {
+            bytes += wgpuBufferGetSize(buffer);
+        }
+    }
+    for (auto& [name, prop] : m_color_properties) {
+        if (prop->m_buffer) {
+            bytes += wgpuBufferGetSize(prop->m_buffer);
+        }
+    }
+    for (auto& [name, prop] : m_scalar_properties) {
+        if (prop->m_buffer) {
+            bytes += wgpuBufferGetSize(prop->m_buffer);
+        }
+    }
+    return bytes;
+}
+
+void VisualMesh::set_normal_mode(NormalMode mode) {
+    if (mode == m_normal_mode) {
+        return;
+    }
+    m_normal_mode = mode;
+    // the normal topology changes, so does the vertex layout
+    if (mode == NormalMode::Flat) {
+        set_flat_normals(m_mesh);
+    } else if (mode == NormalMode::Smooth) {
+        set_smooth_normals(m_mesh);
+    } else {
+        return;
     }
-    m_attributes_dirty = true;
+    m_normals_on_gpu = false;
+    m_vertex_faces.clear();
+    configure_render_pipeline();
 }
 
-VisualPointCloud::VisualPointCloud(const std::vector<glm::vec3>& positions, const Renderer& renderer)
-    : Drawable(&renderer, BoundingBox(positions)) {
+void VisualMesh::update_positions(const glm::vec3* positions, size_t count) {
+    assert(count == m_mesh.num_vertices());
+    std::copy(positions, positions + count, m_mesh.positions.begin());
+    // with GPU normals m_mesh.normals stay outdated
+    bool gpu = m_gpu_normals && m_normal_mode != NormalMode::Keep;
+    if (!gpu && m_normal_mode == NormalMode::Flat) {
+        compute_flat_normals();
+    } else if (!gpu && m_normal_mode == NormalMode::Smooth) {
+        compute_smooth_normals();
+    }
+    on_positions_changed(m_normal_mode != NormalMode::Keep && !gpu);
+
+    if (m_normal_mode != NormalMode::Keep) {
+        m_normals_on_gpu = gpu;
+    }
+    if (gpu) {
+        dispatch_normal_compute();
+    }
+}
+
+void VisualMesh::dispatch_normal_compute() {
+    if (!m_normal_compute) {
+        create_normal_compute();
+    }
+    m_normal_compute->dispatch(glm::vec3(m_uniforms.position_offset), glm::vec3(m_uniforms.position_scale));
+}
+
+void VisualMesh::create_normal_compute() {
+    const Mesh& mesh = m_mesh;
+
+    // Triangles of every mesh normal: the first triangle of each face that uses it, which has the
+    // normal face_normal computes on the CPU. For flat normals this is the face itself, for
+    // smooth normals the faces around a position.
+    auto for_each_normal = [&](size_t f, auto&& g) {
+        auto nf = mesh.normal_faces[f];
+        for (size_t k = 0; k < nf.size(); ++k) {
+            if (std::find(nf.begin(), nf.begin() + k, nf[k]) == nf.begin() + k) {
+                g(nf[k]);
+            }
+        }
+    };
+
+    std::vector<uint32_t> normal_offsets(mesh.normals.size() + 1, 0);
+    for (size_t f = 0; f < mesh.num_faces(); ++f) {
+        for_each_normal(f, [&](uint32_t n) { ++normal_offsets[n + 1]; });
+    }
+    for (size_t n = 0; n < mesh.normals.size(); ++n) {
+        normal_offsets[n + 1] += normal_offsets[n];
+    }
+    std::vector<uint32_t> normal_triangles(normal_offsets.back());
+    std::vector<uint32_t> fill(normal_offsets.begin(), normal_offsets.end() - 1);
+    for (size_t f = 0; f < mesh.num_faces(); ++f) {
+        for_each_normal(f, [&](uint32_t n) { normal_triangles[fill[n]++] = m_face_offsets[f]; });
+    }
+
+    // the same per vertex, split vertices get a copy
+    std::vector<uint32_t> vertex_offsets(m_num_vertices + 1, 0);
+    for (size_t i = 0; i < m_num_vertices; ++i) {
+        uint32_t n            = m_normal_ids[i];
+        vertex_offsets[i + 1] = vertex_offsets[i] + normal_offsets[n + 1] - normal_offsets[n];
+    }
+    std::vector<uint32_t> vertex_triangles;
+    vertex_triangles.reserve(vertex_offsets.back());
+    for (size_t i = 0; i < m_num_vertices; ++i) {
+        uint32_t n = m_normal_ids[i];
+        vertex_triangles.insert(vertex_triangles.end(), normal_triangles.begin() + normal_offsets[n],
+                                normal_triangles.begin() + normal_offsets[n + 1]);
+    }
+
+    m_normal_compute = std::make_unique<NormalCompute>(
+        *m_renderer, m_vertex_format == VisualMeshVertexFormat::Compact, m_position_buffer, m_triangle_buffer,
+        m_normal_buffer, uint32_t(m_num_triangles), vertex_offsets, vertex_triangles);
+}
+
+void VisualMesh::update_positions(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals) {
+    assert(positions.size() == m_mesh.num_vertices());
+    assert(normals.size() == m_mesh.normals.size());
+    m_mesh.positions = positions;
+    m_mesh.normals   = normals;
+    m_normals_on_gpu = false;
+    on_positions_changed(true);
+}
+
+void VisualMesh::compute_flat_normals() {
+    parallel_for(0, m_mesh.num_faces(), [&](size_t begin, size_t end) {
+        for (size_t f = begin; f < end; ++f) {
+            m_mesh.normals[f] = face_normal(m_mesh, f);
+        }
+    });
+}
+
+void VisualMesh::compute_smooth_normals() {
+    size_t num_faces    = m_mesh.num_faces();
+    size_t num_vertices = m_mesh.num_vertices();
+
+    // Vertex to face adjacency, built on the first update. Every vertex sums its own faces, so
+    // the vertices can be processed in parallel without atomics.
+    if (m_vertex_faces.empty()) {
+        vertex_face_adjacency(m_mesh, m_vertex_face_offsets, m_vertex_faces);
+    }
+
+    std::vector<glm::vec3> face_normals(num_faces);
+    parallel_for(0, num_faces, [&](size_t begin, size_t end) {
+        for (size_t f = begin; f < end; ++f) {
+            face_normals[f] = face_normal(m_mesh, f);
+        }
+    });
+    parallel_for(0, num_vertices, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            glm::vec3 n(0.0f);
+            for (uint32_t i = m_vertex_face_offsets[v]; i < m_vertex_face_offsets[v + 1]; ++i) {
+                n += face_normals[m_vertex_faces[i]];
+            }
+            m_mesh.normals[v] = glm::normalize(n);
+        }
+    });
+}
+
+void VisualMesh::on_positions_changed(bool normals_changed) {
+    m_dynamic = true;
+    m_bbox    = BoundingBox(m_mesh.positions);
+    upload_vertices(normals_changed);
+    request_redraw();
+    for (auto& [name, prop] : m_vector_properties) {
+        prop->update_face_centers();
+    }
+}
+
+void VisualMesh::upload_vertices(bool normals) {
+    const Renderer& renderer = *m_renderer;
+    const Mesh&     mesh     = m_mesh;
+
+    if (m_vertex_format == VisualMeshVertexFormat::Full) {
+        std::vector<glm::vec3> data(m_num_vertices);
+        parallel_for(0, m_num_vertices, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                data[i] = mesh.positions[m_position_ids[i]];
+            }
+        });
+        wgpuQueueWriteBuffer(renderer.m_queue, m_position_buffer, 0, data.data(), data.size() * sizeof(glm::vec3));
+        if (normals) {
+            parallel_for(0, m_num_vertices, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    data[i] = mesh.normals[m_normal_ids[i]];
+                }
+            });
+            wgpuQueueWriteBuffer(renderer.m_queue, m_normal_buffer, 0, data.data(), data.size() * sizeof(glm::vec3));
+        }
+        return;
+    }
+
+    // the quantization follows the new bounding box
+    glm::vec3 offset, scale;
+    quantization_range(m_bbox, offset, scale);
+    m_uniforms.position_offset = glm::vec4(offset, 0.0f);
+    m_uniforms.position_scale  = glm::vec4(scale, 0.0f);
+    m_uniforms_dirty           = true;
+
+    std::vector<uint32_t> data(2 * m_num_vertices);
+    parallel_for(0, m_num_vertices, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            encode_position(mesh.positions[m_position_ids[i]], offset, scale, &data[2 * i]);
+        }
+    });
+    wgpuQueueWriteBuffer(renderer.m_queue, m_position_buffer, 0, data.data(), data.size() * sizeof(uint32_t));
+    if (normals) {
+        parallel_for(0, m_num_vertices, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                data[i] = encode_octahedral(mesh.normals[m_normal_ids[i]]);
+            }
+        });
+        wgpuQueueWriteBuffer(renderer.m_queue, m_normal_buffer, 0, data.data(), m_num_vertices * sizeof(uint32_t));
+    }
+}
 
+bool VisualMesh::is_batchable() const {
+    // repacking the batch for every deformation would cost more than the draw call it saves
+    if (m_dynamic || m_active_colors != nullptr || m_active_scalars != nullptr) {
+        return false;
+    }
+    for (auto& [name, prop] : m_vector_properties) {
+        if (prop->is_enabled()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+VisualMeshBatch::~VisualMeshBatch() {
+    release();
+}
+
+void VisualMeshBatch::release() {
+    if (m_object_buffer == nullptr) {
+        return;
+    }
+    for (WGPUBuffer buffer :
+         {m_object_buffer, m_position_buffer, m_normal_buffer, m_triangle_buffer, m_indirect_buffer}) {
+        wgpuBufferDestroy(buffer);
+        wgpuBufferRelease(buffer);
+    }
+    wgpuBindGroupRelease(m_bind_group);
+    // the pipeline belongs to the pipeline cache
+    m_pipeline      = nullptr;
+    m_object_buffer = nullptr;
+}
+
+void VisualMeshBatch::invalidate() {
+    m_meshes.clear();
+    m_objects.clear();
+    release();
+}
+
+void VisualMeshBatch::set_meshes(const std::vector<VisualMesh*>& meshes) {
+    if (meshes != m_meshes || (m_object_buffer == nullptr && !meshes.empty())) {
+        m_meshes = meshes;
+        build();
+    }
+    upload_objects();
+}
+
+void VisualMeshBatch::build() {
+    release();
+    m_dirty_objects.clear();
+    m_objects.resize(m_meshes.size());
+    m_num_triangles = 0;
+    if (m_meshes.empty()) {
+        return;
+    }
+    assert(m_meshes.size() < (size_t(1) << 29));
+    const Renderer& renderer = *m_renderer;
+
+    std::vector<VisualMeshLayout> layouts(m_meshes.size());
+    parallel_for(
+        0, m_meshes.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                layouts[i] = create_vertex_layout(m_meshes[i]->m_mesh);
+            }
+        },
+        64);
+
+    std::vector<size_t> vertex_offsets(m_meshes.size() + 1, 0);
+    std::vector<size_t> triangle_offsets(m_meshes.size() + 1, 0);
+    for (size_t i = 0; i < m_meshes.size(); ++i) {
+        vertex_offsets[i + 1]   = vertex_offsets[i] + layouts[i].positions.size();
+        triangle_offsets[i + 1] = triangle_offsets[i] + layouts[i].triangles.size();
+    }
+    m_num_triangles = triangle_offsets.back();
+
+    // Vertex ids become global and the object id is stored above the edge mask
+    std::vector<glm::vec3>  positions(vertex_offsets.back());
+    std::vector<glm::vec3>  normals(vertex_offsets.back());
+    std::vector<glm::uvec4> triangles(m_num_triangles);
+    parallel_for(
+        0, m_meshes.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const VisualMeshLayout& layout = layouts[i];
+                uint32_t                base   = uint32_t(vertex_offsets[i]);
+                std::copy(layout.positions.begin(), layout.positions.end(), positions.begin() + vertex_offsets[i]);
+                std::copy(layout.normals.begin(), layout.normals.end(), normals.begin() + vertex_offsets[i]);
+                for (size_t t = 0; t < layout.triangles.size(); ++t) {
+                    glm::uvec4 tri = layout.triangles[t];
+                    triangles[triangle_offsets[i] + t] =
+                        glm::uvec4(tri.x + base, tri.y + base, tri.z + base, tri.w | (uint32_t(i) << 3));
+                }
+            }
+        },
+        64);
+
+    m_position_buffer = create_buffer(renderer, positions.data(), positions.size() * sizeof(glm::vec3),
+                                      WGPUBufferUsage_Storage);
+    m_normal_buffer   = create_buffer(renderer, normals.data(), normals.size() * sizeof(glm::vec3),
+                                      WGPUBufferUsage_Storage);
+    m_triangle_buffer = create_buffer(renderer, triangles.data(), triangles.size() * sizeof(glm::uvec4),
+                                      WGPUBufferUsage_Storage);
+    m_object_buffer   = create_buffer(renderer, nullptr, m_objects.size() * sizeof(VisualMeshBatchObject),
+                                      WGPUBufferUsage_Storage);
+
+    // vertex count, instance count, first vertex, first instance
+    std::array<uint32_t, 4> draw_args = {uint32_t(3 * m_num_triangles), 1, 0, 0};
+    m_indirect_buffer = create_buffer(renderer, draw_args.data(), sizeof(draw_args), WGPUBufferUsage_Indirect);
+
+    std::vector<WGPUBindGroupLayoutEntry> batch_bindings(4);
+    for (uint32_t i = 0; i < batch_bindings.size(); ++i) {
+        batch_bindings[i].binding     = i;
+        batch_bindings[i].visibility  = WGPUShaderStage_Vertex;
+        batch_bindings[i].buffer.type = WGPUBufferBindingType_ReadOnlyStorage;
+    }
+    // the fragment shader reads the colors and options of its object
+    batch_bindings[0].visibility = WGPUShaderStage_Vertex | WGPUShaderStage_Fragment;
+
+    static const std::string source = std::string(lightingShaderCode) + visualMeshShading + visualMeshBatchCode;
+
+    RenderPipelineDescription pipeline_desc;
+    pipeline_desc.shader_source  = source;
+    pipeline_desc.vertex_buffers = {};
+    pipeline_desc.bind_groups    = {{Renderer::camera_layout_entry()}, batch_bindings};
+
+    // same state as VisualMesh
+    pipeline_desc.blend.color.srcFactor = WGPUBlendFactor_SrcAlpha;
+    pipeline_desc.blend.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+    pipeline_desc.blend.color.operation = WGPUBlendOperation_Add;
+    pipeline_desc.blend.alpha.srcFactor = WGPUBlendFactor_One;
+    pipeline_desc.blend.alpha.dstFactor = WGPUBlendFactor_Zero;
+    pipeline_desc.blend.alpha.operation = WGPUBlendOperation_Add;
+
+    pipeline_desc.color_format = renderer.m_swap_chain_format;
+    pipeline_desc.depth_format = renderer.m_depth_texture_format;
+
+    const CachedPipeline& cached = renderer.m_pipeline_cache->get(pipeline_desc);
+    m_pipeline                   = cached.pipeline;
+
+    std::array<WGPUBuffer, 4>         buffers  = {m_object_buffer, m_position_buffer, m_normal_buffer,
+                                                  m_triangle_buffer};
+    std::array<WGPUBindGroupEntry, 4> bindings = {};
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+        bindings[i].binding = i;
+        bindings[i].buffer  = buffers[i];
+        bindings[i].offset  = 0;
+        bindings[i].size    = wgpuBufferGetSize(buffers[i]);
+    }
+
+    WGPUBindGroupDescriptor bind_group_desc = {};
+    bind_group_desc.layout                  = cached.bind_group_layouts[1];
+    bind_group_desc.entryCount              = bindings.size();
+    bind_group_desc.entries                 = bindings.data();
+    m_bind_group                            = wgpuDeviceCreateBindGroup(renderer.m_device, &bind_group_desc);
+
+    // all objects are uploaded, whether their uniforms changed or not
+    for (VisualMesh* mesh : m_meshes) {
+        mesh->m_uniforms_dirty = true;
+    }
+}
+
+void VisualMeshBatch::upload_objects() {
+    for (size_t i = 0; i < m_meshes.size(); ++i) {
+        VisualMesh* mesh = m_meshes[i];
+        if (!mesh->m_uniforms_dirty) {
+            continue;
+        }
+        const VisualMeshUniforms& uniforms = mesh->m_uniforms;
+        m_objects[i]                       = {uniforms.model_matrix, uniforms.mesh_color, uniforms.wireframe_color,
+                                              uniforms.options};
+        m_dirty_objects.add(i);
+
+        mesh->m_uniforms_dirty       = false;
+        mesh->m_uniform_buffer_stale = true;
+    }
+    if (m_dirty_objects.empty()) {
+        return;
+    }
+
+    size_t stride = sizeof(VisualMeshBatchObject);
+    for (auto [begin, end] : m_dirty_objects.ranges()) {
+        wgpuQueueWriteBuffer(m_renderer->m_queue, m_object_buffer, begin * stride, &m_objects[begin],
+                             (end - begin) * stride);
+    }
+    m_dirty_objects.clear();
+}
+
+void VisualMeshBatch::draw(RenderEncoder encoder) {
+    if (m_num_triangles == 0) {
+        return;
+    }
+    encoder.set_pipeline(m_pipeline);
+    // Group 0 is the camera, bound by the renderer
+    encoder.set_bind_group(1, m_bind_group);
+    encoder.draw_indirect(m_indirect_buffer, 0);
+}
+
+VisualPointCloud::VisualPointCloud(const std::vector<glm::vec3>& positions, const Renderer& renderer,
+                                   PointRenderMode mode)
+    : Drawable(&renderer, BoundingBox(positions)), m_positions(positions) {
+    set_render_mode(mode);
+}
+
+void VisualPointCloud::set_render_mode(PointRenderMode mode) {
+    if ((mode == PointRenderMode::Sprites && m_sprites) || (mode == PointRenderMode::Spheres && m_spheres)) {
+        return;
+    }
+    invalidate_commands();
+    const Renderer& renderer = *m_renderer;
+    glm::vec3       color(m_color.x, m_color.y, m_color.z);
+
+    if (mode == PointRenderMode::Sprites) {
+        m_spheres.reset();
+        m_sprites = std::make_unique<PointSprites>(m_positions, m_radius * m_init_radius, color, renderer);
+        return;
+    }
+
+    m_sprites.reset();
     Mesh sphere_mesh = create_sphere(10, 10);
     sphere_mesh.scale({m_init_radius, m_init_radius, m_init_radius});
     set_smooth_normals(sphere_mesh);
-    m_spheres = std::make_unique<InstancedMesh>(sphere_mesh, positions.size(), renderer);
+    m_spheres = std::make_unique<InstancedMesh>(sphere_mesh, m_positions.size(), renderer);
     std::vector<glm::mat4x4> transforms;
 
-    for (const auto& p : positions) {
+    for (const auto& p : m_positions) {
         glm::mat4x4 t(1.0f);
+        t[0][0] = m_radius;
+        t[1][1] = m_radius;
+        t[2][2] = m_radius;
         t[3][0] = p.x;
         t[3][1] = p.y;
         t[3][2] = p.z;
         transforms.push_back(t);
     }
-    m_spheres->set_instance_data(transforms, {m_color.x, m_color.y, m_color.z});
+    m_spheres->set_instance_data(transforms, color);
     m_spheres->upload_instance_data();
-    //  configure_render_pipeline();
 }
 
 VisualLineNetwork::VisualLineNetwork(const std::vector<glm::vec3>&           positions,
-                                     const std::vector<std::pair<int, int>>& lines, const Renderer& renderer)
+                                     const std::vector<std::pair<int, int>>& lines, const Renderer& renderer,
+                                     LineRenderMode                          mode)
     : Drawable(&renderer, BoundingBox(positions)), m_positions(positions), m_lines(lines) {
-    Mesh line_mesh   = create_cylinder(16).triangulate();
-    m_line_mesh      = std::make_unique<InstancedMesh>(line_mesh, lines.size(), renderer);
-    Mesh sphere_mesh = create_sphere(16, 16);
-    set_smooth_normals(sphere_mesh);
-    m_vertices_mesh = std::make_unique<InstancedMesh>(sphere_mesh, positions.size(), renderer);
-    compute_transforms();
+    set_render_mode(mode);
+}
+
+void VisualLineNetwork::set_render_mode(LineRenderMode mode) {
+    if ((mode == LineRenderMode::ScreenSpace && m_screen_lines) || (mode == LineRenderMode::Tubes && m_tubes)) {
+        return;
+    }
+    invalidate_commands();
+    const Renderer& renderer = *m_renderer;
+
+    if (mode == LineRenderMode::ScreenSpace) {
+        m_tubes.reset();
+        m_screen_lines = std::make_unique<ScreenLines>(m_positions, m_lines, m_line_width, m_color, renderer);
+        m_screen_lines->set_round_caps(m_round_caps);
+        return;
+    }
+
+    m_screen_lines.reset();
+    m_tubes = std::make_unique<TubeNetwork>(m_positions, m_lines, m_radius, m_color, renderer);
+}
+
+void VisualLineNetwork::update_positions(const glm::vec3* positions, size_t count) {
+    assert(count == m_positions.size());
+    std::copy(positions, positions + count, m_positions.begin());
+    m_bbox = BoundingBox(m_positions);
+    request_redraw();
+    if (m_screen_lines) {
+        m_screen_lines->update_positions(positions, count);
+    } else {
+        m_tubes->update_positions(positions, count);
+    }
 }
 
 } // namespace rr
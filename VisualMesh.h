@@ -1,10 +1,15 @@
 #pragma once
 
+#include "DirtyRanges.h"
 #include "Drawable.h"
 #include "InstancedMesh.h"
 #include "Mesh.h"
+#include "NormalCompute.h"
+#include "PointSprites.h"
 #include "Property.h"
 #include "Renderer.h"
+#include "ScreenLines.h"
+#include "TubeNetwork.h"
 
 #include <array>
 #include <imgui.h>
@@ -19,39 +24,133 @@ struct VisualMeshOptions {
     float wireframe_thickness = 1.5f;
 };
 
+// Per-object data in bind group 1, the camera is in the renderer's bind group 0
 struct VisualMeshUniforms {
-    glm::mat4x4       projection_matrix;
-    glm::mat4x4       view_matrix;
     glm::mat4x4       model_matrix    = glm::mat4x4(1.0f);
     glm::vec4         wireframe_color = glm::vec4(0.0f, 0.0f, 0.0f, 1.00f);
     VisualMeshOptions options;
+    // dequantization of compact positions, position = offset + q * scale
+    glm::vec4 position_offset = glm::vec4(0.0f);
+    glm::vec4 position_scale  = glm::vec4(1.0f);
+    glm::vec4 mesh_color      = glm::vec4(0.45f, 0.55f, 0.60f, 1.0f);
+    // x: ColorSource, y: triangles look up their face id
+    glm::vec4 color_options = glm::vec4(0.0f);
+    // xy: values mapped to the ends of the colormap
+    glm::vec4 scalar_range = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
 };
 
 static_assert(sizeof(VisualMeshUniforms) % 16 == 0);
 
-struct VisualMeshVertexAttributes {
-    glm::vec3 position;
-    glm::vec3 normal;
-    glm::vec3 bary;
-    glm::vec3 edge_mask;
-    glm::vec3 color;
+// GPU layout of a visual mesh. Corners that share both position and normal are merged into
+// one vertex, triangles reference them by id. The w component of a triangle holds a bit mask
+// of the edges (opposite to corner k) that were introduced by fan triangulation and are
+// therefore hidden in the wireframe.
+struct VisualMeshLayout {
+    std::vector<glm::vec3>  positions;
+    std::vector<glm::vec3>  normals;
+    std::vector<glm::uvec4> triangles;
+    // first triangle of every face, num_faces + 1 entries
+    std::vector<uint32_t> face_offsets;
+    // mesh position and mesh normal of every vertex
+    std::vector<uint32_t> position_ids;
+    std::vector<uint32_t> normal_ids;
+};
+
+VisualMeshLayout create_vertex_layout(const Mesh& mesh);
+
+// Non-owning view of a VisualMeshLayout, e.g. of one stored in a memory mapped binary mesh
+struct VisualMeshLayoutView {
+    VisualMeshLayoutView() = default;
+
+    VisualMeshLayoutView(const VisualMeshLayout& layout)
+        : positions(layout.positions.data()), normals(layout.normals.data()), triangles(layout.triangles.data()),
+          face_offsets(layout.face_offsets.data()), position_ids(layout.position_ids.data()),
+          normal_ids(layout.normal_ids.data()), num_vertices(layout.positions.size()),
+          num_triangles(layout.triangles.size()), num_faces(layout.face_offsets.size() - 1) {}
+
+    const glm::vec3*  positions     = nullptr;
+    const glm::vec3*  normals       = nullptr;
+    const glm::uvec4* triangles     = nullptr;
+    const uint32_t*   face_offsets  = nullptr;
+    const uint32_t*   position_ids  = nullptr;
+    const uint32_t*   normal_ids    = nullptr;
+    size_t            num_vertices  = 0;
+    size_t            num_triangles = 0;
+    size_t            num_faces     = 0;
+};
+
+// Storage format of the vertex data. Full uses 24 bytes per vertex, 16 per triangle and 12 per
+// face color. Compact quantizes positions to 16 bit relative to the bounding box and stores
+// octahedral normals, rgba8 colors and the edge mask in the top bits of the vertex ids, which
+// needs 12 bytes per vertex, 12 per triangle and 4 per face color.
+enum class VisualMeshVertexFormat { Full, Compact };
+
+// Packed buffers of VisualMeshVertexFormat::Compact
+struct CompactVisualMeshLayout {
+    std::vector<uint32_t> positions; // 2 words per vertex, xy and z as unorm16
+    std::vector<uint32_t> normals;   // octahedral snorm16x2
+    std::vector<uint32_t> triangles; // 3 vertex ids, bit 31 hides the edge opposite to the corner
+    glm::vec3             position_offset;
+    glm::vec3             position_scale;
+};
+
+CompactVisualMeshLayout compress_vertex_layout(const VisualMeshLayoutView& layout, const BoundingBox& bbox);
+
+// How VisualMesh::update_positions gets new normals. Flat and Smooth recompute them like
+// set_flat_normals and set_smooth_normals, Keep leaves them as they are.
+enum class NormalMode { Keep, Flat, Smooth };
+
+// Bind group 2 of the meshes that show no property, an empty property buffer and the default
+// colormap, and the sampler of all colormaps. Created once by the renderer and shared by all
+// meshes, so a mesh without properties creates no property objects of its own.
+class MeshPropertyDefaults {
+public:
+    explicit MeshPropertyDefaults(const Renderer& renderer);
+    ~MeshPropertyDefaults();
+
+    MeshPropertyDefaults(const MeshPropertyDefaults&)            = delete;
+    MeshPropertyDefaults& operator=(const MeshPropertyDefaults&) = delete;
+
+    // Entries of bind group 2 of the mesh pipelines
+    static std::vector<WGPUBindGroupLayoutEntry> layout_entries();
+
+    // Bind groups created with m_layout can be used with every mesh pipeline, their group 2
+    // layouts have the same entries
+    WGPUBindGroup create_bind_group(WGPUBuffer buffer, WGPUTextureView colormap) const;
+
+    WGPUDevice          m_device        = nullptr;
+    WGPUBindGroupLayout m_layout        = nullptr;
+    WGPUSampler         m_sampler       = nullptr;
+    WGPUBuffer          m_data          = nullptr;
+    WGPUTexture         m_colormap      = nullptr;
+    WGPUTextureView     m_colormap_view = nullptr;
+    WGPUBindGroup       m_bind_group    = nullptr;
 };
 
 class VisualMesh : public Drawable {
 public:
-    VisualMesh(const Mesh& mesh, const Renderer& renderer);
+    VisualMesh(const Mesh& mesh, const Renderer& renderer,
+               VisualMeshVertexFormat format = VisualMeshVertexFormat::Full);
+
+    // Uploads a layout that was created from mesh beforehand, e.g. the one of a binary mesh
+    // file, instead of building it. The vertex and triangle buffers are written straight from
+    // the layout arrays.
+    VisualMesh(Mesh mesh, const VisualMeshLayoutView& layout, const Renderer& renderer,
+               VisualMeshVertexFormat format = VisualMeshVertexFormat::Full);
     ~VisualMesh() override;
 
     void release();
 
     void configure_render_pipeline();
 
-    void draw(WGPURenderPassEncoder render_pass) override;
+    void update() override;
 
-    void on_camera_update() override;
+    void draw(RenderEncoder encoder) override;
 
     void update_ui(std::string name) override;
 
+    bool needs_redraw() const override;
+
     void set_transform(const glm::mat4& transform) override;
 
     const glm::mat4* get_transform() const override;
@@ -60,16 +159,76 @@ public:
 
     FaceColorProperty* add_face_colors(std::string_view name, const std::vector<glm::vec3>& colors);
 
+    // Shows the face color property name if it is enabled and disables all others, falls back to
+    // the mesh color if none is enabled. This only switches bind groups.
     void update_face_colors(const std::string& name);
 
+    ScalarProperty* add_vertex_scalars(std::string_view name, const std::vector<float>& values);
+
+    ScalarProperty* add_face_scalars(std::string_view name, const std::vector<float>& values);
+
+    // Same as update_face_colors for scalar properties
+    void update_scalars(const std::string& name);
+
     void set_mesh_visible(bool show) {
         m_uniforms.options.show_mesh = show ? 1.0f : 0.0f;
         m_uniforms_dirty             = true;
+        invalidate_commands();
     }
 
     void set_wireframe_visible(bool show) {
         m_uniforms.options.show_wireframe = show ? 1.0f : 0.0f;
         m_uniforms_dirty                 = true;
+        invalidate_commands();
+    }
+
+    // Recreates the GPU buffers and the pipeline if the format changes
+    void set_vertex_format(VisualMeshVertexFormat format);
+
+    VisualMeshVertexFormat vertex_format() const {
+        return m_vertex_format;
+    }
+
+    size_t num_triangles() const {
+        return m_num_triangles;
+    }
+
+    // Size of all GPU buffers owned by this mesh, excluding properties
+    size_t gpu_memory_bytes() const;
+
+    // Meshes that show neither a color property nor vectors can be drawn by a VisualMeshBatch
+    bool is_batchable() const;
+
+    // New positions for the same faces, e.g. for every step of a simulation. The normals are
+    // recomputed in parallel according to normal_mode(). Only the position buffer and, if the
+    // normals changed, the normal buffer are written, the topology and all GPU objects stay.
+    void update_positions(const glm::vec3* positions, size_t count);
+
+    void update_positions(const std::vector<glm::vec3>& positions) {
+        update_positions(positions.data(), positions.size());
+    }
+
+    // Same with given normals, indexed like m_mesh.normals
+    void update_positions(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals);
+
+    // Detected from the normals of the mesh, changing it recomputes the normals and rebuilds the
+    // vertex layout
+    void set_normal_mode(NormalMode mode);
+
+    NormalMode normal_mode() const {
+        return m_normal_mode;
+    }
+
+    // Lets update_positions compute the flat or smooth normals in a compute pass that writes the
+    // normal buffer, the normals never pass through the CPU. They match the CPU normals,
+    // m_mesh.normals are no longer updated.
+    void set_gpu_normals(bool gpu) {
+        m_gpu_normals = gpu;
+        request_redraw();
+    }
+
+    bool gpu_normals() const {
+        return m_gpu_normals;
     }
 
     Mesh m_mesh;
@@ -78,43 +237,186 @@ public:
     bool m_show_options   = false;
 
 private:
-    WGPUBuffer         m_vertex_buffer  = nullptr;
-    WGPUBuffer         m_uniform_buffer = nullptr;
-    WGPUBindGroup      m_bind_group     = nullptr;
-    WGPURenderPipeline m_pipeline       = nullptr;
+    friend class VisualMeshBatch;
 
-    bool               m_uniforms_dirty = false;
-    VisualMeshUniforms m_uniforms;
+    // Where the mesh color comes from, matches colorOptions.x in the shader
+    enum class ColorSource { Mesh, FaceColors, VertexScalars, FaceScalars };
+
+    void set_color_source(FaceColorProperty* colors, ScalarProperty* scalars);
+
+    ScalarProperty* add_scalars(std::string_view name, ScalarLocation location, const std::vector<float>& values);
+
+    WGPUBindGroup create_property_bind_group(WGPUBuffer buffer, WGPUTextureView colormap) const;
+
+    void upload_face_colors(FaceColorProperty& prop);
+
+    void upload_scalars(ScalarProperty& prop);
+
+    void compute_flat_normals();
+
+    void compute_smooth_normals();
+
+    void on_positions_changed(bool normals_changed);
+
+    // Writes the positions and optionally the normals of m_mesh to the vertex buffers
+    void upload_vertices(bool normals);
 
-    glm::vec3 m_mesh_color = glm::vec3(0.45f, 0.55f, 0.60f);
+    void create_normal_compute();
 
-    bool                                    m_attributes_dirty = false;
-    std::vector<VisualMeshVertexAttributes> m_vertex_attributes;
+    void dispatch_normal_compute();
+
+    // Creates the GPU objects for the vertex and triangle arrays of layout, its ids have to be
+    // in m_face_offsets, m_position_ids and m_normal_ids already
+    void configure_render_pipeline(const VisualMeshLayoutView& layout);
+
+    VisualMeshVertexFormat m_vertex_format = VisualMeshVertexFormat::Full;
+    NormalMode             m_normal_mode   = NormalMode::Keep;
+    // set by update_positions, deforming meshes are not batched
+    bool m_dynamic     = false;
+    bool m_gpu_normals = false;
+    // created by the first update_positions with GPU normals
+    std::unique_ptr<NormalCompute> m_normal_compute;
+    // the normal buffer was last written by m_normal_compute and m_mesh.normals are outdated, so
+    // configure_render_pipeline dispatches it again
+    bool m_normals_on_gpu = false;
+
+    WGPUBuffer         m_position_buffer = nullptr;
+    WGPUBuffer         m_normal_buffer   = nullptr;
+    WGPUBuffer         m_triangle_buffer = nullptr;
+    WGPUBuffer         m_face_id_buffer  = nullptr;
+    WGPUBuffer         m_uniform_buffer  = nullptr;
+    WGPUBindGroup      m_bind_group      = nullptr;
+    WGPURenderPipeline m_pipeline        = nullptr;
+
+    // bind group 2 holds the data of the shown property and a colormap, the renderer's
+    // MeshPropertyDefaults are bound when no property is shown
+    FaceColorProperty* m_active_colors  = nullptr;
+    ScalarProperty*    m_active_scalars = nullptr;
+
+    bool               m_uniforms_dirty = false;
+    VisualMeshUniforms m_uniforms;
+    // set when a VisualMeshBatch consumed m_uniforms_dirty, the uniform buffer is still outdated
+    bool m_uniform_buffer_stale = false;
+
+    size_t                m_num_vertices  = 0;
+    size_t                m_num_triangles = 0;
+    std::vector<uint32_t> m_face_offsets;
+    std::vector<uint32_t> m_position_ids;
+    std::vector<uint32_t> m_normal_ids;
+    // faces around every mesh position for smooth normals, built on demand
+    std::vector<uint32_t> m_vertex_face_offsets;
+    std::vector<uint32_t> m_vertex_faces;
 
     std::unordered_map<std::string, std::unique_ptr<FaceVectorProperty>> m_vector_properties;
     std::unordered_map<std::string, std::unique_ptr<FaceColorProperty>>  m_color_properties;
+    std::unordered_map<std::string, std::unique_ptr<ScalarProperty>>     m_scalar_properties;
+};
+
+// Per-object data of a VisualMeshBatch, indexed by the object id stored in the triangles
+struct VisualMeshBatchObject {
+    glm::mat4x4       model_matrix;
+    glm::vec4         mesh_color;
+    glm::vec4         wireframe_color;
+    VisualMeshOptions options;
+};
+
+static_assert(sizeof(VisualMeshBatchObject) % 16 == 0);
+
+// Draws many visual meshes with one pipeline, one bind group and one indirect draw. The
+// geometry of all meshes is packed into shared buffers in the full format whenever the set of
+// meshes changes, afterwards only the objects whose uniforms changed are uploaded. Meshes keep
+// their own buffers so they can leave the batch at any time.
+class VisualMeshBatch {
+public:
+    explicit VisualMeshBatch(const Renderer& renderer) : m_renderer(&renderer) {}
+    ~VisualMeshBatch();
+
+    VisualMeshBatch(const VisualMeshBatch&)            = delete;
+    VisualMeshBatch& operator=(const VisualMeshBatch&) = delete;
+
+    void release();
+
+    // Repacks the geometry if meshes is not the current set of meshes
+    void set_meshes(const std::vector<VisualMesh*>& meshes);
+
+    // Forces a repack with the next set_meshes, needed when a mesh was replaced and a new one
+    // may have the same address
+    void invalidate();
+
+    void draw(RenderEncoder encoder);
+
+    size_t num_objects() const {
+        return m_meshes.size();
+    }
+
+    size_t num_triangles() const {
+        return m_num_triangles;
+    }
+
+private:
+    void build();
+
+    void upload_objects();
+
+    const Renderer* m_renderer = nullptr;
+
+    std::vector<VisualMesh*>           m_meshes;
+    std::vector<VisualMeshBatchObject> m_objects;
+    DirtyRanges                        m_dirty_objects;
+    size_t                             m_num_triangles = 0;
+
+    WGPUBuffer         m_object_buffer   = nullptr;
+    WGPUBuffer         m_position_buffer = nullptr;
+    WGPUBuffer         m_normal_buffer   = nullptr;
+    WGPUBuffer         m_triangle_buffer = nullptr;
+    WGPUBuffer         m_indirect_buffer = nullptr;
+    WGPUBindGroup      m_bind_group      = nullptr;
+    WGPURenderPipeline m_pipeline        = nullptr;
 };
 
+// Spheres are instanced UV sphere meshes with a 80 byte transform per point. Sprites are
+// ray cast sphere impostors with a 20 byte record per point, use them for large clouds.
+enum class PointRenderMode { Spheres, Sprites };
+
 class VisualPointCloud : public Drawable {
 public:
-    VisualPointCloud(const std::vector<glm::vec3>& positions, const Renderer& renderer);
+    VisualPointCloud(const std::vector<glm::vec3>& positions, const Renderer& renderer,
+                     PointRenderMode mode = PointRenderMode::Spheres);
 
-    void draw(WGPURenderPassEncoder render_pass) override {
+    void update() override {
+        if (m_visible && m_sprites) {
+            m_sprites->update();
+        }
+    }
+
+    void draw(RenderEncoder encoder) override {
         if (!m_visible)
             return;
-        m_spheres->draw(render_pass);
-    };
-
-    void on_camera_update() override {
-        m_spheres->on_camera_update();
+        if (m_sprites) {
+            m_sprites->draw(encoder);
+        } else {
+            m_spheres->draw(encoder);
+        }
     };
 
     void set_color(const glm::vec3& color) {
+        m_color = ImVec4(color.x, color.y, color.z, 1.0f);
+        request_redraw();
+        if (m_sprites) {
+            m_sprites->set_color(color);
+            return;
+        }
         m_spheres->set_color(color);
         m_spheres->upload_instance_data();
     };
 
     void set_radius(float radius) {
+        m_radius = radius / m_init_radius;
+        request_redraw();
+        if (m_sprites) {
+            m_sprites->set_radius(radius);
+            return;
+        }
         float                      scale         = radius / m_init_radius;
         std::vector<InstanceData>& instance_data = m_spheres->get_instance_data();
         for (auto& s : instance_data) {
@@ -125,24 +427,39 @@ public:
         m_spheres->upload_instance_data();
     };
 
+    // Creates the GPU data of the new mode and frees the one of the old mode
+    void set_render_mode(PointRenderMode mode);
+
+    PointRenderMode render_mode() const {
+        return m_sprites ? PointRenderMode::Sprites : PointRenderMode::Spheres;
+    }
+
     void update_ui(std::string name) override {
         ImGui::PushID(name.c_str());
         if (m_visible && m_show_options) {
-            
-            ImGui::ColorEdit3("Color", (float*)&m_color); // Edit 3 floats representing a color
-            glm::vec3 newColor(m_color.x, m_color.y, m_color.z);
-            set_color(newColor);
-            ImGui::SliderFloat("Radius", &m_radius, 0.5f, 10.5f);
-            set_radius(m_radius * m_init_radius);
+            if (ImGui::ColorEdit3("Color", (float*)&m_color)) { // Edit 3 floats representing a color
+                set_color(glm::vec3(m_color.x, m_color.y, m_color.z));
+            }
+            if (ImGui::SliderFloat("Radius", &m_radius, 0.5f, 10.5f)) {
+                set_radius(m_radius * m_init_radius);
+            }
+            bool sprites = m_sprites != nullptr;
+            if (ImGui::Checkbox("Sprites", &sprites)) {
+                set_render_mode(sprites ? PointRenderMode::Sprites : PointRenderMode::Spheres);
+            }
         }
         ImGui::PopID();
     }
 
     void set_visible(bool show) {
         m_visible = show;
+        invalidate_commands();
     }
 
+    // only one of them exists, depending on the render mode
     std::unique_ptr<InstancedMesh> m_spheres;
+    std::unique_ptr<PointSprites>  m_sprites;
+    std::vector<glm::vec3>         m_positions;
     float                          m_init_radius = 0.001f;
     // for Imgui interface:
     ImVec4 m_color   = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
@@ -151,84 +468,92 @@ public:
     bool   m_show_options = false;
 };
 
+// Tubes are shaded cylinders with a sphere per vertex. Screen space lines are flat quads of
+// constant width in pixels with 4 vertices per line, use them for large networks.
+enum class LineRenderMode { Tubes, ScreenSpace };
+
 class VisualLineNetwork : public Drawable {
 public:
     VisualLineNetwork(const std::vector<glm::vec3>& positions, const std::vector<std::pair<int, int>>& lines,
-                      const Renderer& renderer);
+                      const Renderer& renderer, LineRenderMode mode = LineRenderMode::Tubes);
 
-    void draw(WGPURenderPassEncoder render_pass) override {
+    void update() override {
         if (!m_visible)
             return;
-        m_line_mesh->draw(render_pass);
-        m_vertices_mesh->draw(render_pass);
+        if (m_screen_lines) {
+            m_screen_lines->update();
+        } else {
+            m_tubes->update();
+        }
     }
 
-    void on_camera_update() override {
-        m_line_mesh->on_camera_update();
-        m_vertices_mesh->on_camera_update();
+    void draw(RenderEncoder encoder) override {
+        if (!m_visible)
+            return;
+        if (m_screen_lines) {
+            m_screen_lines->draw(encoder);
+        } else {
+            m_tubes->draw(encoder);
+        }
     }
 
     void set_color(const glm::vec3& color) {
-        m_line_mesh->set_color(color);
-        m_vertices_mesh->set_color(color);
-        m_line_mesh->upload_instance_data();
-        m_vertices_mesh->upload_instance_data();
+        m_color = color;
+        request_redraw();
+        if (m_screen_lines) {
+            m_screen_lines->set_color(color);
+        } else {
+            m_tubes->set_color(color);
+        }
     };
 
+    // Only writes a uniform, the lines are oriented in the vertex shader
     void set_radius(float radius) {
         m_radius = radius;
-        compute_transforms();
+        request_redraw();
+        if (m_tubes) {
+            m_tubes->set_radius(radius);
+        }
     };
 
-    void compute_transforms() {
-        std::vector<glm::mat4x4> transforms;
-
-        for (auto& line : m_lines) {
-            glm::vec3 p1 = m_positions[line.first];
-            glm::vec3 p2 = m_positions[line.second];
-            glm::vec3 p  = (p1 + p2) / 2.0f;
-            glm::vec3 d  = p2 - p1;
-            float     l  = glm::length(d);
-
-            if (l < 1e-6f)
-                continue; // Skip zero-length lines
-
-            d = d / l; // Normalize
-            glm::vec3 default_dir(0.0f, 1.0f, 0.0f);
-
-            glm::mat4 scaling     = glm::scale(glm::mat4(1), glm::vec3(m_radius, l, m_radius));
-            glm::mat4 translation = glm::translate(glm::mat4(1), p);
-
-            // Handle rotation more robustly
-            float     dot = glm::dot(default_dir, d);
-            glm::mat4 rotation;
-
-            if (dot > 0.9999f) {
-                // Vectors are nearly parallel
-                rotation = glm::mat4(1.0f);
-            } else if (dot < -0.9999f) {
-                // Vectors are nearly anti-parallel
-                rotation = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(1.0f, 0.0f, 0.0f));
-            } else {
-                float     angle         = std::acos(dot);
-                glm::vec3 rotation_axis = glm::normalize(glm::cross(default_dir, d));
-                rotation                = glm::rotate(glm::mat4(1.0f), angle, rotation_axis);
-            }
-
-            glm::mat4 t = translation * rotation * scaling;
-            transforms.push_back(t);
+    // Width of the screen space lines in pixels
+    void set_line_width(float pixels) {
+        m_line_width = pixels;
+        request_redraw();
+        if (m_screen_lines) {
+            m_screen_lines->set_width(pixels);
         }
-        m_line_mesh->set_instance_data(transforms, m_color);
-        m_line_mesh->upload_instance_data();
-
-        std::vector<glm::mat4x4> vertex_transforms;
-        for (const auto& pos : m_positions) {
-            glm::mat4 scaling     = glm::scale(glm::mat4(1), glm::vec3(m_radius, m_radius, m_radius));
-            glm::mat4 translation = glm::translate(glm::mat4(1), pos);
-            vertex_transforms.push_back(translation * scaling);
+    }
+
+    void set_round_caps(bool round_caps) {
+        m_round_caps = round_caps;
+        request_redraw();
+        if (m_screen_lines) {
+            m_screen_lines->set_round_caps(round_caps);
         }
-        m_vertices_mesh->set_instance_data(vertex_transforms, m_color);
-        m_vertices_mesh->upload_instance_data();
+    }
+
+    // Creates the GPU data of the new mode and frees the one of the old mode
+    void set_render_mode(LineRenderMode mode);
+
+    LineRenderMode render_mode() const {
+        return m_screen_lines ? LineRenderMode::ScreenSpace : LineRenderMode::Tubes;
+    }
+
+    // New vertex positions for the same lines, e.g. for every step of a simulation. Writes the
+    // position buffer and nothing else, the lines are rebuilt from it in the vertex shader.
+    void update_positions(const glm::vec3* positions, size_t count);
+
+    void update_positions(const std::vector<glm::vec3>& positions) {
+        update_positions(positions.data(), positions.size());
+    }
+
+    const std::vector<glm::vec3>& positions() const {
+        return m_positions;
+    }
+
+    const std::vector<std::pair<int, int>>& lines() const {
+        return m_lines;
     }
 
     void update_ui(std::string name) override {
@@ -238,7 +563,18 @@ public:
                 glm::vec3 newColor(m_color.x, m_color.y, m_color.z);
                 set_color(newColor);
             }
-            if (ImGui::SliderFloat("Radius", &m_radius, 0.005f, 1.0f)) {
+            bool screen_space = m_screen_lines != nullptr;
+            if (ImGui::Checkbox("Screen Space", &screen_space)) {
+                set_render_mode(screen_space ? LineRenderMode::ScreenSpace : LineRenderMode::Tubes);
+            }
+            if (m_screen_lines) {
+                if (ImGui::SliderFloat("Width (px)", &m_line_width, 1.0f, 20.0f)) {
+                    set_line_width(m_line_width);
+                }
+                if (ImGui::Checkbox("Round Caps", &m_round_caps)) {
+                    set_round_caps(m_round_caps);
+                }
+            } else if (ImGui::SliderFloat("Radius", &m_radius, 0.005f, 1.0f)) {
                 set_radius(m_radius);
             }
         }
@@ -247,15 +583,20 @@ public:
 
     void set_visible(bool show) {
         m_visible = show;
+        invalidate_commands();
     }
 
-    bool                                    m_visible = true;
+    bool                                    m_visible      = true;
     bool                                    m_show_options = false;
-    std::unique_ptr<InstancedMesh>          m_line_mesh;
-    std::unique_ptr<InstancedMesh>          m_vertices_mesh;
-    float                                   m_radius = 0.01f;
-    glm::vec3                               m_color  = glm::vec3(0.45f, 0.55f, 0.60f);
-    const std::vector<glm::vec3>&           m_positions;
-    const std::vector<std::pair<int, int>>& m_lines;
+    // only one of them exists, depending on the render mode
+    std::unique_ptr<TubeNetwork>            m_tubes;
+    std::unique_ptr<ScreenLines>            m_screen_lines;
+    float                                   m_radius     = 0.01f;
+    float                                   m_line_width = 2.0f;
+    bool                                    m_round_caps = true;
+    glm::vec3                               m_color      = glm::vec3(0.45f, 0.55f, 0.60f);
+    // copies, needed to switch the render mode
+    std::vector<glm::vec3>                  m_positions;
+    std::vector<std::pair<int, int>>        m_lines;
 };
 } // namespace rr
\ No newline at end of file
@@ -0,0 +1,283 @@
+#include "VisualPointOctree.h"
+
+#include "Parallel.h"
+#include "Renderer.h"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <utility>
+
+namespace rr {
+
+VisualPointOctree::VisualPointOctree(std::string_view path, const Renderer& renderer)
+    : Drawable(&renderer, BoundingBox()), m_octree(path) {
+    const PointOctreeHeader& header = m_octree.header();
+    m_bbox.lower                    = header.lower;
+    m_bbox.upper                    = header.lower + header.size;
+    m_nodes.resize(m_octree.nodes().size());
+    m_pipeline = point_sprite_pipeline(renderer);
+
+    // reading is mostly waiting for the disk, a few threads keep several reads in flight
+    size_t num_loaders = std::min<size_t>(4, num_worker_threads());
+    if (num_loaders > 1) {
+        for (size_t i = 0; i < num_loaders; ++i) {
+            m_loaders.emplace_back(&VisualPointOctree::loader_main, this);
+        }
+    } else {
+        m_file.open(m_octree.path(), std::ios::binary);
+    }
+}
+
+VisualPointOctree::~VisualPointOctree() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    for (std::thread& loader : m_loaders) {
+        loader.join();
+    }
+    while (!m_resident.empty()) {
+        release_node(m_resident.back());
+    }
+}
+
+void VisualPointOctree::loader_main() {
+    std::ifstream file(m_octree.path(), std::ios::binary);
+    while (true) {
+        uint32_t node;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_stop || !m_requests.empty(); });
+            if (m_stop) {
+                return;
+            }
+            node = m_requests.front();
+            m_requests.pop_front();
+        }
+        LoadedNode loaded = load_node(file, node);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_loaded.push_back(std::move(loaded));
+    }
+}
+
+VisualPointOctree::LoadedNode VisualPointOctree::load_node(std::ifstream& file, uint32_t node) const {
+    LoadedNode loaded;
+    loaded.node = node;
+    try {
+        m_octree.read_points(file, node, loaded.points);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        file.clear();
+        loaded.points.clear();
+        loaded.failed = true;
+    }
+    return loaded;
+}
+
+void VisualPointOctree::select_nodes() {
+    const Renderer&                     renderer = *m_renderer;
+    const std::vector<PointOctreeNode>& nodes    = m_octree.nodes();
+    const glm::mat4&                    view     = renderer.m_camera.transform();
+
+    // Frustum planes from the rows of the view projection matrix (Gribb and Hartmann). The near
+    // plane is that of a [-1, 1] depth range, which is conservative for [0, 1].
+    glm::mat4                rows   = glm::transpose(renderer.m_projection * view);
+    std::array<glm::vec4, 6> planes = {rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                                       rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2]};
+    for (glm::vec4& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    float pixels_per_unit = renderer.m_projection[1][1] * 0.5f * float(renderer.m_height);
+
+    // Projected radius of the bounding sphere in pixels, negative if the node is not visible
+    auto projected_size = [&](uint32_t i) {
+        const PointOctreeNode& node   = nodes[i];
+        float                  radius = 0.8660254f * node.size;
+        glm::vec3              center = node.lower + 0.5f * node.size;
+        for (const glm::vec4& plane : planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+                return -1.0f;
+            }
+        }
+        float distance = glm::length(glm::vec3(view * glm::vec4(center, 1.0f)));
+        if (distance <= radius) {
+            return std::numeric_limits<float>::max();
+        }
+        return radius * pixels_per_unit / distance;
+    };
+
+    m_wanted.clear();
+    std::priority_queue<std::pair<float, uint32_t>> queue;
+    if (float size = projected_size(0); size >= 0.0f) {
+        queue.push({size, 0});
+    }
+    size_t bytes = 0;
+    while (!queue.empty()) {
+        auto [size, i] = queue.top();
+        queue.pop();
+        // the queue is ordered by importance, everything after this is less important
+        if (bytes + node_bytes(i) > m_memory_budget) {
+            break;
+        }
+        bytes += node_bytes(i);
+        m_wanted.push_back(i);
+        m_nodes[i].last_used = m_frame;
+
+        const PointOctreeNode& node = nodes[i];
+        if (size < m_min_node_pixels) {
+            continue;
+        }
+        uint32_t child = node.first_child;
+        for (int c = 0; c < 8; ++c) {
+            if (node.child_mask & (1u << c)) {
+                if (float child_size = projected_size(child); child_size >= 0.0f) {
+                    queue.push({child_size, child});
+                }
+                ++child;
+            }
+        }
+    }
+}
+
+void VisualPointOctree::receive_nodes() {
+    std::vector<LoadedNode> loaded;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        loaded.swap(m_loaded);
+    }
+    for (LoadedNode& l : loaded) {
+        NodeState& state = m_nodes[l.node];
+        state.loading    = false;
+        --m_num_loading;
+        if (l.failed) {
+            state.failed = true;
+        } else if (state.last_used == m_frame) {
+            // the camera may have moved on while the node was read
+            make_resident(l);
+        }
+    }
+}
+
+void VisualPointOctree::request_nodes() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (uint32_t i : m_requests) {
+        m_nodes[i].loading = false;
+        --m_num_loading;
+    }
+    m_requests.clear();
+
+    for (uint32_t i : m_wanted) {
+        if (m_num_loading >= m_max_loading) {
+            break;
+        }
+        NodeState& state = m_nodes[i];
+        if (state.buffer || state.loading || state.failed) {
+            continue;
+        }
+        state.loading = true;
+        ++m_num_loading;
+        m_requests.push_back(i);
+    }
+
+    if (m_loaders.empty()) {
+        // one node per frame keeps the frame time bounded
+        if (!m_requests.empty()) {
+            m_loaded.push_back(load_node(m_file, m_requests.front()));
+            m_requests.pop_front();
+        }
+    } else {
+        m_condition.notify_all();
+    }
+}
+
+void VisualPointOctree::make_resident(LoadedNode& loaded) {
+    size_t bytes = loaded.points.size() * sizeof(PointSprite);
+    if (bytes == 0 || bytes > m_memory_budget || !evict_until(m_memory_budget - bytes)) {
+        return;
+    }
+
+    WGPUBufferDescriptor desc = {};
+    desc.size                 = bytes;
+    desc.usage                = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex;
+    desc.mappedAtCreation     = false;
+
+    NodeState& state = m_nodes[loaded.node];
+    state.buffer     = wgpuDeviceCreateBuffer(m_renderer->m_device, &desc);
+    wgpuQueueWriteBuffer(m_renderer->m_queue, state.buffer, 0, loaded.points.data(), bytes);
+    m_resident.push_back(loaded.node);
+    m_resident_bytes += bytes;
+}
+
+bool VisualPointOctree::evict_until(size_t bytes) {
+    if (m_resident_bytes <= bytes) {
+        return true;
+    }
+    // least recently wanted first, the nodes wanted in this frame stay
+    std::sort(m_resident.begin(), m_resident.end(),
+              [&](uint32_t a, uint32_t b) { return m_nodes[a].last_used > m_nodes[b].last_used; });
+    while (m_resident_bytes > bytes && !m_resident.empty() && m_nodes[m_resident.back()].last_used != m_frame) {
+        release_node(m_resident.back());
+    }
+    return m_resident_bytes <= bytes;
+}
+
+void VisualPointOctree::release_node(uint32_t node) {
+    NodeState& state = m_nodes[node];
+    wgpuBufferDestroy(state.buffer);
+    wgpuBufferRelease(state.buffer);
+    state.buffer = nullptr;
+    m_resident_bytes -= node_bytes(node);
+    m_resident.erase(std::find(m_resident.begin(), m_resident.end(), node));
+}
+
+void VisualPointOctree::update() {
+    if (!m_visible || m_nodes.empty()) {
+        return;
+    }
+
+    ++m_frame;
+    select_nodes();
+    receive_nodes();
+    evict_until(m_memory_budget);
+    request_nodes();
+}
+
+void VisualPointOctree::draw(RenderEncoder encoder) {
+    m_num_drawn_points = 0;
+    if (!m_visible || m_nodes.empty()) {
+        return;
+    }
+
+    // Group 0 is the camera, bound by the renderer
+    encoder.set_pipeline(m_pipeline);
+    for (uint32_t i : m_wanted) {
+        if (m_nodes[i].buffer) {
+            uint32_t count = m_octree.nodes()[i].num_points;
+            encoder.set_vertex_buffer(0, m_nodes[i].buffer, 0, node_bytes(i));
+            encoder.draw(4, count, 0, 0);
+            m_num_drawn_points += count;
+        }
+    }
+}
+
+void VisualPointOctree::update_ui(std::string name) {
+    ImGui::PushID(name.c_str());
+    if (m_visible && m_show_options) {
+        int budget = int(m_memory_budget >> 20);
+        if (ImGui::SliderInt("GPU Budget (MB)", &budget, 64, 4096)) {
+            set_memory_budget(size_t(budget) << 20);
+        }
+        ImGui::SliderFloat("Min Node Pixels", &m_min_node_pixels, 20.0f, 1000.0f);
+    }
+    ImGui::Text("Nodes: %zu / %zu resident, %.1f MB, %zu points drawn", m_resident.size(), m_nodes.size(),
+                double(m_resident_bytes) / double(1 << 20), m_num_drawn_points);
+    ImGui::PopID();
+}
+
+} // namespace rr
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "Drawable.h"
+#include "PointOctree.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <webgpu/webgpu.h>
+
+namespace rr {
+
+class Renderer;
+
+// Streams a point octree file from disk. Every frame the nodes in the view frustum are ranked
+// by their projected size, the largest ones that fit into the GPU memory budget are kept
+// resident and drawn as point sprites. Missing nodes are read by loader threads, nodes that
+// are no longer wanted are evicted least recently used first when the budget is exceeded.
+class VisualPointOctree : public Drawable {
+public:
+    VisualPointOctree(std::string_view path, const Renderer& renderer);
+    ~VisualPointOctree() override;
+
+    VisualPointOctree(const VisualPointOctree&)            = delete;
+    VisualPointOctree& operator=(const VisualPointOctree&) = delete;
+
+    // Selects the nodes of this frame, receives loaded ones and requests missing ones
+    void update() override;
+
+    void draw(RenderEncoder encoder) override;
+
+    // the drawn nodes follow the camera
+    bool is_static() const override {
+        return false;
+    }
+
+    void update_ui(std::string name) override;
+
+    // Loaded nodes are only made resident in draw, so frames are drawn until all loads are done
+    bool needs_redraw() const override {
+        return m_redraw_requested || (m_visible && m_num_loading > 0);
+    }
+
+    void set_visible(bool visible) {
+        m_visible = visible;
+        invalidate_commands();
+    }
+
+    void set_memory_budget(size_t bytes) {
+        m_memory_budget = bytes;
+        request_redraw();
+    }
+
+    // Nodes whose bounding sphere covers fewer pixels on screen are not refined
+    void set_min_node_pixels(float pixels) {
+        m_min_node_pixels = pixels;
+        request_redraw();
+    }
+
+    const PointOctree& octree() const {
+        return m_octree;
+    }
+
+    size_t num_resident_nodes() const {
+        return m_resident.size();
+    }
+
+    size_t resident_bytes() const {
+        return m_resident_bytes;
+    }
+
+    size_t num_drawn_points() const {
+        return m_num_drawn_points;
+    }
+
+    bool m_visible      = true;
+    bool m_show_options = false;
+
+private:
+    struct NodeState {
+        WGPUBuffer buffer    = nullptr;
+        bool       loading   = false; // queued or being read by a loader
+        bool       failed    = false;
+        uint64_t   last_used = 0;     // frame in which the node was last wanted
+    };
+
+    struct LoadedNode {
+        uint32_t                 node;
+        std::vector<PointSprite> points;
+        bool                     failed = false;
+    };
+
+    void loader_main();
+
+    LoadedNode load_node(std::ifstream& file, uint32_t node) const;
+
+    // Ranks the visible nodes and fills m_wanted, most important first
+    void select_nodes();
+
+    void request_nodes();
+
+    void receive_nodes();
+
+    void make_resident(LoadedNode& loaded);
+
+    // Frees resident nodes that were not wanted in this frame until at most `bytes` are used
+    bool evict_until(size_t bytes);
+
+    void release_node(uint32_t node);
+
+    size_t node_bytes(uint32_t node) const {
+        return size_t(m_octree.nodes()[node].num_points) * sizeof(PointSprite);
+    }
+
+    PointOctree            m_octree;
+    std::vector<NodeState> m_nodes;
+    std::vector<uint32_t>  m_wanted;
+    std::vector<uint32_t>  m_resident;
+    uint64_t               m_frame       = 0;
+    size_t                 m_num_loading = 0;
+
+    size_t m_memory_budget    = size_t(512) << 20;
+    float  m_min_node_pixels  = 150.0f;
+    size_t m_max_loading      = 16;
+    size_t m_resident_bytes   = 0;
+    size_t m_num_drawn_points = 0;
+
+    // Shared with the loaders. Requests that were not started yet are taken back every frame,
+    // so the queue always follows the current view.
+    std::mutex              m_mutex;
+    std::condition_variable m_condition;
+    std::deque<uint32_t>    m_requests;
+    std::vector<LoadedNode> m_loaded;
+    bool                    m_stop = false;
+
+    std::vector<std::thread> m_loaders;
+    std::ifstream            m_file; // used on the main thread if there are no loaders
+
+    WGPURenderPipeline m_pipeline = nullptr;
+};
+
+} // namespace rr
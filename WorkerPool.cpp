@@ -0,0 +1,72 @@
+#include "WorkerPool.h"
+
+namespace rr {
+
+WorkerPool::WorkerPool(size_t num_threads) {
+    for (size_t i = 1; i < num_threads; ++i) {
+        m_threads.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::run(size_t count, const std::function<void(size_t)>& job) {
+    if (m_threads.empty() || count <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            job(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job    = &job;
+        m_count  = count;
+        m_next   = 0;
+        m_active = m_threads.size();
+        ++m_generation;
+    }
+    m_wake.notify_all();
+    work();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return m_active == 0; });
+    m_job = nullptr;
+}
+
+void WorkerPool::work() {
+    // jobs are taken one at a time, so uneven jobs still keep every thread busy
+    for (size_t i = m_next++; i < m_count; i = m_next++) {
+        (*m_job)(i);
+    }
+}
+
+void WorkerPool::worker_loop() {
+    uint64_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&]() { return m_stop || m_generation != generation; });
+            if (m_stop) {
+                return;
+            }
+            generation = m_generation;
+        }
+        work();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_active == 0) {
+            m_done.notify_one();
+        }
+    }
+}
+
+} // namespace rr
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rr {
+
+// Threads that are started once and wait for jobs, for work that is dispatched every frame where
+// starting threads like parallel_for does would cost more than the work itself
+class WorkerPool {
+public:
+    // The calling thread of run is one of the threads, so num_threads - 1 workers are started
+    explicit WorkerPool(size_t num_threads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&)            = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t num_threads() const {
+        return m_threads.size() + 1;
+    }
+
+    // Calls job(i) for every i in [0, count) on the workers and the calling thread, returns when
+    // all calls finished. Not reentrant, jobs must not call run themselves.
+    void run(size_t count, const std::function<void(size_t)>& job);
+
+    // Splits [0, count) into at most num_threads contiguous ranges of at least min_grain elements
+    // and calls f(begin, end) for each of them
+    template <typename F> void for_ranges(size_t count, size_t min_grain, F&& f) {
+        size_t num_ranges = std::min(num_threads(), (count + min_grain - 1) / min_grain);
+        if (num_ranges <= 1) {
+            if (count > 0) {
+                f(size_t(0), count);
+            }
+            return;
+        }
+        size_t range_size = (count + num_ranges - 1) / num_ranges;
+        run(num_ranges, [&](size_t r) {
+            size_t begin = std::min(count, r * range_size);
+            size_t end   = std::min(count, begin + range_size);
+            if (begin < end) {
+                f(begin, end);
+            }
+        });
+    }
+
+private:
+    void work();
+    void worker_loop();
+
+    std::vector<std::thread> m_threads;
+    std::mutex               m_mutex;
+    std::condition_variable  m_wake;
+    std::condition_variable  m_done;
+    bool                     m_stop       = false;
+    uint64_t                 m_generation = 0;
+    // workers that have not finished the current run
+    size_t m_active = 0;
+
+    const std::function<void(size_t)>* m_job   = nullptr;
+    size_t                             m_count = 0;
+    std::atomic<size_t>                m_next  = 0;
+};
+
+} // namespace rr
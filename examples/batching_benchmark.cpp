@@ -0,0 +1,96 @@
+// Measures the CPU time to encode one frame of many small meshes, drawn one by one and with
+// mesh batching. The parts are boxes and cylinders on a grid, like a CAD assembly.
+// Usage: batching_benchmark_example [frames per measurement, default 20]
+#include "Primitives.h"
+#include "Renderer.h"
+#include "VisualMesh.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+using namespace rr;
+
+static void add_parts(Renderer& renderer, size_t num_parts) {
+    Mesh box      = create_box();
+    Mesh cylinder = create_cylinder(12);
+    set_flat_normals(box);
+    set_smooth_normals(cylinder);
+
+    size_t side = size_t(std::ceil(std::cbrt(double(num_parts))));
+    float  step = 2.0f / float(side);
+    for (size_t i = 0; i < num_parts; ++i) {
+        glm::vec3 p(float(i % side), float((i / side) % side), float(i / (side * side)));
+        glm::mat4 t = glm::translate(glm::mat4(1.0f), p * step - 1.0f);
+        t           = glm::scale(t, glm::vec3(0.3f * step));
+
+        // register_mesh updates the scene bounds with every call, which is quadratic here
+        auto mesh = std::make_unique<VisualMesh>(i % 2 ? box : cylinder, renderer);
+        mesh->set_transform(t);
+        renderer.m_meshes["part" + std::to_string(i)] = std::move(mesh);
+    }
+}
+
+// Average time in milliseconds to encode a frame, the command buffers are not submitted
+static double encode_time(Renderer& renderer, WGPUTextureView target, int frames) {
+    double total = 0.0;
+    // the first frames upload uniforms and build the batch
+    for (int i = -2; i < frames; ++i) {
+        auto start = std::chrono::steady_clock::now();
+
+        WGPUCommandEncoder    encoder     = wgpuDeviceCreateCommandEncoder(renderer.m_device, nullptr);
+        WGPURenderPassEncoder render_pass = renderer.create_render_pass(target, encoder);
+        renderer.draw_drawables(render_pass);
+        wgpuRenderPassEncoderEnd(render_pass);
+        WGPUCommandBuffer command = wgpuCommandEncoderFinish(encoder, nullptr);
+
+        if (i >= 0) {
+            total += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        wgpuCommandBufferRelease(command);
+        wgpuRenderPassEncoderRelease(render_pass);
+        wgpuCommandEncoderRelease(encoder);
+    }
+    return total / frames;
+}
+
+int main(int argc, char** argv) {
+    int frames = argc > 1 ? std::stoi(argv[1]) : 20;
+
+    Renderer& renderer = Renderer::get();
+
+    WGPUTextureDescriptor texture_desc = {};
+    texture_desc.dimension             = WGPUTextureDimension_2D;
+    texture_desc.format                = renderer.m_swap_chain_format;
+    texture_desc.mipLevelCount         = 1;
+    texture_desc.sampleCount           = 1;
+    texture_desc.size                  = {renderer.m_width, renderer.m_height, 1};
+    texture_desc.usage                 = WGPUTextureUsage_RenderAttachment;
+    WGPUTexture     target             = wgpuDeviceCreateTexture(renderer.m_device, &texture_desc);
+    WGPUTextureView target_view        = wgpuTextureCreateView(target, nullptr);
+
+    for (size_t num_parts : {10000, 50000, 100000}) {
+        renderer.set_mesh_batching(false);
+        renderer.m_meshes.clear();
+        add_parts(renderer, num_parts);
+
+        double individual = encode_time(renderer, target_view, frames);
+        renderer.set_mesh_batching(true);
+        double batched = encode_time(renderer, target_view, frames);
+
+        std::cout << num_parts << " parts\n"
+                  << "  one draw per mesh: " << individual << " ms\n"
+                  << "  batched:           " << batched << " ms\n"
+                  << "  speedup:           " << individual / batched << "x\n";
+    }
+
+    renderer.set_mesh_batching(false);
+    renderer.m_meshes.clear();
+    wgpuTextureViewRelease(target_view);
+    wgpuTextureDestroy(target);
+    wgpuTextureRelease(target);
+    return 0;
+}
@@ -0,0 +1,53 @@
+// Renders a turntable of the mammoth without a window and writes the frames to the temp directory.
+// Usage: headless_example [number of images, default 120] [size, default 512] [--software] [--raw]
+#include "RenderRex.h"
+#include "Utils.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+int main(int argc, char** argv) {
+    size_t   num_images = 120;
+    uint32_t size       = 512;
+    bool     software   = false;
+    bool     raw        = false;
+    int      position   = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--software") == 0) {
+            software = true;
+        } else if (std::strcmp(argv[i], "--raw") == 0) {
+            raw = true;
+        } else if (position++ == 0) {
+            num_images = std::stoul(argv[i]);
+        } else {
+            size = uint32_t(std::stoul(argv[i]));
+        }
+    }
+
+    rr::init_headless(size, size, software);
+    rr::make_visual("mammoth", rr::load_mesh(std::string(RESOURCE_DIR) + "/mammoth_simple.obj"));
+
+    std::filesystem::path       directory = std::filesystem::temp_directory_path() / "renderrex_frames";
+    std::vector<rr::Camera>     cameras;
+    std::vector<std::string>    paths;
+    std::filesystem::create_directories(directory);
+    for (size_t i = 0; i < num_images; ++i) {
+        float angle = 2.0f * 3.14159265f * float(i) / float(num_images);
+        cameras.emplace_back(glm::vec3(5.0f * std::sin(angle), 1.0f, 5.0f * std::cos(angle)), glm::vec3(0.0f),
+                             glm::vec3(0.0f, 1.0f, 0.0f));
+        paths.push_back((directory / ("frame_" + std::to_string(i) + (raw ? ".rgba" : ".png"))).string());
+    }
+
+    auto   start  = std::chrono::steady_clock::now();
+    size_t failed = rr::render_to_files(cameras, paths);
+    double time   = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << num_images << " images of " << size << "x" << size << " in " << time * 1000.0 << " ms, "
+              << double(num_images) / time << " images/s, " << failed << " failed\n";
+    std::cout << "written to " << directory.string() << "\n";
+    return failed == 0 ? 0 : 1;
+}
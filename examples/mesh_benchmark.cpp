@@ -0,0 +1,77 @@
+// Times the parallel mesh kernels on a synthetic quad grid.
+// Usage: mesh_benchmark_example [million faces, default 1] ...
+// e.g. mesh_benchmark_example 1 10 50
+#include "BoundingBox.h"
+#include "Mesh.h"
+#include "Parallel.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+// A wavy grid of roughly num_faces quads
+static rr::Mesh make_grid(size_t num_faces) {
+    size_t   n = size_t(std::ceil(std::sqrt(double(num_faces)))) + 1;
+    rr::Mesh mesh;
+    mesh.positions.resize(n * n);
+    rr::parallel_for(0, n, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            for (size_t x = 0; x < n; ++x) {
+                float z                   = 0.1f * std::sin(0.05f * float(x)) * std::cos(0.05f * float(y));
+                mesh.positions[y * n + x] = glm::vec3(float(x), float(y), z);
+            }
+        }
+    });
+    mesh.position_faces.resize((n - 1) * (n - 1), 4);
+    rr::parallel_for(0, n - 1, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            for (size_t x = 0; x + 1 < n; ++x) {
+                uint32_t a    = uint32_t(y * n + x);
+                auto     face = mesh.position_faces[y * (n - 1) + x];
+                face[0]       = a;
+                face[1]       = a + 1;
+                face[2]       = a + uint32_t(n) + 1;
+                face[3]       = a + uint32_t(n);
+            }
+        }
+    });
+    return mesh;
+}
+
+template <typename F> static double seconds(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char* name, double time, size_t count) {
+    std::cout << "  " << name << time * 1000.0 << " ms, " << double(count) / time * 1e-6 << " M/s\n";
+}
+
+static void benchmark(size_t num_faces) {
+    rr::Mesh mesh = make_grid(num_faces);
+    std::cout << mesh.num_faces() << " quads, " << mesh.num_vertices() << " vertices, " << rr::num_worker_threads()
+              << " threads\n";
+
+    rr::BoundingBox bbox;
+    double          time = seconds([&]() { bbox = rr::BoundingBox(mesh.positions); });
+    report("bounding box:       ", time, mesh.num_vertices());
+    report("translate:          ", seconds([&]() { mesh.translate(-bbox.lower); }), mesh.num_vertices());
+    report("scale:              ", seconds([&]() { mesh.scale(0.5f); }), mesh.num_vertices());
+    report("flat normals:       ", seconds([&]() { rr::set_flat_normals(mesh); }), mesh.num_faces());
+    report("smooth normals:     ", seconds([&]() { rr::set_smooth_normals(mesh); }), mesh.num_faces());
+    size_t num_quads = mesh.num_faces();
+    report("triangulate:        ", seconds([&]() { mesh.triangulate(); }), num_quads);
+    report("smooth normals tri: ", seconds([&]() { rr::set_smooth_normals(mesh); }), mesh.num_faces());
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        benchmark(1000000);
+    }
+    for (int i = 1; i < argc; ++i) {
+        benchmark(size_t(std::stod(argv[i]) * 1e6));
+    }
+    return 0;
+}
@@ -1,5 +1,7 @@
 #include "RenderRex.h"
 
+#include <cmath>
+
 int main() {
     // Define the 8 corners of a cube centered at the origin, with edge length 1.0f.
     std::vector<glm::vec3> positions = {
@@ -22,6 +24,17 @@ int main() {
 
     // Create and show the VisualLineNetwork of the cube.
     rr::VisualLineNetwork* cube = rr::make_visual("CubeNetwork", positions, lines);
+
+    // Let the cube breathe, only the positions are uploaded every frame
+    float time = 0.0f;
+    rr::set_user_callback([&]() {
+        time += 0.02f;
+        std::vector<glm::vec3> moved = positions;
+        for (glm::vec3& p : moved) {
+            p *= 1.0f + 0.2f * std::sin(time);
+        }
+        cube->update_positions(moved);
+    });
     rr::show();
 
     return 0;
@@ -0,0 +1,126 @@
+// Compares the throughput of the memory mapped, parallel OBJ loader with the istream loader, with
+// loading the binary cache and with the same mesh stored as binary PLY.
+// Usage: obj_benchmark_example [synthetic size in MB, default 1024]
+#include "BinaryMesh.h"
+#include "Mesh.h"
+#include "Ply.h"
+#include "Utils.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// Writes a grid of quads with normals and uvs until the file is roughly target_bytes large
+static void write_synthetic_obj(const std::string& path, size_t target_bytes) {
+    std::ofstream file(path, std::ios::binary);
+    std::mt19937  gen(42);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    const size_t row     = 1024;
+    size_t       written = 0;
+    size_t       rows    = 0;
+    char         line[256];
+    std::string  buffer;
+    buffer.reserve(1 << 20);
+
+    while (written < target_bytes) {
+        for (size_t i = 0; i < row; ++i) {
+            int n = std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvn %.6f %.6f %.6f\nvt %.6f %.6f\n",
+                                  float(i) + dist(gen), float(rows) + dist(gen), dist(gen), dist(gen), dist(gen),
+                                  dist(gen), dist(gen), dist(gen));
+            buffer.append(line, size_t(n));
+        }
+        if (rows > 0) {
+            for (size_t i = 0; i + 1 < row; ++i) {
+                size_t a = (rows - 1) * row + i + 1;
+                size_t b = a + 1;
+                size_t c = b + row;
+                size_t d = a + row;
+                int    n = std::snprintf(line, sizeof(line), "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n", a, a,
+                                         a, b, b, b, c, c, c, d, d, d);
+                buffer.append(line, size_t(n));
+            }
+        }
+        ++rows;
+        if (buffer.size() > (1 << 20) - 64 * 1024 || written + buffer.size() >= target_bytes) {
+            file.write(buffer.data(), std::streamsize(buffer.size()));
+            written += buffer.size();
+            buffer.clear();
+        }
+    }
+}
+
+template <typename F> static double seconds(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void benchmark(const std::string& path, int repetitions) {
+    double megabytes = double(fs::file_size(path)) / (1024.0 * 1024.0);
+
+    size_t num_faces = 0;
+    double mapped    = 0.0;
+    for (int i = 0; i < repetitions; ++i) {
+        mapped += seconds([&]() { num_faces = rr::load_mesh(path).num_faces(); });
+    }
+
+    double streamed = 0.0;
+    for (int i = 0; i < repetitions; ++i) {
+        streamed += seconds([&]() {
+            std::ifstream file(path);
+            rr::load_mesh(file);
+        });
+    }
+
+    // the first call writes the cache
+    fs::remove(rr::mesh_cache_path(path));
+    double cache_write = seconds([&]() { rr::load_mesh_cached(path); });
+    double cached      = 0.0;
+    for (int i = 0; i < repetitions; ++i) {
+        cached += seconds([&]() { rr::load_mesh_cached(path); });
+    }
+    fs::remove(rr::mesh_cache_path(path));
+
+    std::string ply_path  = path + ".ply";
+    rr::Mesh    mesh      = rr::load_mesh(path);
+    double      ply_write = seconds([&]() { rr::save_ply(ply_path, mesh); });
+    double      ply       = 0.0;
+    for (int i = 0; i < repetitions; ++i) {
+        ply += seconds([&]() { rr::load_ply(ply_path); });
+    }
+    fs::remove(ply_path);
+
+    mapped /= repetitions;
+    streamed /= repetitions;
+    cached /= repetitions;
+    ply /= repetitions;
+    std::cout << path << " (" << megabytes << " MB, " << num_faces << " faces)\n"
+              << "  mapped parallel: " << mapped << " s, " << megabytes / mapped << " MB/s\n"
+              << "  istream:         " << streamed << " s, " << megabytes / streamed << " MB/s\n"
+              << "  speedup:         " << streamed / mapped << "x\n"
+              << "  cache write:     " << cache_write << " s\n"
+              << "  cached:          " << cached << " s, " << mapped / cached << "x faster than parsing\n"
+              << "  ply write:       " << ply_write << " s\n"
+              << "  binary ply:      " << ply << " s, " << mapped / ply << "x faster than parsing\n";
+}
+
+int main(int argc, char** argv) {
+    size_t synthetic_mb = argc > 1 ? std::stoul(argv[1]) : 1024;
+
+    benchmark(std::string(RESOURCE_DIR) + "/spot.obj", 20);
+
+    std::string synthetic = (fs::temp_directory_path() / "renderrex_synthetic.obj").string();
+    std::cout << "Writing " << synthetic_mb << " MB synthetic OBJ to " << synthetic << std::endl;
+    write_synthetic_obj(synthetic, synthetic_mb * 1024 * 1024);
+    benchmark(synthetic, 1);
+    fs::remove(synthetic);
+
+    return 0;
+}
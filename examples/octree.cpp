@@ -0,0 +1,49 @@
+// Streams a large point cloud through a point octree.
+// Usage: octree_example [points.ply or raw float x, y, z file]
+// Without an argument a synthetic terrain of 50 million points is written to the temp directory.
+#include "RenderRex.h"
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+static std::string write_terrain(size_t num_points) {
+    std::string path = (std::filesystem::temp_directory_path() / "renderrex_terrain.xyz").string();
+    if (std::filesystem::exists(path) && std::filesystem::file_size(path) == num_points * 3 * sizeof(float)) {
+        return path;
+    }
+
+    std::ofstream                         file(path, std::ios::binary);
+    std::mt19937                          rng(42);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<float>                    chunk;
+    for (size_t i = 0; i < num_points; ++i) {
+        float x = uniform(rng);
+        float z = uniform(rng);
+        float y = 0.1f * std::sin(7.0f * x) * std::cos(5.0f * z) + 0.02f * std::sin(60.0f * x + 40.0f * z);
+        chunk.insert(chunk.end(), {x, y, z});
+        if (chunk.size() >= 3 << 20 || i + 1 == num_points) {
+            file.write(reinterpret_cast<const char*>(chunk.data()), std::streamsize(chunk.size() * sizeof(float)));
+            chunk.clear();
+        }
+    }
+    return path;
+}
+
+int main(int argc, char** argv) {
+    std::string path = argc > 1 ? argv[1] : write_terrain(50000000);
+
+    try {
+        rr::make_point_octree("points", path);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    rr::show();
+
+    return 0;
+}
@@ -5,7 +5,8 @@ int main() {
     rr::Mesh spot = rr::load_mesh(std::string(RESOURCE_DIR) + "/spot.obj");
 
     rr::VisualPointCloud* vpc = rr::make_visual("spot_points", spot.positions);
-    
+    vpc->set_render_mode(rr::PointRenderMode::Sprites);
+
     rr::show();
 
     return 0;
@@ -39,7 +39,7 @@ int main() {
 
     // make vector property (face normals)
     std::vector<glm::vec3> face_normals;
-    for(auto& face : mesh.position_faces) {
+    for(auto face : mesh.position_faces) {
         auto normal = glm::normalize(glm::cross(mesh.positions[face[1]] - mesh.positions[face[0]], mesh.positions[face[2]] - mesh.positions[face[0]]));
         face_normals.push_back(normal);
     }
@@ -69,6 +69,18 @@ int main() {
         face_colors2.push_back(rr::get_random_color());
     }
     auto face_colors_prop2 = vm->add_face_colors("face_colors2", face_colors2);
+
+    // scalar properties, colormapped on the gpu
+    std::vector<float> heights;
+    for(const auto& p : mesh.positions) {
+        heights.push_back(p.y);
+    }
+    vm->add_vertex_scalars("height", heights);
+    std::vector<float> face_lengths;
+    for(size_t i = 0; i < mesh.position_faces.size(); ++i) {
+        face_lengths.push_back(glm::length(face_normals_random_length[i]));
+    }
+    vm->add_face_scalars("face_vector_length", face_lengths);
     
     
     rr::show();
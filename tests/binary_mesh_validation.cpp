@@ -0,0 +1,53 @@
+// A binary mesh whose normal faces do not have the corners of the position faces is rejected
+// when it is opened instead of being read out of bounds
+#include "BinaryMesh.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+using namespace rr;
+
+int main() {
+    // a triangle and a quad, so the faces are stored with offsets
+    Mesh mesh;
+    mesh.positions = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {2, 0, 0}, {2, 1, 0}};
+    mesh.normals   = {{0, 0, 1}, {0, 0, 1}, {0, 0, 1}, {0, 0, 1}, {0, 0, 1}};
+    for (FaceList* faces : {&mesh.position_faces, &mesh.normal_faces}) {
+        faces->push_back({0, 1, 2});
+        faces->push_back({1, 3, 4, 2});
+    }
+    std::string path = (std::filesystem::temp_directory_path() / "renderrex_validation.rrmesh").string();
+    save_binary(path, mesh);
+    try {
+        BinaryMeshFile file(path);
+    } catch (const std::runtime_error& e) {
+        std::cerr << "valid file rejected: " << e.what() << "\n";
+        return 1;
+    }
+
+    // normal face offsets 0, 3, 7 become 0, 2, 7: the triangle loses a corner, the indices
+    // and the offsets are still in range
+    BinaryMeshHeader header;
+    std::ifstream(path, std::ios::binary).read(reinterpret_cast<char*>(&header), sizeof(header));
+    uint32_t     truncated = 2;
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(std::streamoff(header.sections[size_t(BinaryMeshSection::NormalFaceOffsets)].offset + 4));
+    file.write(reinterpret_cast<const char*>(&truncated), sizeof(truncated));
+    file.close();
+
+    bool rejected = false;
+    try {
+        BinaryMeshFile corrupt(path);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    std::remove(path.c_str());
+    if (!rejected) {
+        std::cerr << "truncated normal face not rejected\n";
+        return 1;
+    }
+    return 0;
+}
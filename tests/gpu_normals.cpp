@@ -0,0 +1,62 @@
+// The smooth normals of the compute pass shade a mesh like the CPU normals. The grid has
+// alternating narrow and wide columns, so area weighted normals would differ visibly. Renders
+// headless with the software adapter.
+#include "RenderRex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+using namespace rr;
+
+int main() {
+    init_headless(256, 256, true);
+
+    const uint32_t         n = 24;
+    std::vector<glm::vec3> positions;
+    float                  x = -1.0f;
+    for (uint32_t i = 0; i <= n; ++i) {
+        for (uint32_t j = 0; j <= n; ++j) {
+            float z = -1.0f + 2.0f * float(j) / float(n);
+            positions.emplace_back(x, 0.3f * std::sin(3.0f * x) * std::cos(2.0f * z), z);
+        }
+        x += i % 2 ? 0.14f : 0.02f;
+    }
+    std::vector<std::array<uint32_t, 3>> triangles;
+    for (uint32_t i = 0; i < n; ++i) {
+        for (uint32_t j = 0; j < n; ++j) {
+            uint32_t v = i * (n + 1) + j;
+            triangles.push_back({v, v + 1, v + n + 1});
+            triangles.push_back({v + 1, v + n + 2, v + n + 1});
+        }
+    }
+    Mesh mesh(positions, triangles);
+    set_smooth_normals(mesh);
+
+    VisualMesh* visual = make_visual("grid", mesh);
+    visual->set_wireframe_visible(false);
+    Camera camera(glm::vec3(0.0f, 2.0f, 2.5f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    visual->update_positions(positions);
+    Image cpu = render_to_image(camera);
+
+    visual->set_gpu_normals(true);
+    visual->update_positions(positions);
+    Image gpu = render_to_image(camera);
+
+    if (cpu.pixels.empty() || cpu.pixels.size() != gpu.pixels.size()) {
+        std::cerr << "no image\n";
+        return 1;
+    }
+    // allow for rounding, the sums are formed in a different order
+    int max_diff = 0;
+    for (size_t i = 0; i < cpu.pixels.size(); ++i) {
+        max_diff = std::max(max_diff, std::abs(int(cpu.pixels[i]) - int(gpu.pixels[i])));
+    }
+    if (max_diff > 2) {
+        std::cerr << "CPU and GPU normals differ by up to " << max_diff << " in a color channel\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+// An idle scene in on-demand mode must stop drawing, also with mesh batching and hidden meshes.
+// Needs a window.
+#include "Primitives.h"
+#include "Renderer.h"
+#include "VisualMesh.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <string>
+
+using namespace rr;
+
+// Lets the scene settle, then checks that the following frames are skipped
+static bool goes_idle(Renderer& renderer, const char* scene) {
+    for (int i = 0; i < 20; ++i) {
+        renderer.update_frame();
+    }
+    uint64_t drawn   = renderer.frame_count();
+    uint64_t skipped = renderer.skipped_frame_count();
+    for (int i = 0; i < 10; ++i) {
+        renderer.update_frame();
+    }
+    if (renderer.skipped_frame_count() == skipped || renderer.frame_count() != drawn) {
+        std::cerr << scene << ": " << renderer.frame_count() - drawn << " of 10 idle frames were drawn\n";
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    Renderer& renderer = Renderer::get();
+    Mesh      box      = create_box();
+    for (int i = 0; i < 8; ++i) {
+        auto mesh = std::make_unique<VisualMesh>(box, renderer);
+        mesh->set_transform(glm::translate(glm::mat4(1.0f), glm::vec3(2.0f * float(i), 0.0f, 0.0f)));
+        renderer.m_meshes["box" + std::to_string(i)] = std::move(mesh);
+    }
+    renderer.set_on_demand_rendering(true, 0.01);
+
+    bool ok = true;
+    renderer.set_mesh_batching(true);
+    ok &= goes_idle(renderer, "mesh batching");
+
+    renderer.set_mesh_batching(false);
+    VisualMesh* hidden       = renderer.m_meshes["box0"].get();
+    hidden->m_visible_mesh   = false;
+    hidden->m_show_wireframe = false;
+    hidden->set_mesh_visible(false);
+    ok &= goes_idle(renderer, "hidden mesh");
+
+    return ok ? 0 : 1;
+}